@@ -0,0 +1,181 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/*
+ * BlockPool
+ * Hands out fixed-size, aligned memory blocks carved from large slabs. Released blocks
+ * go to a free list and are reused before a new slab is requested. All slabs are
+ * returned to the system when the pool is destroyed.
+ *
+ * A tree gives each leaf one block holding its embeddings row-major, one aligned row per
+ * entry, rather than as a structure of arrays (one array per coordinate). A kNN search
+ * scores one query against every row of a leaf. A contiguous row of hundreds of
+ * coordinates feeds the SIMD distance kernels in a single streaming pass. Column storage
+ * would only pay off for short vectors, where the kernels cannot fill a register with one
+ * row; there it would need a partial sum per entry and a scattered write on every insert.
+ */
+
+class BlockPool {
+    size_t blockSize;
+    size_t alignment;
+    size_t blocksPerSlab;
+
+    std::vector<void*> slabs;
+    void* freeList = nullptr;
+    size_t nextInSlab = 0;
+    // Atomic so that it can be read, as a hint, while another thread allocates
+    std::atomic<size_t> blocksInUse{0};
+
+    void* slotAt(void* slab, size_t index) const {
+        return static_cast<char*>(slab) + index * blockSize;
+    }
+
+public:
+    BlockPool(size_t blockBytes, size_t alignment = 64, size_t blocksPerSlab = 64)
+        : blockSize((std::max(blockBytes, sizeof(void*)) + alignment - 1) / alignment * alignment),
+          alignment(alignment), blocksPerSlab(blocksPerSlab), nextInSlab(blocksPerSlab) {}
+
+    BlockPool(const BlockPool&) = delete;
+    BlockPool& operator=(const BlockPool&) = delete;
+
+    ~BlockPool() {
+        for (void* slab : slabs) {
+            ::operator delete(slab, std::align_val_t(alignment));
+        }
+    }
+
+    void* allocate() {
+        blocksInUse.fetch_add(1, std::memory_order_relaxed);
+
+        if (freeList != nullptr) {
+            void* block = freeList;
+            freeList = *static_cast<void**>(block);
+            return block;
+        }
+
+        if (nextInSlab == blocksPerSlab) {
+            slabs.push_back(::operator new(blockSize * blocksPerSlab, std::align_val_t(alignment)));
+            nextInSlab = 0;
+        }
+        return slotAt(slabs.back(), nextInSlab++);
+    }
+
+    void deallocate(void* block) {
+        blocksInUse.fetch_sub(1, std::memory_order_relaxed);
+        *static_cast<void**>(block) = freeList;
+        freeList = block;
+    }
+
+    size_t getBlockSize() const { return blockSize; }
+    size_t getBlocksInUse() const { return blocksInUse.load(std::memory_order_relaxed); }
+    size_t getReservedBytes() const { return slabs.size() * blocksPerSlab * blockSize; }
+};
+
+/*
+ * ObjectPool
+ * Typed front-end over a BlockPool: constructs objects in pooled blocks and destroys
+ * them back into it.
+ */
+
+template <typename T>
+class ObjectPool {
+    BlockPool blocks;
+
+public:
+    explicit ObjectPool(size_t objectsPerSlab = 64)
+        : blocks(sizeof(T), alignof(T) < 64 ? 64 : alignof(T), objectsPerSlab) {}
+
+    template <typename... Args>
+    T* create(Args&&... args) {
+        void* block = blocks.allocate();
+        try {
+            return new (block) T(std::forward<Args>(args)...);
+        } catch (...) {
+            blocks.deallocate(block);
+            throw;
+        }
+    }
+
+    void destroy(T* object) {
+        object->~T();
+        blocks.deallocate(object);
+    }
+
+    size_t getObjectsInUse() const { return blocks.getBlocksInUse(); }
+    size_t getReservedBytes() const { return blocks.getReservedBytes(); }
+};
+
+/*
+ * AppendOnlyArray
+ * Array of trivially copyable elements that only grows at its end. Growing copies the
+ * elements to a buffer twice as large and publishes it atomically, and the buffers it
+ * replaces stay allocated until releaseRetired(). Elements may thus be read while another
+ * thread appends, as long as the reader learned of them after they were appended; appends
+ * themselves must not overlap.
+ */
+
+template <typename T>
+class AppendOnlyArray {
+    static_assert(std::is_trivially_copyable_v<T>, "AppendOnlyArray copies its elements bytewise");
+
+    std::atomic<T*> elements{nullptr};
+    std::atomic<size_t> count{0};
+    size_t capacity = 0;
+    std::unique_ptr<T[]> buffer;
+    // Buffers replaced by a larger one, which readers may still be using
+    std::vector<std::unique_ptr<T[]>> retired;
+    size_t retiredCapacity = 0;
+
+    void grow(size_t minimum) {
+        size_t larger = std::max({minimum, capacity * 2, size_t(16)});
+        std::unique_ptr<T[]> replacement(new T[larger]);
+        std::copy(buffer.get(), buffer.get() + count.load(std::memory_order_relaxed), replacement.get());
+        if (buffer) {
+            retiredCapacity += capacity;
+            retired.push_back(std::move(buffer));
+        }
+        buffer = std::move(replacement);
+        capacity = larger;
+        elements.store(buffer.get(), std::memory_order_release);
+    }
+
+public:
+    AppendOnlyArray() = default;
+    AppendOnlyArray(const AppendOnlyArray&) = delete;
+    AppendOnlyArray& operator=(const AppendOnlyArray&) = delete;
+
+    void push_back(const T& value) { append(&value, &value + 1); }
+
+    void append(const T* first, const T* last) {
+        size_t size = count.load(std::memory_order_relaxed);
+        size_t added = static_cast<size_t>(last - first);
+        if (size + added > capacity) {
+            grow(size + added);
+        }
+        std::copy(first, last, buffer.get() + size);
+        count.store(size + added, std::memory_order_release);
+    }
+
+    const T& operator[](size_t index) const { return elements.load(std::memory_order_acquire)[index]; }
+    const T* data() const { return elements.load(std::memory_order_acquire); }
+    size_t size() const { return count.load(std::memory_order_acquire); }
+
+    // Frees the replaced buffers; no reader may be running
+    void releaseRetired() {
+        retired.clear();
+        retiredCapacity = 0;
+    }
+
+    size_t getReservedBytes() const { return (capacity + retiredCapacity) * sizeof(T); }
+};
+
+#endif // ARENA_H
@@ -1,23 +1,27 @@
 #ifndef DATA_H
 #define DATA_H
 
-#include <string>
+#include <cstdint>
 #include "Point.h"
 
+// Identifier of a data point within a tree, handed out in insertion order
+using DataId = uint32_t;
+
+template <int Dim = static_cast<int>(DIM), typename Scalar = float>
 class Data {
 private:
-    Point embedding;
-    std::string path;
+    Point<Dim, Scalar> embedding;
+    DataId id;
 
 public:
-    Data(const Point& embedding, const std::string& imagePath)
-        : embedding(embedding), path(imagePath) {}
+    Data(const Point<Dim, Scalar>& embedding, DataId id)
+        : embedding(embedding), id(id) {}
 
-    const Point& getEmbedding() const { return embedding; }
-    const std::string& getPath() const { return path; }
+    const Point<Dim, Scalar>& getEmbedding() const { return embedding; }
+    DataId getId() const { return id; }
 
     bool operator==(const Data& other) const {
-        return path == other.path;
+        return id == other.id;
     }
 };
 
@@ -0,0 +1,122 @@
+#ifndef DATASTORE_H
+#define DATASTORE_H
+
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+#include "Data.h"
+#include "Tags.h"
+
+// Records per chunk of a DataStore; chunks never reallocate, so records keep their address
+constexpr size_t DATA_STORE_CHUNK = 4096;
+
+/*
+ * PathArena
+ * Interns strings back to back in one character blob, addressed by index through an
+ * offset table (the layout of the paths section of an index file). Strings are never
+ * removed, so a path costs its characters plus one offset instead of a heap block each.
+ */
+
+class PathArena {
+    AppendOnlyArray<char> blob;
+    // offsets[i] and offsets[i + 1] delimit string i
+    AppendOnlyArray<uint64_t> offsets;
+
+public:
+    PathArena() { offsets.push_back(0); }
+
+    size_t add(std::string_view path) {
+        blob.append(path.data(), path.data() + path.size());
+        offsets.push_back(blob.size());
+        return offsets.size() - 2;
+    }
+
+    std::string_view get(size_t index) const {
+        return std::string_view(blob.data() + offsets[index], offsets[index + 1] - offsets[index]);
+    }
+
+    size_t size() const { return offsets.size() - 1; }
+
+    void releaseRetired() {
+        blob.releaseRetired();
+        offsets.releaseRetired();
+    }
+
+    size_t getReservedBytes() const { return blob.getReservedBytes() + offsets.getReservedBytes(); }
+};
+
+/*
+ * DataStore
+ * Owns the data of a tree: one record (embedding and id) per point, in chunks of
+ * DATA_STORE_CHUNK records, the paths interned in a PathArena and the tags in a TagArena.
+ * Ids are handed out in insertion order and index all three. Records are never moved nor freed before the
+ * store, so leaves only keep ids and paths are only resolved for results.
+ * Reads go through AppendOnlyArrays (the chunk directory, paths and tags), so they may run
+ * while another thread adds a point; adds must be serialized by the caller.
+ */
+
+template <int Dim = static_cast<int>(DIM), typename Scalar = float>
+class DataStore {
+public:
+    using PointType = Point<Dim, Scalar>;
+    using DataType = Data<Dim, Scalar>;
+
+private:
+    std::vector<std::vector<DataType>> chunks;
+    // chunkRecords[c]: first record of chunks[c], which stays put when `chunks` reallocates
+    AppendOnlyArray<const DataType*> chunkRecords;
+    PathArena paths;
+    TagArena tags;
+
+public:
+    const DataType& add(const PointType& embedding, std::string_view path, const std::vector<Tag>& tagList = {}) {
+        if (paths.size() > std::numeric_limits<DataId>::max()) {
+            throw std::overflow_error("Too many data points for the DataId type");
+        }
+        if (chunks.empty() || chunks.back().size() == DATA_STORE_CHUNK) {
+            chunks.emplace_back();
+            chunks.back().reserve(DATA_STORE_CHUNK);
+            chunkRecords.push_back(chunks.back().data());
+        }
+        DataId id = static_cast<DataId>(paths.size());
+        chunks.back().emplace_back(embedding, id);
+        const DataType& record = chunks.back().back();
+        // Published last: a concurrent reader finds the id valid only once its record, path and tags are in
+        tags.add(tagList);
+        paths.add(path);
+        return record;
+    }
+
+    const DataType& get(DataId id) const { return chunkRecords[id / DATA_STORE_CHUNK][id % DATA_STORE_CHUNK]; }
+    const PointType& getEmbedding(DataId id) const { return get(id).getEmbedding(); }
+    std::string_view getPath(DataId id) const { return paths.get(id); }
+    TagList getTags(DataId id) const { return tags.get(id); }
+
+    bool contains(DataId id) const { return id < paths.size(); }
+    size_t size() const { return paths.size(); }
+
+    // Frees the buffers the arrays grew out of; no reader may be running
+    void releaseRetired() {
+        chunkRecords.releaseRetired();
+        paths.releaseRetired();
+        tags.releaseRetired();
+    }
+
+    size_t getReservedBytes() const {
+        size_t bytes = chunks.capacity() * sizeof(std::vector<DataType>) + chunkRecords.getReservedBytes()
+                       + paths.getReservedBytes() + tags.getReservedBytes();
+        for (const auto& chunk : chunks) {
+            bytes += chunk.capacity() * sizeof(DataType);
+            if (Dim == Eigen::Dynamic) {
+                for (const auto& record : chunk) {
+                    bytes += record.getEmbedding().size() * sizeof(Scalar);
+                }
+            }
+        }
+        return bytes;
+    }
+};
+
+#endif // DATASTORE_H
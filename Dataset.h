@@ -0,0 +1,243 @@
+#ifndef DATASET_H
+#define DATASET_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "Distance.h"
+
+/*
+ * Dataset
+ * A set of float vectors stored row by row, loaded from the usual ANN benchmark formats
+ * (.fvecs, .npy) or generated synthetically.
+ */
+
+struct Dataset {
+    size_t dimension = 0;
+    std::vector<float> values;
+
+    size_t size() const { return dimension == 0 ? 0 : values.size() / dimension; }
+    const float* row(size_t index) const { return values.data() + index * dimension; }
+};
+
+/**
+ * loadFvecs
+ * Reads an .fvecs file: each vector is stored as its int32 dimension followed by its floats.
+ * @param path: File to read.
+ * @param limit: Maximum number of vectors to read (0 reads them all).
+ * @return Dataset: The vectors read.
+ */
+
+inline Dataset loadFvecs(const std::string& path, size_t limit = 0) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        throw std::runtime_error("Cannot open dataset: " + path);
+    }
+
+    Dataset dataset;
+    int32_t dimension = 0;
+    while ((limit == 0 || dataset.size() < limit) && in.read(reinterpret_cast<char*>(&dimension), sizeof(dimension))) {
+        if (dimension <= 0 || (dataset.dimension != 0 && static_cast<size_t>(dimension) != dataset.dimension)) {
+            throw std::runtime_error("Inconsistent vector dimension in " + path);
+        }
+        dataset.dimension = static_cast<size_t>(dimension);
+
+        size_t offset = dataset.values.size();
+        dataset.values.resize(offset + dataset.dimension);
+        if (!in.read(reinterpret_cast<char*>(dataset.values.data() + offset),
+                     static_cast<std::streamsize>(dataset.dimension * sizeof(float)))) {
+            throw std::runtime_error("Truncated vector in " + path);
+        }
+    }
+    return dataset;
+}
+
+/**
+ * loadNpy
+ * Reads a two-dimensional, C-ordered little-endian float32 or float64 .npy array;
+ * float64 values are narrowed to float.
+ * @param path: File to read.
+ * @param limit: Maximum number of rows to read (0 reads them all).
+ * @return Dataset: The rows read.
+ */
+
+inline Dataset loadNpy(const std::string& path, size_t limit = 0) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        throw std::runtime_error("Cannot open dataset: " + path);
+    }
+
+    char magic[8];
+    if (!in.read(magic, sizeof(magic)) || std::memcmp(magic, "\x93NUMPY", 6) != 0) {
+        throw std::runtime_error("Not an .npy file: " + path);
+    }
+
+    uint32_t headerLength = 0;
+    if (magic[6] == 1) {
+        uint16_t shortLength = 0;
+        in.read(reinterpret_cast<char*>(&shortLength), sizeof(shortLength));
+        headerLength = shortLength;
+    } else {
+        in.read(reinterpret_cast<char*>(&headerLength), sizeof(headerLength));
+    }
+    std::string header(headerLength, '\0');
+    if (!in.read(&header[0], headerLength)) {
+        throw std::runtime_error("Truncated .npy header in " + path);
+    }
+
+    bool isDouble = header.find("'<f8'") != std::string::npos;
+    if (!isDouble && header.find("'<f4'") == std::string::npos) {
+        throw std::runtime_error("Only little-endian float32/float64 .npy arrays are supported: " + path);
+    }
+    if (header.find("'fortran_order': True") != std::string::npos) {
+        throw std::runtime_error("Fortran-ordered .npy arrays are not supported: " + path);
+    }
+
+    size_t shapeStart = header.find('(', header.find("'shape'"));
+    size_t shapeEnd = header.find(')', shapeStart);
+    if (shapeStart == std::string::npos || shapeEnd == std::string::npos) {
+        throw std::runtime_error("Missing shape in .npy header of " + path);
+    }
+    std::vector<size_t> shape;
+    for (size_t position = shapeStart + 1; position < shapeEnd;) {
+        size_t next = header.find(',', position);
+        std::string field = header.substr(position, std::min(next, shapeEnd) - position);
+        if (field.find_first_of("0123456789") != std::string::npos) {
+            shape.push_back(std::stoull(field));
+        }
+        position = next == std::string::npos ? shapeEnd : next + 1;
+    }
+    if (shape.size() != 2 || shape[1] == 0) {
+        throw std::runtime_error("Expected a two-dimensional .npy array in " + path);
+    }
+
+    size_t rows = limit == 0 ? shape[0] : std::min(shape[0], limit);
+    Dataset dataset;
+    dataset.dimension = shape[1];
+    dataset.values.resize(rows * dataset.dimension);
+
+    if (isDouble) {
+        std::vector<double> buffer(dataset.values.size());
+        in.read(reinterpret_cast<char*>(buffer.data()), static_cast<std::streamsize>(buffer.size() * sizeof(double)));
+        std::copy(buffer.begin(), buffer.end(), dataset.values.begin());
+    } else {
+        in.read(reinterpret_cast<char*>(dataset.values.data()),
+                static_cast<std::streamsize>(dataset.values.size() * sizeof(float)));
+    }
+    if (!in) {
+        throw std::runtime_error("Truncated .npy data in " + path);
+    }
+    return dataset;
+}
+
+/**
+ * loadDataset
+ * Reads a dataset, choosing the format from the file extension.
+ * @param path: .fvecs or .npy file to read.
+ * @param limit: Maximum number of vectors to read (0 reads them all).
+ * @return Dataset: The vectors read.
+ */
+
+inline Dataset loadDataset(const std::string& path, size_t limit = 0) {
+    auto endsWith = [&path](const std::string& suffix) {
+        return path.size() >= suffix.size() && path.compare(path.size() - suffix.size(), suffix.size(), suffix) == 0;
+    };
+    if (endsWith(".fvecs")) {
+        return loadFvecs(path, limit);
+    }
+    if (endsWith(".npy")) {
+        return loadNpy(path, limit);
+    }
+    throw std::invalid_argument("Unknown dataset format (expected .fvecs or .npy): " + path);
+}
+
+/**
+ * generateUniform
+ * @param count: Number of vectors.
+ * @param dimension: Coordinates per vector.
+ * @param gen: Random generator.
+ * @return Dataset: Vectors with coordinates drawn uniformly from [0, 1).
+ */
+
+inline Dataset generateUniform(size_t count, size_t dimension, std::mt19937& gen) {
+    std::uniform_real_distribution<float> coordinate(0.0f, 1.0f);
+    Dataset dataset;
+    dataset.dimension = dimension;
+    dataset.values.resize(count * dimension);
+    for (auto& value : dataset.values) {
+        value = coordinate(gen);
+    }
+    return dataset;
+}
+
+/**
+ * generateClustered
+ * Points scattered around random cluster centers, closer to real embeddings than uniform noise.
+ * @param count: Number of vectors.
+ * @param dimension: Coordinates per vector.
+ * @param clusters: Number of cluster centers, drawn uniformly from [0, 1).
+ * @param spread: Standard deviation of the points around their center.
+ * @param gen: Random generator.
+ * @return Dataset: The generated vectors.
+ */
+
+inline Dataset generateClustered(size_t count, size_t dimension, size_t clusters, float spread, std::mt19937& gen) {
+    Dataset centers = generateUniform(clusters, dimension, gen);
+    std::normal_distribution<float> noise(0.0f, spread);
+    std::uniform_int_distribution<size_t> pickCenter(0, clusters - 1);
+
+    Dataset dataset;
+    dataset.dimension = dimension;
+    dataset.values.resize(count * dimension);
+    for (size_t i = 0; i < count; ++i) {
+        const float* center = centers.row(pickCenter(gen));
+        for (size_t d = 0; d < dimension; ++d) {
+            dataset.values[i * dimension + d] = center[d] + noise(gen);
+        }
+    }
+    return dataset;
+}
+
+/**
+ * splitQueries
+ * Moves the last vectors of a dataset into a separate query set.
+ * @param dataset: Dataset to split; keeps the remaining vectors.
+ * @param count: Number of vectors to move.
+ * @return Dataset: The queries.
+ */
+
+inline Dataset splitQueries(Dataset& dataset, size_t count) {
+    count = std::min(count, dataset.size());
+    Dataset queries;
+    queries.dimension = dataset.dimension;
+    queries.values.assign(dataset.values.end() - static_cast<std::ptrdiff_t>(count * dataset.dimension), dataset.values.end());
+    dataset.values.resize(dataset.values.size() - count * dataset.dimension);
+    return queries;
+}
+
+/**
+ * normalizeRows
+ * Scales every vector of a dataset to unit length, as cosine similarity expects; zero
+ * vectors are left as they are.
+ * @param dataset: Dataset to normalize in place.
+ */
+
+inline void normalizeRows(Dataset& dataset) {
+    for (size_t r = 0; r < dataset.size(); ++r) {
+        float* row = dataset.values.data() + r * dataset.dimension;
+        float norm = std::sqrt(dotProduct(row, row, dataset.dimension));
+        if (norm > 0.0f) {
+            for (size_t i = 0; i < dataset.dimension; ++i) {
+                row[i] /= norm;
+            }
+        }
+    }
+}
+
+#endif // DATASET_H
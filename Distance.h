@@ -0,0 +1,448 @@
+#ifndef DISTANCE_H
+#define DISTANCE_H
+
+#include <cstddef>
+#include <cmath>
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+/*
+ * Distance kernels
+ * Fused, allocation-free Euclidean distance and inner product kernels over raw coordinate arrays.
+ * The widest instruction set enabled at compile time is used (AVX-512, then AVX2),
+ * with a scalar loop for the remaining coordinates and for other targets.
+ */
+
+#if defined(__AVX512F__)
+
+inline float horizontalSum(__m512 v) {
+    return _mm512_reduce_add_ps(v);
+}
+
+#elif defined(__AVX2__)
+
+inline float horizontalSum(__m256 v) {
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_movehdup_ps(sum));
+    return _mm_cvtss_f32(sum);
+}
+
+inline __m256 squaredDifferenceAdd(__m256 a, __m256 b, __m256 acc) {
+    __m256 diff = _mm256_sub_ps(a, b);
+#if defined(__FMA__)
+    return _mm256_fmadd_ps(diff, diff, acc);
+#else
+    return _mm256_add_ps(_mm256_mul_ps(diff, diff), acc);
+#endif
+}
+
+inline __m256 productAdd(__m256 a, __m256 b, __m256 acc) {
+#if defined(__FMA__)
+    return _mm256_fmadd_ps(a, b, acc);
+#else
+    return _mm256_add_ps(_mm256_mul_ps(a, b), acc);
+#endif
+}
+
+#endif
+
+/**
+ * squaredDistance
+ * Computes the squared Euclidean distance between two coordinate arrays.
+ * @param a: First coordinate array.
+ * @param b: Second coordinate array.
+ * @param n: Number of coordinates.
+ * @return float: Squared distance between `a` and `b`.
+ */
+
+inline float squaredDistance(const float* a, const float* b, std::size_t n) {
+    std::size_t i = 0;
+    float sum = 0.0f;
+
+#if defined(__AVX512F__)
+    __m512 acc0 = _mm512_setzero_ps();
+    __m512 acc1 = _mm512_setzero_ps();
+    for (; i + 32 <= n; i += 32) {
+        __m512 d0 = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+        __m512 d1 = _mm512_sub_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16));
+        acc0 = _mm512_fmadd_ps(d0, d0, acc0);
+        acc1 = _mm512_fmadd_ps(d1, d1, acc1);
+    }
+    for (; i + 16 <= n; i += 16) {
+        __m512 d0 = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+        acc0 = _mm512_fmadd_ps(d0, d0, acc0);
+    }
+    sum = horizontalSum(_mm512_add_ps(acc0, acc1));
+#elif defined(__AVX2__)
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    for (; i + 16 <= n; i += 16) {
+        acc0 = squaredDifferenceAdd(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+        acc1 = squaredDifferenceAdd(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), acc1);
+    }
+    for (; i + 8 <= n; i += 8) {
+        acc0 = squaredDifferenceAdd(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+    }
+    sum = horizontalSum(_mm256_add_ps(acc0, acc1));
+#endif
+
+    for (; i < n; ++i) {
+        float diff = a[i] - b[i];
+        sum += diff * diff;
+    }
+    return sum;
+}
+
+/**
+ * distance
+ * Computes the Euclidean distance between two coordinate arrays.
+ * @param a: First coordinate array.
+ * @param b: Second coordinate array.
+ * @param n: Number of coordinates.
+ * @return float: Distance between `a` and `b`.
+ */
+
+inline float distance(const float* a, const float* b, std::size_t n) {
+    return std::sqrt(squaredDistance(a, b, n));
+}
+
+/**
+ * squaredDistance4
+ * Computes the squared distances from one query to four coordinate arrays at once,
+ * loading every block of the query a single time.
+ * @param query: Query coordinate array.
+ * @param rows: Pointers to the four coordinate arrays.
+ * @param n: Number of coordinates.
+ * @param out: Receives the four squared distances.
+ */
+
+inline void squaredDistance4(const float* query, const float* const* rows, std::size_t n, float* out) {
+    const float* r0 = rows[0];
+    const float* r1 = rows[1];
+    const float* r2 = rows[2];
+    const float* r3 = rows[3];
+    std::size_t i = 0;
+    float s0 = 0.0f, s1 = 0.0f, s2 = 0.0f, s3 = 0.0f;
+
+#if defined(__AVX512F__)
+    __m512 acc0 = _mm512_setzero_ps(), acc1 = _mm512_setzero_ps();
+    __m512 acc2 = _mm512_setzero_ps(), acc3 = _mm512_setzero_ps();
+    for (; i + 16 <= n; i += 16) {
+        __m512 q = _mm512_loadu_ps(query + i);
+        __m512 d0 = _mm512_sub_ps(q, _mm512_loadu_ps(r0 + i));
+        __m512 d1 = _mm512_sub_ps(q, _mm512_loadu_ps(r1 + i));
+        __m512 d2 = _mm512_sub_ps(q, _mm512_loadu_ps(r2 + i));
+        __m512 d3 = _mm512_sub_ps(q, _mm512_loadu_ps(r3 + i));
+        acc0 = _mm512_fmadd_ps(d0, d0, acc0);
+        acc1 = _mm512_fmadd_ps(d1, d1, acc1);
+        acc2 = _mm512_fmadd_ps(d2, d2, acc2);
+        acc3 = _mm512_fmadd_ps(d3, d3, acc3);
+    }
+    s0 = horizontalSum(acc0);
+    s1 = horizontalSum(acc1);
+    s2 = horizontalSum(acc2);
+    s3 = horizontalSum(acc3);
+#elif defined(__AVX2__)
+    __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+    __m256 acc2 = _mm256_setzero_ps(), acc3 = _mm256_setzero_ps();
+    for (; i + 8 <= n; i += 8) {
+        __m256 q = _mm256_loadu_ps(query + i);
+        acc0 = squaredDifferenceAdd(q, _mm256_loadu_ps(r0 + i), acc0);
+        acc1 = squaredDifferenceAdd(q, _mm256_loadu_ps(r1 + i), acc1);
+        acc2 = squaredDifferenceAdd(q, _mm256_loadu_ps(r2 + i), acc2);
+        acc3 = squaredDifferenceAdd(q, _mm256_loadu_ps(r3 + i), acc3);
+    }
+    s0 = horizontalSum(acc0);
+    s1 = horizontalSum(acc1);
+    s2 = horizontalSum(acc2);
+    s3 = horizontalSum(acc3);
+#endif
+
+    for (; i < n; ++i) {
+        float d0 = query[i] - r0[i], d1 = query[i] - r1[i];
+        float d2 = query[i] - r2[i], d3 = query[i] - r3[i];
+        s0 += d0 * d0;
+        s1 += d1 * d1;
+        s2 += d2 * d2;
+        s3 += d3 * d3;
+    }
+
+    out[0] = s0;
+    out[1] = s1;
+    out[2] = s2;
+    out[3] = s3;
+}
+
+/**
+ * squaredDistanceBatch
+ * Computes the squared distances from one query to many coordinate arrays
+ * (e.g. the centroids of a node's children).
+ * @param query: Query coordinate array.
+ * @param rows: Pointers to the coordinate arrays to compare against.
+ * @param count: Number of coordinate arrays.
+ * @param n: Number of coordinates.
+ * @param out: Receives `count` squared distances.
+ */
+
+inline void squaredDistanceBatch(const float* query, const float* const* rows, std::size_t count,
+                                 std::size_t n, float* out) {
+    std::size_t r = 0;
+    for (; r + 4 <= count; r += 4) {
+        squaredDistance4(query, rows + r, n, out + r);
+    }
+    for (; r < count; ++r) {
+        out[r] = squaredDistance(query, rows[r], n);
+    }
+}
+
+/**
+ * squaredDistanceRows
+ * Computes the squared distances from one query to `count` coordinate arrays stored
+ * back to back in one block (e.g. the embeddings of a leaf), streaming through it in order.
+ * @param query: Query coordinate array.
+ * @param rows: First coordinate array of the block.
+ * @param count: Number of coordinate arrays.
+ * @param stride: Distance, in floats, between consecutive coordinate arrays.
+ * @param n: Number of coordinates.
+ * @param out: Receives `count` squared distances.
+ */
+
+inline void squaredDistanceRows(const float* query, const float* rows, std::size_t count, std::size_t stride,
+                                std::size_t n, float* out) {
+    std::size_t r = 0;
+    for (; r + 4 <= count; r += 4) {
+        const float* group[4] = {rows + r * stride, rows + (r + 1) * stride,
+                                 rows + (r + 2) * stride, rows + (r + 3) * stride};
+#if defined(__GNUC__)
+        for (std::size_t ahead = r + 4; ahead < r + 8 && ahead < count; ++ahead) {
+            __builtin_prefetch(rows + ahead * stride);
+        }
+#endif
+        squaredDistance4(query, group, n, out + r);
+    }
+    for (; r < count; ++r) {
+        out[r] = squaredDistance(query, rows + r * stride, n);
+    }
+}
+
+/**
+ * dotProduct
+ * Computes the inner product of two coordinate arrays.
+ * @param a: First coordinate array.
+ * @param b: Second coordinate array.
+ * @param n: Number of coordinates.
+ * @return float: Inner product of `a` and `b`.
+ */
+
+inline float dotProduct(const float* a, const float* b, std::size_t n) {
+    std::size_t i = 0;
+    float sum = 0.0f;
+
+#if defined(__AVX512F__)
+    __m512 acc0 = _mm512_setzero_ps();
+    __m512 acc1 = _mm512_setzero_ps();
+    for (; i + 32 <= n; i += 32) {
+        acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), acc0);
+        acc1 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16), acc1);
+    }
+    for (; i + 16 <= n; i += 16) {
+        acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), acc0);
+    }
+    sum = horizontalSum(_mm512_add_ps(acc0, acc1));
+#elif defined(__AVX2__)
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    for (; i + 16 <= n; i += 16) {
+        acc0 = productAdd(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+        acc1 = productAdd(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), acc1);
+    }
+    for (; i + 8 <= n; i += 8) {
+        acc0 = productAdd(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+    }
+    sum = horizontalSum(_mm256_add_ps(acc0, acc1));
+#endif
+
+    for (; i < n; ++i) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+/**
+ * dotProduct4
+ * Computes the inner products of one query with four coordinate arrays at once,
+ * loading every block of the query a single time.
+ * @param query: Query coordinate array.
+ * @param rows: Pointers to the four coordinate arrays.
+ * @param n: Number of coordinates.
+ * @param out: Receives the four inner products.
+ */
+
+inline void dotProduct4(const float* query, const float* const* rows, std::size_t n, float* out) {
+    const float* r0 = rows[0];
+    const float* r1 = rows[1];
+    const float* r2 = rows[2];
+    const float* r3 = rows[3];
+    std::size_t i = 0;
+    float s0 = 0.0f, s1 = 0.0f, s2 = 0.0f, s3 = 0.0f;
+
+#if defined(__AVX512F__)
+    __m512 acc0 = _mm512_setzero_ps(), acc1 = _mm512_setzero_ps();
+    __m512 acc2 = _mm512_setzero_ps(), acc3 = _mm512_setzero_ps();
+    for (; i + 16 <= n; i += 16) {
+        __m512 q = _mm512_loadu_ps(query + i);
+        acc0 = _mm512_fmadd_ps(q, _mm512_loadu_ps(r0 + i), acc0);
+        acc1 = _mm512_fmadd_ps(q, _mm512_loadu_ps(r1 + i), acc1);
+        acc2 = _mm512_fmadd_ps(q, _mm512_loadu_ps(r2 + i), acc2);
+        acc3 = _mm512_fmadd_ps(q, _mm512_loadu_ps(r3 + i), acc3);
+    }
+    s0 = horizontalSum(acc0);
+    s1 = horizontalSum(acc1);
+    s2 = horizontalSum(acc2);
+    s3 = horizontalSum(acc3);
+#elif defined(__AVX2__)
+    __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+    __m256 acc2 = _mm256_setzero_ps(), acc3 = _mm256_setzero_ps();
+    for (; i + 8 <= n; i += 8) {
+        __m256 q = _mm256_loadu_ps(query + i);
+        acc0 = productAdd(q, _mm256_loadu_ps(r0 + i), acc0);
+        acc1 = productAdd(q, _mm256_loadu_ps(r1 + i), acc1);
+        acc2 = productAdd(q, _mm256_loadu_ps(r2 + i), acc2);
+        acc3 = productAdd(q, _mm256_loadu_ps(r3 + i), acc3);
+    }
+    s0 = horizontalSum(acc0);
+    s1 = horizontalSum(acc1);
+    s2 = horizontalSum(acc2);
+    s3 = horizontalSum(acc3);
+#endif
+
+    for (; i < n; ++i) {
+        s0 += query[i] * r0[i];
+        s1 += query[i] * r1[i];
+        s2 += query[i] * r2[i];
+        s3 += query[i] * r3[i];
+    }
+
+    out[0] = s0;
+    out[1] = s1;
+    out[2] = s2;
+    out[3] = s3;
+}
+
+/**
+ * dotProductBatch
+ * Computes the inner products of one query with many coordinate arrays.
+ * @param query: Query coordinate array.
+ * @param rows: Pointers to the coordinate arrays to compare against.
+ * @param count: Number of coordinate arrays.
+ * @param n: Number of coordinates.
+ * @param out: Receives `count` inner products.
+ */
+
+inline void dotProductBatch(const float* query, const float* const* rows, std::size_t count,
+                            std::size_t n, float* out) {
+    std::size_t r = 0;
+    for (; r + 4 <= count; r += 4) {
+        dotProduct4(query, rows + r, n, out + r);
+    }
+    for (; r < count; ++r) {
+        out[r] = dotProduct(query, rows[r], n);
+    }
+}
+
+/**
+ * dotProductRows
+ * Computes the inner products of one query with `count` coordinate arrays stored back
+ * to back in one block, streaming through it in order.
+ * @param query: Query coordinate array.
+ * @param rows: First coordinate array of the block.
+ * @param count: Number of coordinate arrays.
+ * @param stride: Distance, in floats, between consecutive coordinate arrays.
+ * @param n: Number of coordinates.
+ * @param out: Receives `count` inner products.
+ */
+
+inline void dotProductRows(const float* query, const float* rows, std::size_t count, std::size_t stride,
+                           std::size_t n, float* out) {
+    std::size_t r = 0;
+    for (; r + 4 <= count; r += 4) {
+        const float* group[4] = {rows + r * stride, rows + (r + 1) * stride,
+                                 rows + (r + 2) * stride, rows + (r + 3) * stride};
+#if defined(__GNUC__)
+        for (std::size_t ahead = r + 4; ahead < r + 8 && ahead < count; ++ahead) {
+            __builtin_prefetch(rows + ahead * stride);
+        }
+#endif
+        dotProduct4(query, group, n, out + r);
+    }
+    for (; r < count; ++r) {
+        out[r] = dotProduct(query, rows + r * stride, n);
+    }
+}
+
+/*
+ * Generic kernels
+ * Plain loops used for scalar types without a vectorized specialization (e.g. double).
+ * When the length is a compile-time constant the compiler unrolls and vectorizes them.
+ */
+
+template <typename Scalar>
+inline Scalar squaredDistance(const Scalar* a, const Scalar* b, std::size_t n) {
+    Scalar sum = Scalar(0);
+    for (std::size_t i = 0; i < n; ++i) {
+        Scalar diff = a[i] - b[i];
+        sum += diff * diff;
+    }
+    return sum;
+}
+
+template <typename Scalar>
+inline Scalar distance(const Scalar* a, const Scalar* b, std::size_t n) {
+    return std::sqrt(squaredDistance(a, b, n));
+}
+
+template <typename Scalar>
+inline void squaredDistanceBatch(const Scalar* query, const Scalar* const* rows, std::size_t count,
+                                 std::size_t n, Scalar* out) {
+    for (std::size_t r = 0; r < count; ++r) {
+        out[r] = squaredDistance(query, rows[r], n);
+    }
+}
+
+template <typename Scalar>
+inline void squaredDistanceRows(const Scalar* query, const Scalar* rows, std::size_t count, std::size_t stride,
+                                std::size_t n, Scalar* out) {
+    for (std::size_t r = 0; r < count; ++r) {
+        out[r] = squaredDistance(query, rows + r * stride, n);
+    }
+}
+
+template <typename Scalar>
+inline Scalar dotProduct(const Scalar* a, const Scalar* b, std::size_t n) {
+    Scalar sum = Scalar(0);
+    for (std::size_t i = 0; i < n; ++i) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+template <typename Scalar>
+inline void dotProductBatch(const Scalar* query, const Scalar* const* rows, std::size_t count,
+                            std::size_t n, Scalar* out) {
+    for (std::size_t r = 0; r < count; ++r) {
+        out[r] = dotProduct(query, rows[r], n);
+    }
+}
+
+template <typename Scalar>
+inline void dotProductRows(const Scalar* query, const Scalar* rows, std::size_t count, std::size_t stride,
+                           std::size_t n, Scalar* out) {
+    for (std::size_t r = 0; r < count; ++r) {
+        out[r] = dotProduct(query, rows + r * stride, n);
+    }
+}
+
+#endif // DISTANCE_H
@@ -0,0 +1,79 @@
+#ifndef EPOCH_H
+#define EPOCH_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * EpochDomain
+ * Epoch-based reclamation for memory that readers traverse without holding it locked
+ * throughout, such as the nodes a concurrent search keeps in its queue. Readers enter the
+ * current epoch and leave it when done; a writer that unlinks an object stamps it with the
+ * epoch of the moment and frees it once the epoch has advanced twice past that stamp. The
+ * epoch only advances when no reader is left in the previous one, so by then every reader
+ * that could have reached the object has left.
+ */
+
+class EpochDomain {
+    std::atomic<uint64_t> current{0};
+    // Readers inside an even (active[0]) or odd (active[1]) epoch
+    std::atomic<size_t> active[2] = {0, 0};
+
+public:
+    uint64_t enter() {
+        for (;;) {
+            uint64_t epoch = current.load();
+            active[epoch & 1].fetch_add(1);
+            // The epoch may have advanced before this reader was counted; count it in the new one
+            if (current.load() == epoch) {
+                return epoch;
+            }
+            active[epoch & 1].fetch_sub(1);
+        }
+    }
+
+    void exit(uint64_t epoch) { active[epoch & 1].fetch_sub(1); }
+
+    uint64_t now() const { return current.load(); }
+
+    // Advances the epoch if no reader is left in the previous one, and returns the epoch
+    uint64_t tryAdvance() {
+        uint64_t epoch = current.load();
+        if (active[(epoch + 1) & 1].load() == 0) {
+            current.compare_exchange_strong(epoch, epoch + 1);
+        }
+        return current.load();
+    }
+
+    // Whether an object unlinked at epoch `stamp` can no longer be reached by any reader
+    bool isSafe(uint64_t stamp) const { return current.load() >= stamp + 2; }
+};
+
+/*
+ * EpochGuard
+ * Keeps the calling thread inside an epoch for its lifetime (nothing without a domain).
+ */
+
+class EpochGuard {
+    EpochDomain* domain;
+    uint64_t epoch = 0;
+
+public:
+    explicit EpochGuard(EpochDomain* domain) : domain(domain) {
+        if (domain != nullptr) {
+            epoch = domain->enter();
+        }
+    }
+
+    ~EpochGuard() {
+        if (domain != nullptr) {
+            domain->exit(epoch);
+        }
+    }
+
+    EpochGuard(const EpochGuard&) = delete;
+    EpochGuard& operator=(const EpochGuard&) = delete;
+};
+
+#endif // EPOCH_H
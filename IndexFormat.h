@@ -0,0 +1,62 @@
+#ifndef INDEXFORMAT_H
+#define INDEXFORMAT_H
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * On-disk index format (native byte order, every section 64-byte aligned):
+ *
+ *   IndexHeader
+ *   IndexNode      nodes[nodeCount]                  breadth-first; siblings are contiguous
+ *   Scalar         centroids[nodeCount][stride]      one row per node
+ *   Scalar         embeddings[entryCount][stride]    leaf entries, leaf by leaf
+ *   uint32_t       ids[entryCount]                   DataId the source tree gave each entry
+ *   uint64_t       pathOffsets[entryCount + 1]       into the path blob
+ *   char           paths[]                           payload paths, not terminated
+ *
+ * An internal node's `first` is the index of its first child in `nodes`; a leaf's is the
+ * index of its first entry. Rows are `stride` scalars apart so each one starts aligned.
+ * `metric` is the Metric the source tree searched under, which the mapped index ranks by.
+ */
+
+constexpr uint64_t INDEX_MAGIC = 0x5845444e49545353ULL;  // "SSTINDEX"
+constexpr uint32_t INDEX_VERSION = 3;
+constexpr uint32_t INDEX_BYTE_ORDER = 0x01020304;
+constexpr uint64_t INDEX_ALIGNMENT = 64;
+
+struct IndexHeader {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t scalarSize;
+    uint32_t dimension;
+    uint32_t stride;
+    uint32_t maxPointsPerNode;
+    uint32_t metric;
+    uint32_t reserved;
+    uint64_t nodeCount;
+    uint64_t entryCount;
+    uint64_t nodesOffset;
+    uint64_t centroidsOffset;
+    uint64_t embeddingsOffset;
+    uint64_t idsOffset;
+    uint64_t pathOffsetsOffset;
+    uint64_t pathsOffset;
+    uint64_t fileSize;
+};
+
+struct IndexNode {
+    double radius;
+    uint32_t isLeaf;
+    uint32_t count;
+    uint64_t first;
+};
+
+static_assert(sizeof(IndexNode) == 24, "IndexNode must have no padding");
+
+inline uint64_t alignIndexOffset(uint64_t offset) {
+    return (offset + INDEX_ALIGNMENT - 1) / INDEX_ALIGNMENT * INDEX_ALIGNMENT;
+}
+
+#endif // INDEXFORMAT_H
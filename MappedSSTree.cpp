@@ -0,0 +1,231 @@
+#include "MappedSSTree.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * MappedSSTree
+ * Maps an index file and checks that it matches this tree's scalar type and dimension, and
+ * that every section is aligned and lies within the file. The contents of the node and
+ * path offset tables are trusted as written by SSTree::save.
+ * @param path: Index file written by SSTree::save.
+ */
+
+template <int Dim, typename Scalar>
+MappedSSTree<Dim, Scalar>::MappedSSTree(const std::string& path) : mapping(nullptr), mappingSize(0) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open index file: " + path);
+    }
+
+    struct stat info;
+    if (::fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(IndexHeader)) {
+        ::close(fd);
+        throw std::runtime_error("Index file is too small: " + path);
+    }
+
+    mappingSize = static_cast<size_t>(info.st_size);
+    mapping = ::mmap(nullptr, mappingSize, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        mapping = nullptr;
+        throw std::runtime_error("Cannot map index file: " + path);
+    }
+
+    const char* base = static_cast<const char*>(mapping);
+    header = reinterpret_cast<const IndexHeader*>(base);
+
+    // A section of `count` elements of `size` bytes must be aligned and lie within the file
+    auto sectionFits = [this](uint64_t offset, uint64_t count, uint64_t size) {
+        return offset % INDEX_ALIGNMENT == 0 && offset >= sizeof(IndexHeader) && offset <= mappingSize
+               && count <= (mappingSize - offset) / size;
+    };
+    const uint64_t rowBytes = static_cast<uint64_t>(header->stride) * sizeof(Scalar);
+
+    const char* problem = nullptr;
+    if (header->magic != INDEX_MAGIC) problem = "not an SS-tree index";
+    else if (header->version != INDEX_VERSION) problem = "unsupported format version";
+    else if (header->byteOrder != INDEX_BYTE_ORDER) problem = "written with a different byte order";
+    else if (header->scalarSize != sizeof(Scalar)) problem = "scalar type mismatch";
+    else if (Dim != Eigen::Dynamic && header->dimension != static_cast<uint32_t>(Dim)) problem = "dimension mismatch";
+    else if (header->fileSize != mappingSize) problem = "truncated file";
+    else if (header->metric > static_cast<uint32_t>(Metric::InnerProduct)) problem = "unknown metric";
+    else if (header->dimension == 0 || header->stride < header->dimension) problem = "invalid row stride";
+    else if (!sectionFits(header->nodesOffset, header->nodeCount, sizeof(IndexNode))) problem = "nodes out of range";
+    else if (!sectionFits(header->centroidsOffset, header->nodeCount, rowBytes)) problem = "centroids out of range";
+    else if (!sectionFits(header->embeddingsOffset, header->entryCount, rowBytes)) problem = "embeddings out of range";
+    else if (!sectionFits(header->idsOffset, header->entryCount, sizeof(DataId))) problem = "ids out of range";
+    // entryCount + 1 cannot wrap around: the embeddings check bounds entryCount by the file size
+    else if (!sectionFits(header->pathOffsetsOffset, header->entryCount + 1, sizeof(uint64_t))) {
+        problem = "path offsets out of range";
+    } else if (header->pathsOffset < sizeof(IndexHeader) || header->pathsOffset > mappingSize) {
+        problem = "paths out of range";
+    } else if (reinterpret_cast<const uint64_t*>(base + header->pathOffsetsOffset)[header->entryCount]
+               > mappingSize - header->pathsOffset) {
+        problem = "paths out of range";
+    }
+
+    if (problem != nullptr) {
+        ::munmap(mapping, mappingSize);
+        mapping = nullptr;
+        throw std::runtime_error("Invalid index file " + path + ": " + problem);
+    }
+
+    nodes = reinterpret_cast<const IndexNode*>(base + header->nodesOffset);
+    centroids = reinterpret_cast<const Scalar*>(base + header->centroidsOffset);
+    embeddings = reinterpret_cast<const Scalar*>(base + header->embeddingsOffset);
+    ids = reinterpret_cast<const DataId*>(base + header->idsOffset);
+    pathOffsets = reinterpret_cast<const uint64_t*>(base + header->pathOffsetsOffset);
+    paths = base + header->pathsOffset;
+}
+
+template <int Dim, typename Scalar>
+MappedSSTree<Dim, Scalar>::~MappedSSTree() {
+    if (mapping != nullptr) {
+        ::munmap(mapping, mappingSize);
+    }
+}
+
+template <int Dim, typename Scalar>
+MappedSSTree<Dim, Scalar>::MappedSSTree(MappedSSTree&& other) noexcept
+    : mapping(other.mapping), mappingSize(other.mappingSize), header(other.header), nodes(other.nodes),
+      centroids(other.centroids), embeddings(other.embeddings), ids(other.ids), pathOffsets(other.pathOffsets),
+      paths(other.paths) {
+    other.mapping = nullptr;
+}
+
+/**
+ * getPath
+ * @param entry: Index of an entry.
+ * @return std::string_view: Payload path of the entry, pointing into the mapped file.
+ */
+
+template <int Dim, typename Scalar>
+std::string_view MappedSSTree<Dim, Scalar>::getPath(uint64_t entry) const {
+    return std::string_view(paths + pathOffsets[entry], pathOffsets[entry + 1] - pathOffsets[entry]);
+}
+
+/**
+ * knn-search
+ * Returns the k nearest neighbors under the metric of the saved tree, searching the mapped
+ * nodes best-first.
+ * @param query: point from which to find the k nearest neighbors
+ * @param k: number of neighbors
+ * @return std::vector<Neighbor>: Ids, entries, distances and paths of the k nearest neighbors
+ */
+
+template <int Dim, typename Scalar>
+std::vector<typename MappedSSTree<Dim, Scalar>::Neighbor> MappedSSTree<Dim, Scalar>::knn(const PointType& query,
+                                                                                       size_t k) const {
+    switch (getMetric()) {
+        case Metric::SquaredEuclidean:
+            return knnSearch<Metric::SquaredEuclidean>(query, k);
+        case Metric::Cosine:
+            return knnSearch<Metric::Cosine>(query, k);
+        case Metric::InnerProduct:
+            return knnSearch<Metric::InnerProduct>(query, k);
+        default:
+            return knnSearch<Metric::Euclidean>(query, k);
+    }
+}
+
+/**
+ * knnSearch
+ * Best-first kNN under one metric; entries are ranked by the metric's keys and nodes are
+ * bounded from their full centroids and radii, as in SSTree::knnSearch.
+ * @param query: point from which to find the k nearest neighbors
+ * @param k: number of neighbors
+ * @return std::vector<Neighbor>: Ids, entries, distances and paths of the k nearest neighbors
+ */
+
+template <int Dim, typename Scalar>
+template <Metric M>
+std::vector<typename MappedSSTree<Dim, Scalar>::Neighbor> MappedSSTree<Dim, Scalar>::knnSearch(const PointType& query,
+                                                                                             size_t k) const {
+    using Kernel = MetricKernel<M>;
+    if (header->nodeCount == 0 || k == 0) {
+        return {};
+    }
+
+    const size_t dimension = header->dimension;
+    const size_t stride = header->stride;
+    const Scalar queryNorm = std::sqrt(dotProduct(query.data(), query.data(), dimension));
+
+    auto nodeCompare = [](const std::pair<uint64_t, Scalar>& a, const std::pair<uint64_t, Scalar>& b) {
+        return a.second > b.second;
+    };
+    auto neighborCompare = [](const std::pair<Scalar, uint64_t>& a, const std::pair<Scalar, uint64_t>& b) {
+        return a.first < b.first;
+    };
+
+    std::vector<std::pair<uint64_t, Scalar>> nodeQueue;
+    std::vector<std::pair<Scalar, uint64_t>> nearestNeighbors;
+    std::vector<Scalar> distances;
+    std::vector<const Scalar*> rows;
+
+    Scalar rootScore;
+    Kernel::centroidScores(query.data(), &centroids, 1, dimension, &rootScore);
+    nodeQueue.emplace_back(0, Kernel::nodeBound(rootScore, static_cast<Scalar>(nodes[0].radius), queryNorm, Scalar(1)));
+
+    while (!nodeQueue.empty()) {
+        std::pop_heap(nodeQueue.begin(), nodeQueue.end(), nodeCompare);
+        auto [nodeIndex, nodeDistance] = nodeQueue.back();
+        nodeQueue.pop_back();
+
+        if (nearestNeighbors.size() == k && nodeDistance > nearestNeighbors.front().first) {
+            continue;
+        }
+
+        const IndexNode& node = nodes[nodeIndex];
+        distances.resize(node.count);
+
+        if (node.isLeaf) {
+            Kernel::scoreRows(query.data(), embeddings + node.first * stride, node.count, stride, dimension,
+                              distances.data());
+
+            for (uint32_t i = 0; i < node.count; ++i) {
+                Scalar entryDistance = Kernel::distance(distances[i]);
+                if (nearestNeighbors.size() < k) {
+                    nearestNeighbors.emplace_back(entryDistance, node.first + i);
+                    std::push_heap(nearestNeighbors.begin(), nearestNeighbors.end(), neighborCompare);
+                } else if (entryDistance < nearestNeighbors.front().first) {
+                    std::pop_heap(nearestNeighbors.begin(), nearestNeighbors.end(), neighborCompare);
+                    nearestNeighbors.back() = {entryDistance, node.first + i};
+                    std::push_heap(nearestNeighbors.begin(), nearestNeighbors.end(), neighborCompare);
+                }
+            }
+        } else {
+            rows.clear();
+            for (uint32_t i = 0; i < node.count; ++i) {
+                rows.push_back(centroids + (node.first + i) * stride);
+            }
+            Kernel::centroidScores(query.data(), rows.data(), node.count, dimension, distances.data());
+
+            for (uint32_t i = 0; i < node.count; ++i) {
+                Scalar childDistance = Kernel::nodeBound(distances[i], static_cast<Scalar>(nodes[node.first + i].radius),
+                                                         queryNorm, Scalar(1));
+                if (nearestNeighbors.size() == k && childDistance > nearestNeighbors.front().first) {
+                    continue;
+                }
+                nodeQueue.emplace_back(node.first + i, childDistance);
+                std::push_heap(nodeQueue.begin(), nodeQueue.end(), nodeCompare);
+            }
+        }
+    }
+
+    std::sort_heap(nearestNeighbors.begin(), nearestNeighbors.end(), neighborCompare);
+
+    std::vector<Neighbor> ans;
+    for (const auto& [entryDistance, entry] : nearestNeighbors) {
+        ans.push_back({ids[entry], entry, entryDistance, getPath(entry)});
+    }
+    return ans;
+}
+
+#define INSTANTIATE_MAPPED_SSTREE(Dim, Scalar) template class MappedSSTree<Dim, Scalar>;
+SSTREE_FOR_EACH_INSTANTIATION(INSTANTIATE_MAPPED_SSTREE)
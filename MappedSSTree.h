@@ -0,0 +1,67 @@
+#ifndef MAPPEDSSTREE_H
+#define MAPPEDSSTREE_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Point.h"
+#include "Data.h"
+#include "IndexFormat.h"
+#include "Metric.h"
+
+/*
+ * MappedSSTree
+ * Read-only view of an index written by SSTree::save. The file is memory-mapped and
+ * queries read nodes, centroids and leaf blocks straight from the mapped pages, so
+ * opening costs no deserialization and only the pages a query touches are faulted in.
+ * Queries are ranked under the metric the source tree had when it was saved.
+ */
+
+template <int Dim = static_cast<int>(DIM), typename Scalar = float>
+class MappedSSTree {
+public:
+    using PointType = Point<Dim, Scalar>;
+
+    struct Neighbor {
+        // Id the source tree gave the data point, as its own searches return it
+        DataId id;
+        // Position of the entry in the file
+        uint64_t entry;
+        Scalar distance;
+        std::string_view path;
+    };
+
+private:
+    void* mapping;
+    size_t mappingSize;
+
+    const IndexHeader* header;
+    const IndexNode* nodes;
+    const Scalar* centroids;
+    const Scalar* embeddings;
+    const DataId* ids;
+    const uint64_t* pathOffsets;
+    const char* paths;
+
+    template <Metric M>
+    std::vector<Neighbor> knnSearch(const PointType& query, size_t k) const;
+
+public:
+    explicit MappedSSTree(const std::string& path);
+    ~MappedSSTree();
+
+    MappedSSTree(MappedSSTree&& other) noexcept;
+    MappedSSTree(const MappedSSTree&) = delete;
+    MappedSSTree& operator=(const MappedSSTree&) = delete;
+    MappedSSTree& operator=(MappedSSTree&&) = delete;
+
+    size_t size() const { return header->entryCount; }
+    size_t getDimension() const { return header->dimension; }
+    Metric getMetric() const { return static_cast<Metric>(header->metric); }
+    std::string_view getPath(uint64_t entry) const;
+    DataId getId(uint64_t entry) const { return ids[entry]; }
+
+    std::vector<Neighbor> knn(const PointType& query, size_t k) const;
+};
+
+#endif // MAPPEDSSTREE_H
@@ -0,0 +1,184 @@
+#ifndef METRIC_H
+#define METRIC_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include "Distance.h"
+
+/*
+ * Metric
+ * How kNN and range searches measure the distance from the query to the data. Nodes keep
+ * their Euclidean bounding spheres whatever the metric: each metric below derives a sound
+ * bound from a sphere, so the same tree answers queries under any of them.
+ */
+
+enum class Metric {
+    // |q - x|
+    Euclidean,
+    // |q - x|^2
+    SquaredEuclidean,
+    // 1 - q.x, for a query and data normalized to unit length
+    Cosine,
+    // -q.x, so that the largest inner products come first
+    InnerProduct
+};
+
+/*
+ * MetricKernel
+ * Compile-time policy of a Metric. Searches rank entries by a key (smaller is nearer)
+ * computed by the metric's own vectorized kernel, convert keys to the distances they
+ * report with `distance`, and bound a node from the score of its centroid with `nodeBound`:
+ *   - scoreRows / scoreBatch: keys of the entries of a leaf block or of scattered rows;
+ *   - centroidScores: squared distances to the centroids for the Euclidean metrics, inner
+ *     products for InnerProduct;
+ *   - nodeBound: smallest distance of a point in the sphere, from the centroid score, the
+ *     radius and the norm of the query.
+ * Metrics whose keys order entries as the Euclidean distance does (`euclideanOrder`) also
+ * accept projected centroids and quantized rows, both of which only approximate, or bound,
+ * Euclidean distances; `fromSquaredDistance` maps such a squared distance to a key.
+ */
+
+template <Metric M>
+struct MetricKernel;
+
+template <>
+struct MetricKernel<Metric::Euclidean> {
+    static constexpr bool euclideanOrder = true;
+
+    // Keys are squared distances, so that the leaf scan needs no square root
+    template <typename Scalar>
+    static void scoreRows(const Scalar* query, const Scalar* rows, size_t count, size_t stride, size_t n, Scalar* out) {
+        squaredDistanceRows(query, rows, count, stride, n, out);
+    }
+
+    template <typename Scalar>
+    static void scoreBatch(const Scalar* query, const Scalar* const* rows, size_t count, size_t n, Scalar* out) {
+        squaredDistanceBatch(query, rows, count, n, out);
+    }
+
+    template <typename Scalar>
+    static void centroidScores(const Scalar* query, const Scalar* const* rows, size_t count, size_t n, Scalar* out) {
+        squaredDistanceBatch(query, rows, count, n, out);
+    }
+
+    template <typename Scalar>
+    static Scalar fromSquaredDistance(Scalar squared) { return squared; }
+
+    template <typename Scalar>
+    static Scalar distance(Scalar key) { return std::sqrt(key); }
+
+    template <typename Scalar>
+    static Scalar nodeBound(Scalar centroidScore, Scalar radius, Scalar, Scalar scale) {
+        return std::sqrt(centroidScore) * scale - radius;
+    }
+};
+
+template <>
+struct MetricKernel<Metric::SquaredEuclidean> {
+    static constexpr bool euclideanOrder = true;
+
+    template <typename Scalar>
+    static void scoreRows(const Scalar* query, const Scalar* rows, size_t count, size_t stride, size_t n, Scalar* out) {
+        squaredDistanceRows(query, rows, count, stride, n, out);
+    }
+
+    template <typename Scalar>
+    static void scoreBatch(const Scalar* query, const Scalar* const* rows, size_t count, size_t n, Scalar* out) {
+        squaredDistanceBatch(query, rows, count, n, out);
+    }
+
+    template <typename Scalar>
+    static void centroidScores(const Scalar* query, const Scalar* const* rows, size_t count, size_t n, Scalar* out) {
+        squaredDistanceBatch(query, rows, count, n, out);
+    }
+
+    template <typename Scalar>
+    static Scalar fromSquaredDistance(Scalar squared) { return squared; }
+
+    template <typename Scalar>
+    static Scalar distance(Scalar key) { return key; }
+
+    template <typename Scalar>
+    static Scalar nodeBound(Scalar centroidScore, Scalar radius, Scalar, Scalar scale) {
+        Scalar gap = std::max(Scalar(0), std::sqrt(centroidScore) * scale - radius);
+        return gap * gap;
+    }
+};
+
+template <>
+struct MetricKernel<Metric::Cosine> {
+    // For unit vectors 1 - q.x = |q - x|^2 / 2
+    static constexpr bool euclideanOrder = true;
+
+    template <typename Scalar>
+    static void scoreRows(const Scalar* query, const Scalar* rows, size_t count, size_t stride, size_t n, Scalar* out) {
+        dotProductRows(query, rows, count, stride, n, out);
+        for (size_t i = 0; i < count; ++i) {
+            out[i] = Scalar(1) - out[i];
+        }
+    }
+
+    template <typename Scalar>
+    static void scoreBatch(const Scalar* query, const Scalar* const* rows, size_t count, size_t n, Scalar* out) {
+        dotProductBatch(query, rows, count, n, out);
+        for (size_t i = 0; i < count; ++i) {
+            out[i] = Scalar(1) - out[i];
+        }
+    }
+
+    // Centroids are not unit vectors, so nodes are still bounded on Euclidean distances
+    template <typename Scalar>
+    static void centroidScores(const Scalar* query, const Scalar* const* rows, size_t count, size_t n, Scalar* out) {
+        squaredDistanceBatch(query, rows, count, n, out);
+    }
+
+    template <typename Scalar>
+    static Scalar fromSquaredDistance(Scalar squared) { return squared / Scalar(2); }
+
+    template <typename Scalar>
+    static Scalar distance(Scalar key) { return key; }
+
+    template <typename Scalar>
+    static Scalar nodeBound(Scalar centroidScore, Scalar radius, Scalar, Scalar scale) {
+        Scalar gap = std::max(Scalar(0), std::sqrt(centroidScore) * scale - radius);
+        return gap * gap / Scalar(2);
+    }
+};
+
+template <>
+struct MetricKernel<Metric::InnerProduct> {
+    static constexpr bool euclideanOrder = false;
+
+    template <typename Scalar>
+    static void scoreRows(const Scalar* query, const Scalar* rows, size_t count, size_t stride, size_t n, Scalar* out) {
+        dotProductRows(query, rows, count, stride, n, out);
+        for (size_t i = 0; i < count; ++i) {
+            out[i] = -out[i];
+        }
+    }
+
+    template <typename Scalar>
+    static void scoreBatch(const Scalar* query, const Scalar* const* rows, size_t count, size_t n, Scalar* out) {
+        dotProductBatch(query, rows, count, n, out);
+        for (size_t i = 0; i < count; ++i) {
+            out[i] = -out[i];
+        }
+    }
+
+    template <typename Scalar>
+    static void centroidScores(const Scalar* query, const Scalar* const* rows, size_t count, size_t n, Scalar* out) {
+        dotProductBatch(query, rows, count, n, out);
+    }
+
+    template <typename Scalar>
+    static Scalar distance(Scalar key) { return key; }
+
+    // By Cauchy-Schwarz, q.x <= q.c + |q| r for every x within r of c
+    template <typename Scalar>
+    static Scalar nodeBound(Scalar centroidScore, Scalar radius, Scalar queryNorm, Scalar) {
+        return -(centroidScore + queryNorm * radius);
+    }
+};
+
+#endif // METRIC_H
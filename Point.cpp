@@ -1,46 +1,48 @@
 #include "Point.h"
 
-Point::Point(const Eigen::VectorXf& coordinates) : coordinates_(coordinates) {
-    if (coordinates.size() != DIM) {
-        throw std::invalid_argument("Incorrect dimensionality :c");
-    }
-}
-
-Point Point::operator+(const Point& other) const {
+template <int Dim, typename Scalar>
+Point<Dim, Scalar> Point<Dim, Scalar>::operator+(const Point& other) const {
     return Point(coordinates_ + other.coordinates_);
 }
 
-Point& Point::operator+=(const Point& other) {
+template <int Dim, typename Scalar>
+Point<Dim, Scalar>& Point<Dim, Scalar>::operator+=(const Point& other) {
     coordinates_ += other.coordinates_;
     return *this;
 }
 
-Point Point::operator-(const Point& other) const {
+template <int Dim, typename Scalar>
+Point<Dim, Scalar> Point<Dim, Scalar>::operator-(const Point& other) const {
     return Point(coordinates_ - other.coordinates_);
 }
 
-Point& Point::operator-=(const Point& other) {
+template <int Dim, typename Scalar>
+Point<Dim, Scalar>& Point<Dim, Scalar>::operator-=(const Point& other) {
     coordinates_ -= other.coordinates_;
     return *this;
 }
 
-Point Point::operator*(float scalar) const {
+template <int Dim, typename Scalar>
+Point<Dim, Scalar> Point<Dim, Scalar>::operator*(Scalar scalar) const {
     return Point(coordinates_ * scalar);
 }
 
-Point& Point::operator*=(float scalar) {
+template <int Dim, typename Scalar>
+Point<Dim, Scalar>& Point<Dim, Scalar>::operator*=(Scalar scalar) {
     coordinates_ *= scalar;
     return *this;
 }
 
-Point Point::operator/(float scalar) const {
+template <int Dim, typename Scalar>
+Point<Dim, Scalar> Point<Dim, Scalar>::operator/(Scalar scalar) const {
     if (std::abs(scalar) < EPSILON) {
         throw std::invalid_argument("Division by zero (or near zero).");
     }
     return Point(coordinates_ / scalar);
 }
 
-Point& Point::operator/=(float scalar) {
+template <int Dim, typename Scalar>
+Point<Dim, Scalar>& Point<Dim, Scalar>::operator/=(Scalar scalar) {
     if (std::abs(scalar) < EPSILON) {
         throw std::invalid_argument("Division by zero (or near zero).");
     }
@@ -48,24 +50,29 @@ Point& Point::operator/=(float scalar) {
     return *this;
 }
 
-Point Point::random(float min, float max) {
+template <int Dim, typename Scalar>
+Point<Dim, Scalar> Point<Dim, Scalar>::random(Scalar min, Scalar max, std::size_t dimension) {
     static std::random_device rd;
     static std::mt19937 gen(rd());
-    std::uniform_real_distribution<float> dis(min, max);
+    std::uniform_real_distribution<Scalar> dis(min, max);
 
-    Eigen::VectorXf coordinates(DIM);
-    for (std::size_t i = 0; i < DIM; ++i) {
+    Vector coordinates(dimension);
+    for (std::size_t i = 0; i < dimension; ++i) {
         coordinates[i] = dis(gen);
     }
 
     return Point(coordinates);
 }
 
-void Point::print() const {
+template <int Dim, typename Scalar>
+void Point<Dim, Scalar>::print() const {
     std::cout << "Point(";
-    for (std::size_t i = 0; i < DIM; ++i) {
+    for (std::size_t i = 0; i < size(); ++i) {
         std::cout << coordinates_[i];
-        if (i < DIM - 1) std::cout << ", ";
+        if (i < size() - 1) std::cout << ", ";
     }
     std::cout << ")" << std::endl;
-}
\ No newline at end of file
+}
+
+#define INSTANTIATE_POINT(Dim, Scalar) template class Point<Dim, Scalar>;
+SSTREE_FOR_EACH_INSTANTIATION(INSTANTIATE_POINT)
@@ -5,17 +5,36 @@
 #include <stdexcept>
 #include <random>
 #include <iostream>
+#include "Distance.h"
 
 constexpr std::size_t DIM = 768;
 constexpr float EPSILON = 1e-8f;
 
+/*
+ * Dimensions and scalar types the library is compiled for. Every entry gets an explicit
+ * instantiation of Point, SSNode and SSTree; Eigen::Dynamic is the runtime-dimension fallback.
+ */
+#define SSTREE_FOR_EACH_INSTANTIATION(X) \
+    X(128, float)                        \
+    X(384, float)                        \
+    X(768, float)                        \
+    X(1024, float)                       \
+    X(Eigen::Dynamic, float)             \
+    X(Eigen::Dynamic, double)
+
+template <int Dim = static_cast<int>(DIM), typename Scalar = float>
 class Point {
 public:
-    Point() : coordinates_(Eigen::VectorXf::Zero(DIM)) {}
-    explicit Point(const Eigen::VectorXf& coordinates);
+    using Vector = Eigen::Matrix<Scalar, Dim, 1>;
+
+    // Number of coordinates of a default point (runtime-sized points must be given one)
+    static constexpr std::size_t defaultDimension = Dim == Eigen::Dynamic ? 0 : static_cast<std::size_t>(Dim);
 
-    static Point Zero() {
-        return Point(Eigen::VectorXf::Zero(DIM));
+    Point() : coordinates_(Vector::Zero(defaultDimension)) {}
+    explicit Point(const Vector& coordinates) : coordinates_(coordinates) {}
+
+    static Point Zero(std::size_t dimension = defaultDimension) {
+        return Point(Vector::Zero(dimension));
     }
 
     Point cwiseProduct(const Point& other) const {
@@ -26,28 +45,32 @@ public:
     Point& operator+=(const Point& other);
     Point  operator- (const Point& other) const;
     Point& operator-=(const Point& other);
-    Point  operator* (float scalar) const;
-    Point& operator*=(float scalar);
-    Point  operator/ (float scalar) const;
-    Point& operator/=(float scalar);
+    Point  operator* (Scalar scalar) const;
+    Point& operator*=(Scalar scalar);
+    Point  operator/ (Scalar scalar) const;
+    Point& operator/=(Scalar scalar);
+
+    Scalar dot(const Point& other) const { return coordinates_.dot(other.coordinates_); }
+    Scalar norm() const { return coordinates_.norm(); }
+    Scalar normSquared() const { return coordinates_.squaredNorm(); }
+    Scalar distance(const Point& other) const { return ::distance(data(), other.data(), size()); }
 
-    float norm() const { return coordinates_.norm(); }
-    float normSquared() const { return coordinates_.squaredNorm(); }
-    float distance(const Point& other) const { return (*this - other).norm(); }
+    static Scalar distance(const Point& a, const Point& b) { return ::distance(a.data(), b.data(), a.size()); }
 
-    static float distance(const Point& a, const Point& b) { return (a - b).norm(); }
+    Scalar distanceSquared(const Point& other) const { return squaredDistance(data(), other.data(), size()); }
 
-    float distanceSquared(const Point& other) const { return (*this - other).normSquared(); }
+    const Scalar* data() const { return coordinates_.data(); }
+    std::size_t size() const { return static_cast<std::size_t>(coordinates_.size()); }
 
-    float  operator[](std::size_t index) const { return coordinates_(index); }
-    float& operator[](std::size_t index) { return coordinates_(index); }
+    Scalar  operator[](std::size_t index) const { return coordinates_(index); }
+    Scalar& operator[](std::size_t index) { return coordinates_(index); }
 
-    static Point random(float min = 0.0f, float max = 1.0f);
+    static Point random(Scalar min = Scalar(0), Scalar max = Scalar(1), std::size_t dimension = defaultDimension);
 
     void print() const;
 
 private:
-    Eigen::VectorXf coordinates_;
+    Vector coordinates_;
 };
 
 #endif // POINT_H
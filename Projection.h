@@ -0,0 +1,127 @@
+#ifndef PROJECTION_H
+#define PROJECTION_H
+
+#include <Eigen/Dense>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+
+/*
+ * Routing
+ * How kNN searches bound the distance from the query to the spheres of the nodes. Full
+ * uses the full-dimensional centroids; the other modes use centroids projected onto a
+ * few orthonormal directions, which are cheaper to compare and still give lower bounds,
+ * since an orthonormal projection never lengthens a vector. Leaves are always scanned
+ * in full dimension, so the results stay exact.
+ */
+
+enum class Routing {
+    Full,
+    // Directions drawn at random, independent of the data
+    RandomProjection,
+    // Directions of highest variance of the data, found by subspace iteration
+    PrincipalComponents
+};
+
+/*
+ * RoutingProjection
+ * Linear map x -> P x onto the orthonormal rows of P.
+ */
+
+template <typename Scalar>
+class RoutingProjection {
+    using Matrix = Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic>;
+    using Vector = Eigen::Matrix<Scalar, Eigen::Dynamic, 1>;
+
+    // One direction per row
+    Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> directions;
+
+    /**
+     * orthonormalColumns
+     * @param columns: Linearly independent columns.
+     * @return Matrix: Orthonormal basis of the span of the columns, one vector per column.
+     */
+
+    static Matrix orthonormalColumns(const Matrix& columns) {
+        Eigen::HouseholderQR<Matrix> qr(columns);
+        return qr.householderQ() * Matrix::Identity(columns.rows(), columns.cols());
+    }
+
+    /**
+     * gaussian
+     * @return Matrix: Matrix of independent standard normal entries.
+     */
+
+    static Matrix gaussian(std::size_t rows, std::size_t cols, uint32_t seed) {
+        std::mt19937 gen(seed);
+        std::normal_distribution<double> normal(0.0, 1.0);
+        Matrix matrix(rows, cols);
+        for (std::size_t c = 0; c < cols; ++c) {
+            for (std::size_t r = 0; r < rows; ++r) {
+                matrix(r, c) = static_cast<Scalar>(normal(gen));
+            }
+        }
+        return matrix;
+    }
+
+public:
+    bool isTrained() const { return directions.size() > 0; }
+    std::size_t outputDimension() const { return static_cast<std::size_t>(directions.rows()); }
+    std::size_t getReservedBytes() const { return static_cast<std::size_t>(directions.size()) * sizeof(Scalar); }
+
+    /**
+     * trainRandom
+     * Draws uniformly random orthonormal directions.
+     * @param inputDimension: Number of coordinates of the embeddings.
+     * @param outputDimension: Number of directions (at most inputDimension).
+     * @param seed: Seed of the random directions.
+     */
+
+    void trainRandom(std::size_t inputDimension, std::size_t outputDimension, uint32_t seed) {
+        outputDimension = std::min(outputDimension, inputDimension);
+        directions = orthonormalColumns(gaussian(inputDimension, outputDimension, seed)).transpose();
+    }
+
+    /**
+     * trainPrincipal
+     * Finds the directions of highest variance of a sample by subspace iteration: starting
+     * from random directions, repeatedly multiplies by the covariance of the sample and
+     * re-orthonormalizes.
+     * @param rows: Pointers to the sample embeddings.
+     * @param count: Number of embeddings.
+     * @param inputDimension: Number of coordinates of the embeddings.
+     * @param outputDimension: Number of directions (at most inputDimension).
+     * @param iterations: Number of subspace iterations.
+     * @param seed: Seed of the starting directions.
+     */
+
+    void trainPrincipal(const Scalar* const* rows, std::size_t count, std::size_t inputDimension,
+                        std::size_t outputDimension, std::size_t iterations, uint32_t seed) {
+        outputDimension = std::min(outputDimension, inputDimension);
+        Matrix sample(count, inputDimension);
+        for (std::size_t r = 0; r < count; ++r) {
+            sample.row(r) = Eigen::Map<const Vector>(rows[r], inputDimension).transpose();
+        }
+        sample.rowwise() -= sample.colwise().mean();
+
+        Matrix basis = orthonormalColumns(gaussian(inputDimension, outputDimension, seed));
+        for (std::size_t iteration = 0; iteration < iterations; ++iteration) {
+            basis = orthonormalColumns(sample.transpose() * (sample * basis));
+        }
+        directions = basis.transpose();
+    }
+
+    /**
+     * project
+     * @param coordinates: Embedding of inputDimension coordinates.
+     * @param projected: Receives outputDimension() coordinates.
+     */
+
+    void project(const Scalar* coordinates, Scalar* projected) const {
+        Eigen::Map<Vector>(projected, directions.rows()).noalias() =
+            directions * Eigen::Map<const Vector>(coordinates, directions.cols());
+    }
+};
+
+#endif // PROJECTION_H
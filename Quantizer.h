@@ -0,0 +1,272 @@
+#ifndef QUANTIZER_H
+#define QUANTIZER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+#include "Distance.h"
+
+/*
+ * Leaf storage
+ * How leaves keep the copies of their embeddings that knn scans. Float stores them
+ * unchanged; Int8 and Float16 store compact codes that are scanned approximately,
+ * with the final candidates re-ranked on the exact embeddings held by each Data.
+ * The data store keeps those exact embeddings in every format, so Float holds each
+ * embedding twice and doubles their memory: the leaf rows (MemoryUsage::leafBlockBytes)
+ * come on top of the records (MemoryUsage::dataBytes), in exchange for leaves that are
+ * scanned as contiguous rows rather than one record lookup per entry. For the same
+ * reason Int8 and Float16 cut the leaf rows 4x and 2x, not the index: at 768 dimensions
+ * an Int8 tree takes about 1.5x less memory in total than a Float one.
+ */
+
+enum class LeafStorage {
+    Float,
+    Int8,
+    Float16
+};
+
+/**
+ * floatToHalf
+ * Converts a float to IEEE 754 half precision, rounding to nearest even.
+ * @param value: Value to convert.
+ * @return uint16_t: Bits of the half-precision value.
+ */
+
+inline uint16_t floatToHalf(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+
+    uint32_t sign = (bits >> 16) & 0x8000u;
+    uint32_t exponent = (bits >> 23) & 0xffu;
+    uint32_t mantissa = bits & 0x7fffffu;
+
+    if (exponent == 0xffu) {
+        return static_cast<uint16_t>(sign | 0x7c00u | (mantissa != 0 ? 0x200u : 0u));
+    }
+
+    int32_t halfExponent = static_cast<int32_t>(exponent) - 127 + 15;
+    if (halfExponent >= 0x1f) {
+        return static_cast<uint16_t>(sign | 0x7c00u);
+    }
+
+    if (halfExponent <= 0) {
+        if (halfExponent < -10) {
+            return static_cast<uint16_t>(sign);
+        }
+        mantissa |= 0x800000u;
+        uint32_t shift = static_cast<uint32_t>(14 - halfExponent);
+        uint32_t half = mantissa >> shift;
+        uint32_t remainder = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (remainder > halfway || (remainder == halfway && (half & 1u))) {
+            ++half;
+        }
+        return static_cast<uint16_t>(sign | half);
+    }
+
+    uint32_t half = (static_cast<uint32_t>(halfExponent) << 10) | (mantissa >> 13);
+    uint32_t remainder = mantissa & 0x1fffu;
+    if (remainder > 0x1000u || (remainder == 0x1000u && (half & 1u))) {
+        ++half;
+    }
+    return static_cast<uint16_t>(sign | half);
+}
+
+/**
+ * halfToFloat
+ * Converts IEEE 754 half-precision bits to a float.
+ * @param half: Bits of the half-precision value.
+ * @return float: The converted value.
+ */
+
+inline float halfToFloat(uint16_t half) {
+    uint32_t sign = static_cast<uint32_t>(half & 0x8000u) << 16;
+    uint32_t exponent = (half >> 10) & 0x1fu;
+    uint32_t mantissa = half & 0x3ffu;
+    uint32_t bits;
+
+    if (exponent == 0) {
+        if (mantissa == 0) {
+            bits = sign;
+        } else {
+            exponent = 127 - 15 + 1;
+            while ((mantissa & 0x400u) == 0) {
+                mantissa <<= 1;
+                --exponent;
+            }
+            bits = sign | (exponent << 23) | ((mantissa & 0x3ffu) << 13);
+        }
+    } else if (exponent == 0x1f) {
+        bits = sign | 0x7f800000u | (mantissa << 13);
+    } else {
+        bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+    }
+
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+/**
+ * squaredDistanceInt8
+ * Approximate squared distance between a prepared query and an int8-coded embedding:
+ * sum over d of weights[d] * (scaledQuery[d] - codes[d])^2 (see ScalarQuantizer).
+ * @param scaledQuery: Query mapped into code space by ScalarQuantizer::prepareQuery.
+ * @param weights: Squared per-dimension scales.
+ * @param codes: Codes of the embedding.
+ * @param n: Number of coordinates.
+ * @return float: Approximate squared distance.
+ */
+
+inline float squaredDistanceInt8(const float* scaledQuery, const float* weights, const uint8_t* codes, std::size_t n) {
+    std::size_t i = 0;
+    float sum = 0.0f;
+
+#if defined(__AVX512F__)
+    __m512 acc = _mm512_setzero_ps();
+    for (; i < n / 16 * 16; i += 16) {
+        __m128i packed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(codes + i));
+        __m512 decoded = _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(packed));
+        __m512 diff = _mm512_sub_ps(_mm512_loadu_ps(scaledQuery + i), decoded);
+        acc = _mm512_fmadd_ps(_mm512_mul_ps(diff, diff), _mm512_loadu_ps(weights + i), acc);
+    }
+    sum = horizontalSum(acc);
+#elif defined(__AVX2__)
+    __m256 acc = _mm256_setzero_ps();
+    for (; i < n / 8 * 8; i += 8) {
+        __m128i packed = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(codes + i));
+        __m256 decoded = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(packed));
+        __m256 diff = _mm256_sub_ps(_mm256_loadu_ps(scaledQuery + i), decoded);
+        acc = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(diff, diff), _mm256_loadu_ps(weights + i)), acc);
+    }
+    sum = horizontalSum(acc);
+#endif
+
+    for (; i < n; ++i) {
+        float diff = scaledQuery[i] - static_cast<float>(codes[i]);
+        sum += weights[i] * diff * diff;
+    }
+    return sum;
+}
+
+/**
+ * squaredDistanceHalf
+ * Squared distance between a float query and a half-precision embedding.
+ * @param query: Query coordinates.
+ * @param codes: Half-precision bits of the embedding.
+ * @param n: Number of coordinates.
+ * @return float: Squared distance.
+ */
+
+inline float squaredDistanceHalf(const float* query, const uint16_t* codes, std::size_t n) {
+    std::size_t i = 0;
+    float sum = 0.0f;
+
+#if defined(__AVX512F__)
+    __m512 acc = _mm512_setzero_ps();
+    for (; i < n / 16 * 16; i += 16) {
+        __m512 decoded = _mm512_cvtph_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(codes + i)));
+        __m512 diff = _mm512_sub_ps(_mm512_loadu_ps(query + i), decoded);
+        acc = _mm512_fmadd_ps(diff, diff, acc);
+    }
+    sum = horizontalSum(acc);
+#elif defined(__AVX2__) && defined(__F16C__)
+    __m256 acc = _mm256_setzero_ps();
+    for (; i < n / 8 * 8; i += 8) {
+        __m256 decoded = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(codes + i)));
+        acc = squaredDifferenceAdd(_mm256_loadu_ps(query + i), decoded, acc);
+    }
+    sum = horizontalSum(acc);
+#endif
+
+    for (; i < n; ++i) {
+        float diff = query[i] - halfToFloat(codes[i]);
+        sum += diff * diff;
+    }
+    return sum;
+}
+
+/*
+ * ScalarQuantizer
+ * Per-dimension affine int8 quantization: x[d] ~ offset[d] + scale[d] * code[d], with
+ * the offset and scale of each dimension spanning the range seen during training.
+ * Values outside that range are clamped.
+ */
+
+class ScalarQuantizer {
+    std::vector<float> offsets;
+    std::vector<float> scales;
+    std::vector<float> weights;
+
+public:
+    bool isTrained() const { return !offsets.empty(); }
+    const float* getWeights() const { return weights.data(); }
+
+    /**
+     * train
+     * Fits the per-dimension ranges to a sample of embeddings.
+     * @param rows: Pointers to the sample embeddings.
+     * @param count: Number of embeddings.
+     * @param dimension: Number of coordinates per embedding.
+     */
+
+    template <typename Scalar>
+    void train(const Scalar* const* rows, std::size_t count, std::size_t dimension) {
+        std::vector<float> low(dimension, std::numeric_limits<float>::max());
+        std::vector<float> high(dimension, std::numeric_limits<float>::lowest());
+        for (std::size_t r = 0; r < count; ++r) {
+            for (std::size_t d = 0; d < dimension; ++d) {
+                low[d] = std::min(low[d], static_cast<float>(rows[r][d]));
+                high[d] = std::max(high[d], static_cast<float>(rows[r][d]));
+            }
+        }
+
+        offsets = low;
+        scales.assign(dimension, 0.0f);
+        weights.assign(dimension, 0.0f);
+        for (std::size_t d = 0; d < dimension; ++d) {
+            if (count > 0 && high[d] > low[d]) {
+                scales[d] = (high[d] - low[d]) / 255.0f;
+                weights[d] = scales[d] * scales[d];
+            } else {
+                offsets[d] = count > 0 ? low[d] : 0.0f;
+            }
+        }
+    }
+
+    /**
+     * encode
+     * @param coordinates: Embedding to encode.
+     * @param n: Number of coordinates.
+     * @param codes: Receives one code per coordinate.
+     */
+
+    template <typename Scalar>
+    void encode(const Scalar* coordinates, std::size_t n, uint8_t* codes) const {
+        for (std::size_t d = 0; d < n; ++d) {
+            float code = scales[d] > 0.0f ? std::round((static_cast<float>(coordinates[d]) - offsets[d]) / scales[d]) : 0.0f;
+            codes[d] = static_cast<uint8_t>(std::clamp(code, 0.0f, 255.0f));
+        }
+    }
+
+    /**
+     * prepareQuery
+     * Maps a query into code space so that squaredDistanceInt8 can compare it to codes.
+     * @param coordinates: Query coordinates.
+     * @param n: Number of coordinates.
+     * @param scaledQuery: Receives the mapped query.
+     */
+
+    template <typename Scalar>
+    void prepareQuery(const Scalar* coordinates, std::size_t n, float* scaledQuery) const {
+        for (std::size_t d = 0; d < n; ++d) {
+            scaledQuery[d] = scales[d] > 0.0f ? (static_cast<float>(coordinates[d]) - offsets[d]) / scales[d] : 0.0f;
+        }
+    }
+};
+
+#endif // QUANTIZER_H
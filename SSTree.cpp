@@ -1,5 +1,9 @@
 #include "SSTree.h"
 
+#include <cassert>
+#include <fstream>
+#include <stdexcept>
+
 /**
  * calculateMean
  * Computes the mean value of centroids along a specific dimension.
@@ -8,8 +12,9 @@
  * @return float: The mean value of the centroids along the specified dimension.
  */
 
-float calculateMean(const std::vector<Point>& centroids, size_t dimension) {
-    float sum = 0.0f;
+template <int Dim, typename Scalar>
+Scalar calculateMean(const std::vector<Point<Dim, Scalar>>& centroids, size_t dimension) {
+    Scalar sum = 0.0f;
     for (const auto& point : centroids) {
         sum += point[dimension];
     }
@@ -24,15 +29,138 @@ float calculateMean(const std::vector<Point>& centroids, size_t dimension) {
  * @return float: The variance of the centroids along the specified dimension.
  */
 
-float calculateVariance(const std::vector<Point>& centroids, size_t dimension) {
+template <int Dim, typename Scalar>
+Scalar calculateVariance(const std::vector<Point<Dim, Scalar>>& centroids, size_t dimension) {
     
-    float meanValue = calculateMean(centroids, dimension);
-    float varianceSum = 0.0f;
+    Scalar meanValue = calculateMean(centroids, dimension);
+    Scalar varianceSum = 0.0f;
     for (const auto& point : centroids) {
-        float deviation = point[dimension] - meanValue;
+        Scalar deviation = point[dimension] - meanValue;
         varianceSum += deviation * deviation; 
     }
-    return varianceSum / static_cast<float>(centroids.size());
+    return varianceSum / static_cast<Scalar>(centroids.size());
+}
+
+/**
+ * embeddingStride
+ * Rounds a dimension up to a whole number of cache lines, so every leaf row starts aligned.
+ * @param dimension: Number of coordinates per embedding.
+ * @return size_t: Number of scalars between consecutive leaf rows.
+ */
+
+template <typename Scalar>
+size_t embeddingStride(size_t dimension) {
+    constexpr size_t scalarsPerLine = 64 / sizeof(Scalar);
+    return (dimension + scalarsPerLine - 1) / scalarsPerLine * scalarsPerLine;
+}
+
+/**
+ * leafRowBytes
+ * Size of one leaf row in a given storage format, rounded up to a whole number of cache lines.
+ * @param dimension: Number of coordinates per embedding.
+ * @param storage: Format of the rows.
+ * @return size_t: Number of bytes between consecutive leaf rows.
+ */
+
+template <typename Scalar>
+size_t leafRowBytes(size_t dimension, LeafStorage storage) {
+    switch (storage) {
+        case LeafStorage::Int8:
+            return (dimension * sizeof(uint8_t) + 63) / 64 * 64;
+        case LeafStorage::Float16:
+            return (dimension * sizeof(uint16_t) + 63) / 64 * 64;
+        default:
+            return embeddingStride<Scalar>(dimension) * sizeof(Scalar);
+    }
+}
+
+/**
+ * NodeArena
+ * Creates the pools for the nodes of a tree and for leaf blocks with room for
+ * `maxPointsPerNode` entries plus the one that triggers a split.
+ * @param store: Data store the leaf ids refer to.
+ * @param maxPointsPerNode: Maximum number of entries per node.
+ * @param dimension: Number of coordinates per embedding.
+ * @param storage: Format of the leaf rows.
+ * @param splitPolicy: How the nodes of the tree split.
+ */
+
+template <int Dim, typename Scalar>
+NodeArena<Dim, Scalar>::NodeArena(const DataStore<Dim, Scalar>* store, size_t maxPointsPerNode, size_t dimension,
+                                  LeafStorage storage, SplitPolicy splitPolicy)
+    : store(store), storage(storage), dimension(dimension), rowBytes(leafRowBytes<Scalar>(dimension, storage)),
+      leafBlocks((maxPointsPerNode + 1) * rowBytes), stride(embeddingStride<Scalar>(dimension)),
+      splitPolicy(splitPolicy) {}
+
+/**
+ * SSNode
+ * Creates a node; leaves created through an arena get their embedding block from it.
+ */
+
+template <int Dim, typename Scalar>
+SSNode<Dim, Scalar>::SSNode(const PointType& centroid, Scalar radius, bool isLeaf, SSNode* parent, size_t M,
+                            NodeArena<Dim, Scalar>* arena)
+    : maxPointsPerNode(M), centroid(centroid), radius(radius), isLeaf(isLeaf), parent(parent),
+      entrySum(PointType::Zero(centroid.size())), drift(0.0f), arena(arena), leafBlock(nullptr) {
+    if (isLeaf && arena != nullptr) {
+        leafBlock = static_cast<unsigned char*>(arena->leafBlocks.allocate());
+    }
+    updateRoutingCentroid();
+}
+
+template <int Dim, typename Scalar>
+SSNode<Dim, Scalar>::~SSNode() {
+    if (leafBlock != nullptr) {
+        arena->leafBlocks.deallocate(leafBlock);
+    }
+}
+
+/**
+ * getEmbeddingStride
+ * @return size_t: Number of scalars between consecutive rows of a LeafStorage::Float leaf block.
+ */
+
+template <int Dim, typename Scalar>
+size_t SSNode<Dim, Scalar>::getEmbeddingStride() const {
+    return arena != nullptr ? arena->stride : centroid.size();
+}
+
+/**
+ * storeEmbedding
+ * Writes an embedding into a row of the leaf block, encoded in the arena's storage format.
+ * @param row: Row to write.
+ * @param embedding: Embedding to store.
+ */
+
+template <int Dim, typename Scalar>
+void SSNode<Dim, Scalar>::storeEmbedding(size_t row, const PointType& embedding) {
+    unsigned char* destination = leafBlock + row * arena->rowBytes;
+    switch (arena->storage) {
+        case LeafStorage::Int8:
+            arena->quantizer.encode(embedding.data(), embedding.size(), destination);
+            break;
+        case LeafStorage::Float16: {
+            uint16_t* codes = reinterpret_cast<uint16_t*>(destination);
+            for (size_t d = 0; d < embedding.size(); ++d) {
+                codes[d] = floatToHalf(static_cast<float>(embedding[d]));
+            }
+            break;
+        }
+        default:
+            std::copy(embedding.data(), embedding.data() + embedding.size(), reinterpret_cast<Scalar*>(destination));
+    }
+}
+
+/**
+ * rebuildEmbeddings
+ * Rewrites the leaf block so that its rows follow the current order of `_data`.
+ */
+
+template <int Dim, typename Scalar>
+void SSNode<Dim, Scalar>::rebuildEmbeddings() {
+    for (size_t row = 0; row < _data.size(); ++row) {
+        storeEmbedding(row, embeddingOf(_data[row]));
+    }
 }
 
 /**
@@ -42,8 +170,9 @@ float calculateVariance(const std::vector<Point>& centroids, size_t dimension) {
  * @return bool: Returns true if the point is inside the sphere; otherwise, false.
  */
 
-bool SSNode::intersectsPoint(const Point& point) const {
-    return Point::distance(centroid, point) <= radius;
+template <int Dim, typename Scalar>
+bool SSNode<Dim, Scalar>::intersectsPoint(const PointType& point) const {
+    return PointType::distance(centroid, point) <= radius;
 }
 
 /**
@@ -53,40 +182,168 @@ bool SSNode::intersectsPoint(const Point& point) const {
  * @return SSNode*: Returns a pointer to the closest child.
  */
 
-SSNode* SSNode::findClosestChild(const Point& target) {
-    return *std::min_element(children.begin(), children.end(), [&target](SSNode* a, SSNode* b) {
-        return a->getCentroid().distance(target) < b->getCentroid().distance(target);
-    });
+template <int Dim, typename Scalar>
+SSNode<Dim, Scalar>* SSNode<Dim, Scalar>::findClosestChild(const PointType& target) {
+    SSNode* closestChild = nullptr;
+    Scalar minDistance = std::numeric_limits<Scalar>::max();
+
+    for (auto* child : children) {
+        Scalar childDistance = child->getCentroid().distanceSquared(target);
+        if (childDistance < minDistance) {
+            minDistance = childDistance;
+            closestChild = child;
+        }
+    }
+
+    return closestChild;
 }
 
 
 /**
  * updateBoundingEnvelope
- * Updates the centroid and radius of the node based on internal nodes or data.
+ * Updates the centroid, radius and tag signature of the node based on internal nodes or data.
  */
 
-void SSNode::updateBoundingEnvelope() {
-    std::vector<Point> entryCentroids = getEntriesCentroids();
+template <int Dim, typename Scalar>
+void SSNode<Dim, Scalar>::updateBoundingEnvelope() {
+    this->entrySum = PointType::Zero(centroid.size());
+    this->tagSignature = TagSignature();
 
-    for (size_t dim = 0; dim < DIM; dim++) {
-        this->centroid[dim] = calculateMean(entryCentroids, dim);
+    if (this->isLeaf) {
+        for (const auto& id : this->_data) {
+            this->entrySum += embeddingOf(id);
+            this->tagSignature.merge(TagSignature::of(tagsOf(id)));
+        }
+    } else {
+        for (const auto& child : this->children) {
+            this->entrySum += child->centroid;
+            this->tagSignature.merge(child->tagSignature);
+        }
     }
 
-    float maxRadius = 0.0f;
+    this->centroid = this->entrySum / static_cast<Scalar>(entryCount());
+    this->drift = 0.0f;
+
+    Scalar maxRadius = 0.0f;
 
     if (this->isLeaf) {
-        for (const auto& entry : this->_data) {
-            float distanceToCentroid = Point::distance(this->centroid, entry->getEmbedding());
+        for (const auto& id : this->_data) {
+            Scalar distanceToCentroid = PointType::distance(this->centroid, embeddingOf(id));
             maxRadius = std::max(maxRadius, distanceToCentroid);
         }
     } else {
         for (const auto& child : this->children) {
-            float distanceToChild = Point::distance(this->centroid, child->centroid) + child->radius;
+            Scalar distanceToChild = PointType::distance(this->centroid, child->centroid) + child->radius;
             maxRadius = std::max(maxRadius, distanceToChild);
         }
     }
 
     this->radius = maxRadius;
+    updateRoutingCentroid();
+}
+
+/**
+ * updateRoutingCentroid
+ * Projects the centroid with the arena's routing projection, or drops the projected
+ * centroid when the tree routes on full centroids.
+ */
+
+template <int Dim, typename Scalar>
+void SSNode<Dim, Scalar>::updateRoutingCentroid() {
+    if (arena == nullptr || !arena->projection.isTrained()) {
+        routingCentroid.clear();
+        return;
+    }
+    routingCentroid.resize(arena->projection.outputDimension());
+    arena->projection.project(centroid.data(), routingCentroid.data());
+}
+
+/**
+ * recenter
+ * Moves the centroid to the mean of the entries, read from the running entry sum.
+ * @return Scalar: Distance the centroid moved.
+ */
+
+template <int Dim, typename Scalar>
+Scalar SSNode<Dim, Scalar>::recenter() {
+    PointType previousCentroid = this->centroid;
+    this->centroid = this->entrySum / static_cast<Scalar>(entryCount());
+    updateRoutingCentroid();
+    return PointType::distance(previousCentroid, this->centroid);
+}
+
+/**
+ * expandBoundingEnvelope
+ * Grows the radius, after the centroid moved by `shift`, so that the sphere still covers
+ * everything it covered before plus the given entry sphere, and adds the entry's tags to
+ * the signature. Falls back to a full recomputation once the centroid has drifted too far
+ * since the last exact radius.
+ * @param shift: Distance the centroid moved since the radius was last updated.
+ * @param entryCentroid: Centroid of the new or changed entry.
+ * @param entryRadius: Radius of the new or changed entry (0 for data points).
+ * @param entryTags: Tag signature of the new or changed entry.
+ */
+
+template <int Dim, typename Scalar>
+void SSNode<Dim, Scalar>::expandBoundingEnvelope(Scalar shift, const PointType& entryCentroid, Scalar entryRadius,
+                                                 const TagSignature& entryTags) {
+    this->tagSignature.merge(entryTags);
+    Scalar coveredRadius = (this->radius + shift) * (1.0f + ENVELOPE_TOLERANCE);
+    Scalar entryExtent = PointType::distance(this->centroid, entryCentroid) + entryRadius;
+    this->radius = std::max(coveredRadius, entryExtent);
+
+    this->drift += shift;
+    if (this->drift > MAX_CENTROID_DRIFT * this->radius) {
+        updateBoundingEnvelope();
+    }
+}
+
+/**
+ * addEntry
+ * Appends a data point to a leaf and updates its envelope incrementally in O(DIM).
+ * @param data: Data to append.
+ */
+
+template <int Dim, typename Scalar>
+void SSNode<Dim, Scalar>::addEntry(const DataType* data) {
+    storeEmbedding(this->_data.size(), data->getEmbedding());
+    this->_data.push_back(data->getId());
+    arena->leafOf[data->getId()] = this;
+    this->entrySum += data->getEmbedding();
+    expandBoundingEnvelope(recenter(), data->getEmbedding(), 0.0f, TagSignature::of(tagsOf(data->getId())));
+}
+
+/**
+ * removeEntry
+ * Removes a data point from a leaf by moving the last entry (and its row of the
+ * leaf block) into its slot, and drops it from the id index. The envelope is left
+ * for the caller to refresh.
+ * @param index: Position of the entry to remove.
+ */
+
+template <int Dim, typename Scalar>
+void SSNode<Dim, Scalar>::removeEntry(size_t index) {
+    arena->leafOf[this->_data[index]] = nullptr;
+    size_t last = this->_data.size() - 1;
+    if (index != last) {
+        this->_data[index] = this->_data[last];
+        std::copy(leafBlock + last * arena->rowBytes, leafBlock + (last + 1) * arena->rowBytes,
+                  leafBlock + index * arena->rowBytes);
+    }
+    this->_data.pop_back();
+}
+
+/**
+ * indexEntries
+ * Points the arena's id index at this leaf for every one of its entries, after they
+ * were moved here by a split or a bulk load.
+ */
+
+template <int Dim, typename Scalar>
+void SSNode<Dim, Scalar>::indexEntries() {
+    for (DataId id : this->_data) {
+        arena->leafOf[id] = this;
+    }
 }
 
 /**
@@ -95,14 +352,15 @@ void SSNode::updateBoundingEnvelope() {
  * @return size_t: Index of the direction of maximum variance.
  */
 
-size_t SSNode::directionOfMaxVariance() {
-    float highestVariance = 0.0f;
+template <int Dim, typename Scalar>
+size_t SSNode<Dim, Scalar>::directionOfMaxVariance() {
+    Scalar highestVariance = 0.0f;
     size_t maxVarianceDirection = 0;
 
     const auto centroids = this->getEntriesCentroids();
 
-    for (size_t dim = 0; dim < DIM; ++dim) {
-        float currentVariance = calculateVariance(centroids, dim);
+    for (size_t dim = 0; dim < centroid.size(); ++dim) {
+        Scalar currentVariance = calculateVariance(centroids, dim);
 
         if (currentVariance > highestVariance) {
             highestVariance = currentVariance;
@@ -116,20 +374,52 @@ size_t SSNode::directionOfMaxVariance() {
 /**
  * split
  * Splits the node and returns the newly created node.
- * Implementation similar to an R-tree.
+ * Implementation similar to an R-tree; the arena's SplitPolicy decides how the entries
+ * are ordered and where the order is cut.
+ * @param latched: Whether to latch the new nodes exclusively before anything can reach them (concurrent inserts).
  * @return SSNode*: Pointer to the new node created by the split.
  */
 
-std::pair<SSNode*, SSNode*> SSNode::split() {
-    size_t splitDimension = directionOfMaxVariance(); 
-    size_t splitIndex = findSplitIndex(splitDimension);
+template <int Dim, typename Scalar>
+std::pair<SSNode<Dim, Scalar>*, SSNode<Dim, Scalar>*> SSNode<Dim, Scalar>::split(bool latched) {
+    size_t splitIndex;
+    switch (arena->splitPolicy) {
+        case SplitPolicy::TwoMeans:
+            splitIndex = twoMeansSplit();
+            break;
+        case SplitPolicy::PrincipalDirection:
+            splitIndex = principalDirectionSplit();
+            break;
+        default:
+            splitIndex = findSplitIndex(directionOfMaxVariance());
+            break;
+    }
 
-    SSNode* leftNode = new SSNode(centroid, radius, isLeaf, this, maxPointsPerNode);
-    SSNode* rightNode = new SSNode(centroid, radius, isLeaf, this, maxPointsPerNode);
+    SSNode* leftNode;
+    SSNode* rightNode;
+    {
+        // Disjoint subtrees may split concurrently during a parallel batched insert
+        std::lock_guard<std::mutex> lock(arena->mutex);
+        leftNode = arena->nodes.create(centroid, radius, isLeaf, this, maxPointsPerNode, arena);
+        rightNode = arena->nodes.create(centroid, radius, isLeaf, this, maxPointsPerNode, arena);
+    }
+    if (latched) {
+        leftNode->latch.lock();
+        rightNode->latch.lock();
+    }
 
     if (isLeaf) {
         leftNode->_data.assign(_data.begin(), _data.begin() + splitIndex);
         rightNode->_data.assign(_data.begin() + splitIndex, _data.end());
+        // A half still too large for a leaf block (after a batched insert) gets its rows once split further
+        if (leftNode->_data.size() <= maxPointsPerNode) {
+            leftNode->rebuildEmbeddings();
+        }
+        if (rightNode->_data.size() <= maxPointsPerNode) {
+            rightNode->rebuildEmbeddings();
+        }
+        leftNode->indexEntries();
+        rightNode->indexEntries();
     } else {
         leftNode->children.assign(children.begin(), children.begin() + splitIndex);
         rightNode->children.assign(children.begin() + splitIndex, children.end());
@@ -145,8 +435,6 @@ std::pair<SSNode*, SSNode*> SSNode::split() {
     leftNode->updateBoundingEnvelope();
     rightNode->updateBoundingEnvelope();
 
-    this->updateBoundingEnvelope();
-
     return {leftNode, rightNode};
 }
 
@@ -158,17 +446,18 @@ std::pair<SSNode*, SSNode*> SSNode::split() {
  * @return size_t: Split index.
  */
 
-size_t SSNode::findSplitIndex(size_t coordinateIndex) {
-    std::vector<float> coordinateValues;
+template <int Dim, typename Scalar>
+size_t SSNode<Dim, Scalar>::findSplitIndex(size_t coordinateIndex) {
+    std::vector<Scalar> coordinateValues;
 
     if (isLeaf) {
         std::sort(_data.begin(), _data.end(),
-            [coordinateIndex](const Data* lhs, const Data* rhs) {
-                return lhs->getEmbedding()[coordinateIndex] < rhs->getEmbedding()[coordinateIndex];
+            [this, coordinateIndex](DataId lhs, DataId rhs) {
+                return embeddingOf(lhs)[coordinateIndex] < embeddingOf(rhs)[coordinateIndex];
             });
 
-        for (const auto& entry : _data) {
-            coordinateValues.push_back(entry->getEmbedding()[coordinateIndex]);
+        for (const auto& id : _data) {
+            coordinateValues.push_back(embeddingOf(id)[coordinateIndex]);
         }
     } else {
 
@@ -185,6 +474,156 @@ size_t SSNode::findSplitIndex(size_t coordinateIndex) {
     return minVarianceSplit(coordinateValues);
 }
 
+/**
+ * twoMeansSplit
+ * Clusters the entry centroids in two with k-means, seeded with two entries far apart,
+ * and orders the entries so that the first cluster comes first. The boundary between
+ * two k-means clusters is a hyperplane, so the clusters are a prefix and a suffix of
+ * the entries ordered by their signed distance to it.
+ * @return size_t: Split index (size of the first cluster, at least one on each side).
+ */
+
+template <int Dim, typename Scalar>
+size_t SSNode<Dim, Scalar>::twoMeansSplit() {
+    const auto centroids = this->getEntriesCentroids();
+    const size_t count = centroids.size();
+
+    auto farthestFrom = [&centroids, count](const PointType& point) {
+        size_t farthest = 0;
+        for (size_t i = 1; i < count; ++i) {
+            if (point.distanceSquared(centroids[i]) > point.distanceSquared(centroids[farthest])) {
+                farthest = i;
+            }
+        }
+        return farthest;
+    };
+    size_t firstSeed = farthestFrom(centroids[0]);
+    size_t secondSeed = farthestFrom(centroids[firstSeed]);
+    if (firstSeed == secondSeed) {
+        return findSplitIndex(directionOfMaxVariance());
+    }
+
+    PointType left = centroids[firstSeed];
+    PointType right = centroids[secondSeed];
+    std::vector<bool> toRight(count, false);
+
+    for (size_t iteration = 0; iteration < SPLIT_KMEANS_ITERATIONS; ++iteration) {
+        bool changed = iteration == 0;
+        PointType leftSum = PointType::Zero(centroid.size());
+        PointType rightSum = PointType::Zero(centroid.size());
+        size_t rightCount = 0;
+
+        for (size_t i = 0; i < count; ++i) {
+            bool assignRight = centroids[i].distanceSquared(right) < centroids[i].distanceSquared(left);
+            changed = changed || assignRight != toRight[i];
+            toRight[i] = assignRight;
+            (assignRight ? rightSum : leftSum) += centroids[i];
+            rightCount += assignRight;
+        }
+
+        if (!changed || rightCount == 0 || rightCount == count) {
+            break;
+        }
+        left = leftSum / static_cast<Scalar>(count - rightCount);
+        right = rightSum / static_cast<Scalar>(rightCount);
+    }
+
+    std::vector<Scalar> keys(count);
+    size_t leftCount = 0;
+    for (size_t i = 0; i < count; ++i) {
+        keys[i] = centroids[i].distanceSquared(left) - centroids[i].distanceSquared(right);
+        leftCount += keys[i] <= 0;
+    }
+    sortEntriesByKey(keys);
+
+    return std::clamp<size_t>(leftCount, 1, count - 1);
+}
+
+/**
+ * principalDirectionSplit
+ * Orders the entries by their projection on the principal direction of the entry
+ * centroids, found by power iteration, and cuts where the sum of the variances of the
+ * projections on both sides is lowest.
+ * @return size_t: Split index.
+ */
+
+template <int Dim, typename Scalar>
+size_t SSNode<Dim, Scalar>::principalDirectionSplit() {
+    auto deviations = this->getEntriesCentroids();
+
+    PointType mean = PointType::Zero(centroid.size());
+    for (const auto& point : deviations) {
+        mean += point;
+    }
+    mean /= static_cast<Scalar>(deviations.size());
+
+    // Start from the entry farthest from the mean, which already leans towards the principal direction
+    size_t farthest = 0;
+    for (size_t i = 0; i < deviations.size(); ++i) {
+        deviations[i] -= mean;
+        if (deviations[i].normSquared() > deviations[farthest].normSquared()) {
+            farthest = i;
+        }
+    }
+    // Point division refuses divisors below EPSILON, which near-duplicate entries reach
+    Scalar spread = deviations[farthest].norm();
+    if (spread < EPSILON) {
+        return findSplitIndex(directionOfMaxVariance());
+    }
+
+    PointType direction = deviations[farthest] / spread;
+    for (size_t iteration = 0; iteration < SPLIT_POWER_ITERATIONS; ++iteration) {
+        PointType next = PointType::Zero(centroid.size());
+        for (const auto& deviation : deviations) {
+            next += deviation * deviation.dot(direction);
+        }
+        // The iterate scales with the square of the deviations; keep the last direction when it vanishes
+        Scalar norm = next.norm();
+        if (norm < EPSILON) {
+            break;
+        }
+        direction = next / norm;
+    }
+
+    std::vector<Scalar> keys(deviations.size());
+    for (size_t i = 0; i < deviations.size(); ++i) {
+        keys[i] = deviations[i].dot(direction);
+    }
+    return minVarianceSplit(sortEntriesByKey(keys));
+}
+
+/**
+ * sortEntriesByKey
+ * Reorders the entries (data points or children) by ascending key.
+ * @param keys: One key per entry, in the current entry order.
+ * @return std::vector<Scalar>: The keys in the new entry order.
+ */
+
+template <int Dim, typename Scalar>
+std::vector<Scalar> SSNode<Dim, Scalar>::sortEntriesByKey(const std::vector<Scalar>& keys) {
+    std::vector<size_t> order(keys.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&keys](size_t lhs, size_t rhs) { return keys[lhs] < keys[rhs]; });
+
+    std::vector<Scalar> sortedKeys;
+    if (isLeaf) {
+        std::vector<DataId> entries;
+        for (size_t index : order) {
+            entries.push_back(_data[index]);
+            sortedKeys.push_back(keys[index]);
+        }
+        _data = std::move(entries);
+    } else {
+        std::vector<SSNode*> entries;
+        for (size_t index : order) {
+            entries.push_back(children[index]);
+            sortedKeys.push_back(keys[index]);
+        }
+        children = std::move(entries);
+    }
+    return sortedKeys;
+}
+
 /**
  * getEntriesCentroids
  * Returns the centroids of the entries.
@@ -192,12 +631,13 @@ size_t SSNode::findSplitIndex(size_t coordinateIndex) {
  * @return std::vector<Point>: Vector of entry centroids.
  */
 
-std::vector<Point> SSNode::getEntriesCentroids() const {
-    std::vector<Point> centroids;
+template <int Dim, typename Scalar>
+std::vector<Point<Dim, Scalar>> SSNode<Dim, Scalar>::getEntriesCentroids() const {
+    std::vector<PointType> centroids;
     
     if (isLeaf) {
-        for (const auto& data : _data) {
-            centroids.push_back(data->getEmbedding());
+        for (const auto& id : _data) {
+            centroids.push_back(embeddingOf(id));
         }
     } else {
         for (const auto& child : children) {
@@ -216,16 +656,17 @@ std::vector<Point> SSNode::getEntriesCentroids() const {
  * @return size_t: Index of minimum variance.
  */
 
-size_t SSNode::minVarianceSplit(const std::vector<float>& values) {
+template <int Dim, typename Scalar>
+size_t SSNode<Dim, Scalar>::minVarianceSplit(const std::vector<Scalar>& values) {
     int M = maxPointsPerNode, m = 1;
-    float min_s = std::numeric_limits<float>::max();
+    Scalar min_s = std::numeric_limits<Scalar>::max();
     size_t idx_min = 0;
 
     for (int i = m; i <= M - m; i++) {
-        float meanLeft = std::accumulate(values.begin(), values.begin() + i, 0.0f) / i;
-        float meanRight = std::accumulate(values.begin() + i, values.end(), 0.0f) / (values.size() - i);
+        Scalar meanLeft = std::accumulate(values.begin(), values.begin() + i, Scalar(0)) / i;
+        Scalar meanRight = std::accumulate(values.begin() + i, values.end(), Scalar(0)) / (values.size() - i);
 
-        float varLeft = 0.0f, varRight = 0.0f;
+        Scalar varLeft = 0.0f, varRight = 0.0f;
         for (size_t j = 0; j < i; j++) {
             varLeft += std::pow(values[j] - meanLeft, 2);
         }
@@ -233,7 +674,7 @@ size_t SSNode::minVarianceSplit(const std::vector<float>& values) {
             varRight += std::pow(values[j] - meanRight, 2);
         }
 
-        float sumVariance = varLeft + varRight;
+        Scalar sumVariance = varLeft + varRight;
         if (sumVariance < min_s) {
             min_s = sumVariance;
             idx_min = i;
@@ -251,7 +692,8 @@ size_t SSNode::minVarianceSplit(const std::vector<float>& values) {
  * @return SSNode*: Appropriate leaf node for insertion.
  */
 
-SSNode* SSNode::searchParentLeaf(SSNode* node, const Point& target) {
+template <int Dim, typename Scalar>
+SSNode<Dim, Scalar>* SSNode<Dim, Scalar>::searchParentLeaf(SSNode* node, const PointType& target) {
     if(node->isLeaf ) return node;
     return searchParentLeaf(node->findClosestChild(target) , target);
 }
@@ -260,32 +702,68 @@ SSNode* SSNode::searchParentLeaf(SSNode* node, const Point& target) {
  * insert
  * Inserts data into the node, splitting it if necessary.
  * @param node: Node where the insertion will take place.
- * @param _data: Data to insert.
+ * @param data: Record of the data to insert, owned by the tree's data store.
  * @return SSNode*: New root node if split occurred, otherwise nullptr.
  */
 
-std::pair<SSNode*, SSNode*> SSNode::insert(SSNode*& node, Data* data) {
-    if (node->isLeaf) {
-        if (std::find(node->_data.begin(), node->_data.end(), data) != node->_data.end()) {
-            return {nullptr, nullptr};
-        }
+template <int Dim, typename Scalar>
+std::pair<SSNode<Dim, Scalar>*, SSNode<Dim, Scalar>*> SSNode<Dim, Scalar>::insert(SSNode*& node, const DataType* data) {
+    size_t height = 0;
+    for (const SSNode* descendant = node; !descendant->isLeaf; descendant = descendant->children.front()) {
+        ++height;
+    }
+    return insertEntry(node, height, Entry{data, nullptr, 0}, nullptr);
+}
 
-        node->_data.push_back(data);
-        node->updateBoundingEnvelope();
+/**
+ * insertEntry
+ * Places an entry in the subtree of a node: a data point in a leaf, or a subtree in the
+ * node of the height above it, descending to the closest child. A node that overflows
+ * splits, unless forced reinsertion lets it evict entries instead.
+ * @param node: Root of the subtree.
+ * @param height: Height of `node`.
+ * @param entry: Entry to place.
+ * @param reinsertion: Forced reinsertion state, or nullptr to always split.
+ * @return std::pair<SSNode*, SSNode*>: The two nodes replacing `node` if it split, otherwise nullptrs.
+ */
 
-        if (node->_data.size() <= node->maxPointsPerNode) {
-            return {nullptr, nullptr};
-        }
+template <int Dim, typename Scalar>
+std::pair<SSNode<Dim, Scalar>*, SSNode<Dim, Scalar>*> SSNode<Dim, Scalar>::insertEntry(SSNode* node, size_t height,
+                                                                                        const Entry& entry,
+                                                                                        Reinsertion* reinsertion) {
+    if (height == entry.height) {
+        if (node->isLeaf) {
+            if (node->_data.size() < node->maxPointsPerNode) {
+                node->addEntry(entry.data);
+                return {nullptr, nullptr};
+            }
 
-        return node->split();
+            node->_data.push_back(entry.data->getId());
+            node->arena->leafOf[entry.data->getId()] = node;
+        } else {
+            entry.subtree->parent = node;
+            node->children.push_back(entry.subtree);
+
+            if (node->children.size() <= node->maxPointsPerNode) {
+                node->entrySum += entry.subtree->centroid;
+                node->expandBoundingEnvelope(node->recenter(), entry.subtree->centroid, entry.subtree->radius,
+                                             entry.subtree->tagSignature);
+                return {nullptr, nullptr};
+            }
+        }
+        return node->overflow(height, reinsertion);
     }
 
-    SSNode* closestChild = node->findClosestChild(data->getEmbedding());
+    SSNode* closestChild = node->findClosestChild(entry.centroid());
+    PointType previousChildCentroid = closestChild->centroid;
 
-    auto [leftSplit, rightSplit] = insert(closestChild, data);
+    auto [leftSplit, rightSplit] = insertEntry(closestChild, height - 1, entry, reinsertion);
 
     if (!leftSplit && !rightSplit) {
-        node->updateBoundingEnvelope();
+        node->entrySum += closestChild->centroid;
+        node->entrySum -= previousChildCentroid;
+        node->expandBoundingEnvelope(node->recenter(), closestChild->centroid, closestChild->radius,
+                                     closestChild->tagSignature);
         return {nullptr, nullptr};
     }
 
@@ -294,31 +772,116 @@ std::pair<SSNode*, SSNode*> SSNode::insert(SSNode*& node, Data* data) {
     if (it != node->children.end()) {
         node->children.erase(it);
     }
+    node->arena->nodes.destroy(closestChild);
 
+    leftSplit->parent = node;
+    rightSplit->parent = node;
     node->children.push_back(leftSplit);
     node->children.push_back(rightSplit);
 
-    node->updateBoundingEnvelope();
+    if (node->children.size() > node->maxPointsPerNode) {
+        return node->overflow(height, reinsertion);
+    }
 
-    if (node->children.size() <= node->maxPointsPerNode) {
-        return {nullptr, nullptr};
+    node->entrySum -= previousChildCentroid;
+    node->entrySum += leftSplit->centroid;
+    node->entrySum += rightSplit->centroid;
+    node->expandBoundingEnvelope(node->recenter(), leftSplit->centroid, leftSplit->radius, leftSplit->tagSignature);
+    node->expandBoundingEnvelope(0.0f, rightSplit->centroid, rightSplit->radius, rightSplit->tagSignature);
+
+    return {nullptr, nullptr};
+}
+
+/**
+ * overflow
+ * Handles a node holding one entry too many. As in the R*-tree, the first overflow at
+ * each height during an insert evicts the entries farthest from the centroid for
+ * reinsertion; the root and later overflows split.
+ * @param height: Height of the node.
+ * @param reinsertion: Forced reinsertion state, or nullptr to always split.
+ * @return std::pair<SSNode*, SSNode*>: The two nodes replacing this one if it split, otherwise nullptrs.
+ */
+
+template <int Dim, typename Scalar>
+std::pair<SSNode<Dim, Scalar>*, SSNode<Dim, Scalar>*> SSNode<Dim, Scalar>::overflow(size_t height,
+                                                                                     Reinsertion* reinsertion) {
+    if (reinsertion == nullptr || parent == nullptr) {
+        return split();
+    }
+
+    if (reinsertion->evicted.size() <= height) {
+        reinsertion->evicted.resize(height + 1, false);
+    }
+    if (reinsertion->evicted[height]) {
+        return split();
+    }
+
+    reinsertion->evicted[height] = true;
+    evictFarthest(height, *reinsertion);
+    return {nullptr, nullptr};
+}
+
+/**
+ * evictFarthest
+ * Removes the entries farthest from the mean of the node's entries and queues them for
+ * reinsertion, nearest first, then recomputes the node's envelope.
+ * @param height: Height of the node.
+ * @param reinsertion: Receives the evicted entries.
+ */
+
+template <int Dim, typename Scalar>
+void SSNode<Dim, Scalar>::evictFarthest(size_t height, Reinsertion& reinsertion) {
+    const auto centroids = this->getEntriesCentroids();
+    const size_t count = centroids.size();
+
+    PointType mean = PointType::Zero(centroid.size());
+    for (const auto& point : centroids) {
+        mean += point;
+    }
+    mean /= static_cast<Scalar>(count);
+
+    std::vector<Scalar> keys(count);
+    for (size_t i = 0; i < count; ++i) {
+        keys[i] = mean.distanceSquared(centroids[i]);
+    }
+    sortEntriesByKey(keys);
+
+    size_t evictCount = std::clamp<size_t>(static_cast<size_t>(reinsertion.fraction * count), 1, count - 1);
+    size_t keep = count - evictCount;
+
+    if (isLeaf) {
+        for (size_t i = keep; i < count; ++i) {
+            reinsertion.pending.push_back(Entry{&arena->store->get(_data[i]), nullptr, 0});
+        }
+        _data.resize(keep);
+        rebuildEmbeddings();
+    } else {
+        for (size_t i = keep; i < count; ++i) {
+            children[i]->parent = nullptr;
+            reinsertion.pending.push_back(Entry{nullptr, children[i], height});
+        }
+        children.resize(keep);
     }
 
-    return node->split();
+    updateBoundingEnvelope();
+    reinsertion.evictedFrom = this;
 }
 
 /**
  * search
  * Searches for a specific data in the tree.
  * @param node: Node from which to start the search.
- * @param _data: Data to search for.
+ * @param id: Id of the data to search for.
  * @return SSNode*: Node containing the data (or nullptr if not found).
  */
 
-SSNode* SSNode::search(SSNode* node, Data* _data) {
+template <int Dim, typename Scalar>
+SSNode<Dim, Scalar>* SSNode<Dim, Scalar>::search(SSNode* node, DataId id, [[maybe_unused]] QueryStats* stats) {
+    SSTREE_STAT(if (stats != nullptr) ++stats->nodesPopped;)
     if(node->isLeaf) {
+        SSTREE_STAT(if (stats != nullptr) ++stats->leavesScanned;)
         for(auto & point : node->_data) {
-            if(point == _data) {
+            if(point == id) {
                 return node;
             }
         }
@@ -326,10 +889,13 @@ SSNode* SSNode::search(SSNode* node, Data* _data) {
 
     else {
         for(auto & child : node->children) {
-            if(child != nullptr && child->intersectsPoint(_data->getEmbedding())) {
-                SSNode* ans = search(child , _data);
+            SSTREE_STAT(if (stats != nullptr) ++stats->centroidDistances;)
+            if(child != nullptr && child->intersectsPoint(embeddingOf(id))) {
+                SSNode* ans = search(child , id, stats);
                 if(ans != nullptr) 
                     return ans;
+            } else {
+                SSTREE_STAT(if (stats != nullptr) ++stats->nodesPruned;)
             }
         }
     }
@@ -337,97 +903,2469 @@ SSNode* SSNode::search(SSNode* node, Data* _data) {
 }
 
 /**
- * insert
- * Inserts data into the tree.
- * @param _data: Data to insert.
+ * ~SSTree
+ * Releases every node of the tree; the arena then returns its slabs to the system.
  */
 
-void SSTree::insert(Data* _data) {
-    if (root == nullptr) root = new SSNode(_data->getEmbedding(),0,true,nullptr,maxPointsPerNode);
-    auto p = root->insert(root , _data);
-    SSNode* n1 = p.first; SSNode*n2 = p.second;
-    if (n1 != nullptr) {
-        root = new SSNode(_data->getEmbedding(), 0 , true , nullptr , maxPointsPerNode);
-        root->children.push_back(n1);
-        root->children.push_back(n2);
-        root->isLeaf = false;
+template <int Dim, typename Scalar>
+SSTree<Dim, Scalar>::~SSTree() {
+    if (root != nullptr) {
+        destroySubtree(root);
+    }
+    if (arena) {
+        reclaimNodes(true);
     }
 }
 
 /**
- * search
- * Searches for a specific data in the tree.
- * @param _data: Data to search for.
- * @return SSNode*: Node containing the data (or nullptr if not found).
+ * createArena
+ * Sets the node arena up on first use (the dimension of runtime-sized trees is only
+ * known once data arrives), drawing the directions of random projected routing.
+ * @param dimension: Number of coordinates per embedding.
  */
 
-SSNode* SSTree::search(Data* _data) {
-    return root->search(root,_data);
+template <int Dim, typename Scalar>
+void SSTree<Dim, Scalar>::createArena(size_t dimension) {
+    if (!arena) {
+        arena = std::make_unique<NodeArena<Dim, Scalar>>(&store, maxPointsPerNode, dimension, leafStorage,
+                                                         splitPolicy);
+        if (routing == Routing::RandomProjection) {
+            arena->projection.trainRandom(dimension, routingDimensions, ROUTING_SEED);
+        }
+    }
 }
 
 /**
- * knn-search
- * Returns the k nearest neighbors.
- * @param k: number of neighbors
- * @param query: point from which to find the k nearest neighbors
- * @return std::vector<Data*>: List containing the k nearest neighbors
+ * createNode
+ * Creates a node in the tree's arena, setting the arena up on first use.
+ * @param centroid: Initial centroid of the node.
+ * @param isLeaf: Whether the node is a leaf.
+ * @param parent: Parent of the node.
+ * @return SSNode*: The new node.
+ */
+
+template <int Dim, typename Scalar>
+SSNode<Dim, Scalar>* SSTree<Dim, Scalar>::createNode(const PointType& centroid, bool isLeaf, NodeType* parent) {
+    createArena(centroid.size());
+    return arena->nodes.create(centroid, 0.0f, isLeaf, parent, maxPointsPerNode, arena.get());
+}
+
+/**
+ * destroySubtree
+ * Returns a node and all of its descendants to the arena.
+ * @param node: Root of the subtree to destroy.
  */
 
-std::vector<Data*> SSTree::knn(const Point& query, size_t k) const {
-    if (!root) {
-        return {}; 
+template <int Dim, typename Scalar>
+void SSTree<Dim, Scalar>::destroySubtree(NodeType* node) {
+    for (auto* child : node->children) {
+        destroySubtree(child);
     }
+    arena->nodes.destroy(node);
+}
 
-    auto compare = [](const std::pair<const SSNode*, float>& a, const std::pair<const SSNode*, float>& b) {
-        return a.second > b.second;
-    };
+/**
+ * insert
+ * Copies a data point into the tree's data store and inserts it.
+ * @param embedding: Embedding of the data.
+ * @param path: Path of the data, kept in the store's path arena.
+ * @param tags: Tags of the data, which filtered searches can select on.
+ * @return DataId: Id given to the data.
+ */
 
-    std::priority_queue<std::pair<const SSNode*, float>, std::vector<std::pair<const SSNode*, float>>, decltype(compare)> nodeQueue(compare);
+template <int Dim, typename Scalar>
+DataId SSTree<Dim, Scalar>::insert(const PointType& embedding, std::string_view path, const std::vector<Tag>& tags) {
+    if (leafStorage == LeafStorage::Int8 && (!arena || !arena->quantizer.isTrained())) {
+        throw std::logic_error("Int8 leaf storage needs trainQuantizer() or bulkLoad() before insert");
+    }
 
-    auto dataCompare = [&query](const Data* a, const Data* b) {
-        return a->getEmbedding().distance(query) < b->getEmbedding().distance(query);
-    };
+    if (concurrent) {
+        const DataType* data;
+        {
+            std::lock_guard<std::mutex> lock(storeMutex);
+            data = &store.add(embedding, path, tags);
+        }
+        insertConcurrent(data);
+        return data->getId();
+    }
 
-    std::priority_queue<Data*, std::vector<Data*>, decltype(dataCompare)> nearestNeighbors(dataCompare);
+    const DataType& data = store.add(embedding, path, tags);
+    insertRecord(&data);
+    store.releaseRetired();
+    return data.getId();
+}
 
-    nodeQueue.emplace(root, query.distance(root->getCentroid()) - root->getRadius());
+/**
+ * insertRecord
+ * Inserts a record of the data store into the tree. With forced reinsertion enabled,
+ * entries evicted by overflowing nodes are reinserted from the root before the call returns.
+ * @param data: Record to insert.
+ */
 
-    while (!nodeQueue.empty()) {
-        auto [currentNode, nodeDistance] = nodeQueue.top();
-        nodeQueue.pop();
+template <int Dim, typename Scalar>
+void SSTree<Dim, Scalar>::insertRecord(const DataType* data) {
+    if (root == nullptr) root = createNode(data->getEmbedding(), true, nullptr);
+    if (arena->leafOf.size() < store.size()) {
+        arena->leafOf.resize(store.size(), nullptr);
+    }
 
-        if (!nearestNeighbors.empty() && nodeDistance > nearestNeighbors.top()->getEmbedding().distance(query)) {
-            continue;
-        }
+    if (reinsertFraction <= 0.0f) {
+        insertEntry(typename NodeType::Entry{data, nullptr, 0}, nullptr);
+        return;
+    }
 
-        if (currentNode->getIsLeaf()) {
-            for (const auto& data : currentNode->getData()) {
-                float dataDistance = data->getEmbedding().distance(query);
-                if (nearestNeighbors.size() < k) {
-                    nearestNeighbors.push(data);
-                } else if (dataDistance < nearestNeighbors.top()->getEmbedding().distance(query)) {
-                    nearestNeighbors.pop();
-                    nearestNeighbors.push(data);
-                }
-            }
-        } else {
-            for (const auto& child : currentNode->getChildren()) {
-                float childDistance = query.distance(child->getCentroid()) - child->getRadius();
-                if (!nearestNeighbors.empty() && childDistance > nearestNeighbors.top()->getEmbedding().distance(query)) {
-                    continue;
-                }
-                nodeQueue.emplace(child, childDistance);
+    typename NodeType::Reinsertion reinsertion;
+    reinsertion.fraction = reinsertFraction;
+    reinsertion.pending.push_back(typename NodeType::Entry{data, nullptr, 0});
+
+    for (size_t i = 0; i < reinsertion.pending.size(); ++i) {
+        typename NodeType::Entry entry = reinsertion.pending[i];
+        insertEntry(entry, &reinsertion);
+
+        // The nodes above an eviction only grew their spheres incrementally; shrink them now
+        if (reinsertion.evictedFrom != nullptr) {
+            for (NodeType* node = reinsertion.evictedFrom->parent; node != nullptr; node = node->parent) {
+                node->updateBoundingEnvelope();
             }
+            reinsertion.evictedFrom = nullptr;
         }
     }
+}
+
+/**
+ * setReinsertFraction
+ * Enables R*-style forced reinsertion for later inserts: on the first overflow at each
+ * height during an insert, this fraction of the node's entries (those farthest from its
+ * centroid) is reinserted from the root instead of splitting the node.
+ * @param fraction: Fraction of the entries to reinsert, in [0, 1) (0 disables it).
+ */
 
-    std::vector<Data*> ans;
-    while (!nearestNeighbors.empty()) {
-        ans.push_back(nearestNeighbors.top());
-        nearestNeighbors.pop();
+template <int Dim, typename Scalar>
+void SSTree<Dim, Scalar>::setReinsertFraction(float fraction) {
+    if (fraction < 0.0f || fraction >= 1.0f) {
+        throw std::invalid_argument("The reinsert fraction must be in [0, 1)");
     }
+    reinsertFraction = fraction;
+}
 
-    std::reverse(ans.begin(), ans.end());
+/**
+ * setConcurrent
+ * Switches concurrent mode, in which insert, knn (every overload) and knnBatch may be called
+ * from several threads at once; every other operation still needs the tree to itself, and
+ * the mode may only be switched while nothing else runs. In particular forEachInRange and
+ * nearest read the nodes unlatched, so they must not run while writers do (debug builds
+ * assert that the mode is off). Inserts then latch the nodes they
+ * change and searches the nodes they read, one reader-writer latch per node, so ingest does
+ * not stall the queries working elsewhere in the tree. Concurrent inserts never reinsert
+ * entries, and they only widen the spheres of internal nodes instead of moving them;
+ * turning the mode off recomputes those spheres and frees the nodes retired by splits.
+ * @param enabled: Whether to enable concurrent mode.
+ */
 
-    return ans;
+template <int Dim, typename Scalar>
+void SSTree<Dim, Scalar>::setConcurrent(bool enabled) {
+    if (concurrent && !enabled && arena) {
+        reclaimNodes(true);
+        store.releaseRetired();
+        arena->leafOf.resize(store.size(), nullptr);
+        if (root != nullptr) {
+            refreshEnvelopes(root);
+        }
+    }
+    concurrent = enabled;
+}
+
+/**
+ * setRouting
+ * Chooses how kNN searches bound the distance to nodes (see Routing). Random directions
+ * are drawn as soon as the dimension is known. Principal components are learned from
+ * the points in the tree when this is called, and again by every bulk load; until the
+ * tree has seen data, it routes on full centroids.
+ * @param routing: Routing mode.
+ * @param dimensions: Number of directions of projected routing.
+ */
+
+template <int Dim, typename Scalar>
+void SSTree<Dim, Scalar>::setRouting(Routing routing, size_t dimensions) {
+    if (dimensions == 0) {
+        throw std::invalid_argument("Projected routing needs at least one dimension");
+    }
+    this->routing = routing;
+    routingDimensions = dimensions;
+    if (!arena) {
+        return;
+    }
+
+    std::vector<DataId> present;
+    if (root != nullptr) {
+        collectData(root, present);
+    }
+    std::vector<const Scalar*> rows;
+    rows.reserve(present.size());
+    for (DataId id : present) {
+        rows.push_back(store.getEmbedding(id).data());
+    }
+    trainRouting(rows, arena->dimension);
 }
+
+/**
+ * trainRouting
+ * Sets up the directions of the routing mode and re-projects the centroids of the nodes
+ * already built. Principal components are learned from an evenly spaced subset of at
+ * most ROUTING_SAMPLE_SIZE of the given embeddings.
+ * @param rows: Coordinates of the embeddings to learn principal components from.
+ * @param dimension: Number of coordinates per embedding.
+ */
+
+template <int Dim, typename Scalar>
+void SSTree<Dim, Scalar>::trainRouting(const std::vector<const Scalar*>& rows, size_t dimension) {
+    switch (routing) {
+        case Routing::RandomProjection:
+            arena->projection.trainRandom(dimension, routingDimensions, ROUTING_SEED);
+            break;
+        case Routing::PrincipalComponents: {
+            if (rows.empty()) {
+                arena->projection = RoutingProjection<Scalar>();
+                break;
+            }
+            std::vector<const Scalar*> sample;
+            size_t sampleSize = std::min(rows.size(), ROUTING_SAMPLE_SIZE);
+            for (size_t i = 0; i < sampleSize; ++i) {
+                sample.push_back(rows[i * rows.size() / sampleSize]);
+            }
+            arena->projection.trainPrincipal(sample.data(), sample.size(), dimension, routingDimensions,
+                                             ROUTING_POWER_ITERATIONS, ROUTING_SEED);
+            break;
+        }
+        default:
+            arena->projection = RoutingProjection<Scalar>();
+    }
+
+    std::vector<NodeType*> pending;
+    if (root != nullptr) {
+        pending.push_back(root);
+    }
+    while (!pending.empty()) {
+        NodeType* node = pending.back();
+        pending.pop_back();
+        node->updateRoutingCentroid();
+        pending.insert(pending.end(), node->children.begin(), node->children.end());
+    }
+}
+
+/**
+ * insertEntry
+ * Places an entry below the root, growing a new root when the old one splits.
+ * @param entry: Entry to place.
+ * @param reinsertion: Forced reinsertion state, or nullptr to always split.
+ */
+
+template <int Dim, typename Scalar>
+void SSTree<Dim, Scalar>::insertEntry(const typename NodeType::Entry& entry,
+                                      typename NodeType::Reinsertion* reinsertion) {
+    size_t height = 0;
+    for (const NodeType* node = root; !node->isLeaf; node = node->children.front()) {
+        ++height;
+    }
+
+    auto p = root->insertEntry(root, height, entry, reinsertion);
+    NodeType* n1 = p.first; NodeType*n2 = p.second;
+    if (n1 != nullptr) {
+        arena->nodes.destroy(root);
+        root = createNode(entry.centroid(), false, nullptr);
+        root->children.push_back(n1);
+        root->children.push_back(n2);
+        n1->parent = root;
+        n2->parent = root;
+        root->updateBoundingEnvelope();
+    }
+}
+
+/**
+ * partitionKey
+ * Point a data point or a node is partitioned by: its embedding, or its centroid.
+ */
+
+template <int Dim, typename Scalar>
+const Point<Dim, Scalar>& partitionKey(const Data<Dim, Scalar>* data) {
+    return data->getEmbedding();
+}
+
+template <int Dim, typename Scalar>
+const Point<Dim, Scalar>& partitionKey(const SSNode<Dim, Scalar>* node) {
+    return node->getCentroid();
+}
+
+/**
+ * forEachChunk
+ * Splits a range of data points into contiguous chunks and calls a function on each,
+ * as tasks of a pool when one is given and the range is large enough to be worth it.
+ * @param first: Iterator to the first data point of the range.
+ * @param last: Iterator past the last data point of the range.
+ * @param pool: Pool to run the chunks on, or nullptr to run them in order on this thread.
+ * @param function: Called as function(chunk, chunkFirst, chunkLast).
+ * @return size_t: Number of chunks.
+ */
+
+template <typename Iterator, typename Function>
+size_t forEachChunk(Iterator first, Iterator last, ThreadPool* pool, Function&& function) {
+    size_t count = std::distance(first, last);
+    size_t chunks = 1;
+    if (pool != nullptr && count >= 2 * PARALLEL_BUILD_GRAIN) {
+        chunks = std::min<size_t>(count / PARALLEL_BUILD_GRAIN, pool->size() * 4);
+    }
+
+    if (chunks == 1) {
+        function(0, first, last);
+        return chunks;
+    }
+
+    TaskGroup group;
+    for (size_t chunk = 0; chunk < chunks; ++chunk) {
+        Iterator chunkFirst = first + count * chunk / chunks;
+        Iterator chunkLast = first + count * (chunk + 1) / chunks;
+        pool->submit(group, [&function, chunk, chunkFirst, chunkLast](unsigned) {
+            function(chunk, chunkFirst, chunkLast);
+        });
+    }
+    pool->wait(group);
+    return chunks;
+}
+
+/**
+ * maxVarianceDimension
+ * Computes the dimension along which a range of data points (or nodes) has the highest variance.
+ * With a pool, the sums over large ranges are split into chunks computed in parallel.
+ * @param first: Iterator to the first data point of the range.
+ * @param last: Iterator past the last data point of the range.
+ * @param pool: Pool for the parallel sums, or nullptr.
+ * @return size_t: Index of the dimension of maximum variance.
+ */
+
+template <typename Iterator>
+size_t maxVarianceDimension(Iterator first, Iterator last, ThreadPool* pool = nullptr) {
+    using PointType = std::decay_t<decltype(partitionKey(*first))>;
+    using Scalar = std::decay_t<decltype(partitionKey(*first)[0])>;
+
+    const Scalar count = static_cast<Scalar>(std::distance(first, last));
+    const auto dimensions = partitionKey(*first).size();
+
+    // One partial sum per chunk, so that the chunks need no synchronization
+    std::vector<PointType> partial(pool != nullptr ? pool->size() * 4 : 1, PointType::Zero(dimensions));
+
+    size_t chunks = forEachChunk(first, last, pool, [&partial](size_t chunk, Iterator chunkFirst, Iterator chunkLast) {
+        for (auto it = chunkFirst; it != chunkLast; ++it) {
+            partial[chunk] += partitionKey(*it);
+        }
+    });
+    PointType mean = PointType::Zero(dimensions);
+    for (size_t chunk = 0; chunk < chunks; ++chunk) {
+        mean += partial[chunk];
+    }
+    mean /= count;
+
+    forEachChunk(first, last, pool, [&partial, &mean, dimensions](size_t chunk, Iterator chunkFirst, Iterator chunkLast) {
+        partial[chunk] = PointType::Zero(dimensions);
+        for (auto it = chunkFirst; it != chunkLast; ++it) {
+            PointType deviation = partitionKey(*it) - mean;
+            partial[chunk] += deviation.cwiseProduct(deviation);
+        }
+    });
+    PointType variance = PointType::Zero(dimensions);
+    for (size_t chunk = 0; chunk < chunks; ++chunk) {
+        variance += partial[chunk];
+    }
+
+    size_t maxDimension = 0;
+    for (size_t dim = 1; dim < variance.size(); ++dim) {
+        if (variance[dim] > variance[maxDimension]) {
+            maxDimension = dim;
+        }
+    }
+    return maxDimension;
+}
+
+/**
+ * partitionByMaxVariance
+ * Recursively bisects a range of data points (or nodes) along its direction of maximum variance
+ * until it is divided into the requested number of groups of (almost) equal size.
+ * With a pool, the two halves of a large range are bisected in parallel.
+ * @param first: Iterator to the first data point of the range.
+ * @param last: Iterator past the last data point of the range.
+ * @param groups: Number of groups to produce.
+ * @param bounds: Receives, in order, the iterator where each group ends.
+ * @param pool: Pool for the parallel work, or nullptr.
+ */
+
+template <typename Iterator>
+void partitionByMaxVariance(Iterator first, Iterator last, size_t groups, std::vector<Iterator>& bounds,
+                            ThreadPool* pool = nullptr) {
+    if (groups == 1) {
+        bounds.push_back(last);
+        return;
+    }
+
+    size_t leftGroups = groups / 2;
+    auto middle = first + std::distance(first, last) * leftGroups / groups;
+
+    size_t dimension = maxVarianceDimension(first, last, pool);
+    std::nth_element(first, middle, last, [dimension](const auto* lhs, const auto* rhs) {
+        return partitionKey(lhs)[dimension] < partitionKey(rhs)[dimension];
+    });
+
+    if (pool != nullptr && static_cast<size_t>(std::distance(first, last)) >= PARALLEL_BUILD_GRAIN) {
+        std::vector<Iterator> leftBounds;
+        TaskGroup group;
+        pool->submit(group, [&](unsigned) {
+            partitionByMaxVariance(first, middle, leftGroups, leftBounds, pool);
+        });
+        std::vector<Iterator> rightBounds;
+        partitionByMaxVariance(middle, last, groups - leftGroups, rightBounds, pool);
+        pool->wait(group);
+
+        bounds.insert(bounds.end(), leftBounds.begin(), leftBounds.end());
+        bounds.insert(bounds.end(), rightBounds.begin(), rightBounds.end());
+        return;
+    }
+
+    partitionByMaxVariance(first, middle, leftGroups, bounds);
+    partitionByMaxVariance(middle, last, groups - leftGroups, bounds);
+}
+
+/**
+ * insertBatch
+ * Copies a batch of data points into the tree's data store and inserts them together:
+ * the points are routed down the tree as groups, each leaf receives its share at once,
+ * and every node touched refreshes its envelope and splits only once, after its whole
+ * share has arrived. A batch into an empty tree is bulk loaded. Overflowing nodes always
+ * split, even with forced reinsertion enabled. With several threads, the groups headed
+ * for different children are inserted in parallel, which gives the same tree.
+ * @param embeddings: Embeddings of the data.
+ * @param paths: Paths of the data, one per embedding (or none).
+ * @param tags: Tags of the data, one list per embedding (or none).
+ * @param threads: Number of threads (0: one per hardware thread).
+ * @return DataId: Id given to the first data point; the others follow in order.
+ */
+
+template <int Dim, typename Scalar>
+DataId SSTree<Dim, Scalar>::insertBatch(const std::vector<PointType>& embeddings,
+                                        const std::vector<std::string>& paths,
+                                        const std::vector<std::vector<Tag>>& tags, unsigned threads) {
+    if (root == nullptr) {
+        return bulkLoad(embeddings, paths, tags, threads);
+    }
+    if (!paths.empty() && paths.size() != embeddings.size()) {
+        throw std::invalid_argument("insertBatch needs one path per embedding, or none");
+    }
+    if (!tags.empty() && tags.size() != embeddings.size()) {
+        throw std::invalid_argument("insertBatch needs one tag list per embedding, or none");
+    }
+    if (leafStorage == LeafStorage::Int8 && !arena->quantizer.isTrained()) {
+        throw std::logic_error("Int8 leaf storage needs trainQuantizer() or bulkLoad() before insert");
+    }
+
+    const DataId firstId = static_cast<DataId>(store.size());
+    std::vector<const DataType*> data;
+    data.reserve(embeddings.size());
+    for (size_t i = 0; i < embeddings.size(); ++i) {
+        data.push_back(&store.add(embeddings[i], paths.empty() ? std::string_view() : std::string_view(paths[i]),
+                                  tags.empty() ? std::vector<Tag>() : tags[i]));
+    }
+    store.releaseRetired();
+    if (data.empty()) {
+        return firstId;
+    }
+    // Sized up front, so that parallel tasks only write the slots of their own points
+    arena->leafOf.resize(store.size(), nullptr);
+
+    std::vector<NodeType*> roots;
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    if (threads == 1) {
+        insertGroup(root, data.begin(), data.end(), roots);
+    } else {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        if (!pool || pool->size() != threads) {
+            pool = std::make_unique<ThreadPool>(threads);
+        }
+        insertGroup(root, data.begin(), data.end(), roots, pool.get());
+    }
+
+    // Grow new roots until a single one holds every node the old root split into
+    while (roots.size() > 1) {
+        NodeType* newRoot = createNode(roots.front()->centroid, false, nullptr);
+        newRoot->children = roots;
+        for (NodeType* node : roots) {
+            node->parent = newRoot;
+        }
+        roots.clear();
+        if (newRoot->children.size() > maxPointsPerNode) {
+            splitOverflowing(newRoot, roots);
+        } else {
+            newRoot->updateBoundingEnvelope();
+            roots.push_back(newRoot);
+        }
+    }
+    root = roots.front();
+    root->parent = nullptr;
+    return firstId;
+}
+
+/**
+ * insertGroup
+ * Inserts a group of data points into the subtree of a node. Each point goes to the
+ * child closest to it, as a single insert would send it, and each child receives its
+ * whole group in one recursive call; a leaf appends its group at once. A node that
+ * still fits recenters once and grows its sphere over what changed, as an insert does
+ * for one entry; a node that overflows splits until its parts fit.
+ * @param node: Root of the subtree.
+ * @param first: Iterator to the first data point of the group.
+ * @param last: Iterator past the last data point of the group.
+ * @param replacements: Receives the nodes standing for `node` afterwards: `node` itself,
+ *                      or the nodes it split into, in which case it was destroyed.
+ */
+
+template <int Dim, typename Scalar>
+void SSTree<Dim, Scalar>::insertGroup(NodeType* node, typename std::vector<const DataType*>::iterator first,
+                                      typename std::vector<const DataType*>::iterator last,
+                                      std::vector<NodeType*>& replacements, ThreadPool* pool) {
+    const size_t count = std::distance(first, last);
+
+    if (node->isLeaf) {
+        if (node->_data.size() + count > maxPointsPerNode) {
+            // The splits give the parts their rows and envelopes
+            for (auto it = first; it != last; ++it) {
+                node->_data.push_back((*it)->getId());
+            }
+            splitOverflowing(node, replacements);
+            return;
+        }
+
+        size_t firstNew = node->_data.size();
+        for (auto it = first; it != last; ++it) {
+            node->storeEmbedding(node->_data.size(), (*it)->getEmbedding());
+            node->_data.push_back((*it)->getId());
+            arena->leafOf[(*it)->getId()] = node;
+            node->entrySum += (*it)->getEmbedding();
+        }
+        Scalar shift = node->recenter();
+        for (size_t i = firstNew; i < node->_data.size(); ++i) {
+            DataId id = node->_data[i];
+            node->expandBoundingEnvelope(shift, store.getEmbedding(id), 0.0f, TagSignature::of(store.getTags(id)));
+            shift = 0.0f;
+        }
+        replacements.push_back(node);
+        return;
+    }
+
+    const auto& children = node->children;
+    std::vector<std::pair<size_t, const DataType*>> routed;
+    routed.reserve(count);
+    if (count < children.size()) {
+        for (auto it = first; it != last; ++it) {
+            NodeType* closestChild = node->findClosestChild((*it)->getEmbedding());
+            routed.emplace_back(std::find(children.begin(), children.end(), closestChild) - children.begin(), *it);
+        }
+    } else {
+        // Closest child of each point, as a single insert would choose it. The term |x|^2 of
+        // |c - x|^2 = |c|^2 - 2 c.x + |x|^2 is the same for every child, so each point is routed
+        // by one matrix-vector product with the centroids, gathered once for the whole group
+        // (copying the points into a matrix for a single product costs more than it saves)
+        using Matrix = Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic>;
+        using Vector = Eigen::Matrix<Scalar, Eigen::Dynamic, 1>;
+        const size_t dimension = arena->dimension;
+        Matrix centroids(dimension, children.size());
+        for (size_t j = 0; j < children.size(); ++j) {
+            centroids.col(j) = Eigen::Map<const Vector>(children[j]->centroid.data(), dimension);
+        }
+        Vector centroidNorms = centroids.colwise().squaredNorm().transpose();
+        Vector products(children.size());
+        for (size_t i = 0; i < count; ++i) {
+            products.noalias() = centroids.transpose() * Eigen::Map<const Vector>(first[i]->getEmbedding().data(), dimension);
+            Eigen::Index closestChild;
+            (centroidNorms - Scalar(2) * products).minCoeff(&closestChild);
+            routed.emplace_back(static_cast<size_t>(closestChild), first[i]);
+        }
+    }
+    std::stable_sort(routed.begin(), routed.end(), [](const auto& lhs, const auto& rhs) {
+        return lhs.first < rhs.first;
+    });
+    for (size_t i = 0; i < count; ++i) {
+        first[i] = routed[i].second;
+    }
+
+    // Children that received points are replaced by what they became, at the end
+    std::vector<NodeType*> updatedChildren;
+    std::vector<size_t> targets;
+    std::vector<size_t> bounds{0};
+    for (size_t index = 0; index < children.size(); ++index) {
+        size_t end = bounds.back();
+        while (end < count && routed[end].first == index) {
+            ++end;
+        }
+        if (end == bounds.back()) {
+            updatedChildren.push_back(children[index]);
+            continue;
+        }
+        node->entrySum -= children[index]->centroid;
+        targets.push_back(index);
+        bounds.push_back(end);
+    }
+
+    // The groups go to disjoint subtrees, so large ones are inserted in parallel
+    std::vector<std::vector<NodeType*>> parts(targets.size());
+    if (pool != nullptr && count >= PARALLEL_INSERT_GRAIN && targets.size() > 1) {
+        TaskGroup group;
+        for (size_t i = 0; i < targets.size(); ++i) {
+            pool->submit(group, [this, &parts, &bounds, child = children[targets[i]], first, pool, i](unsigned) {
+                insertGroup(child, first + bounds[i], first + bounds[i + 1], parts[i], pool);
+            });
+        }
+        pool->wait(group);
+    } else {
+        for (size_t i = 0; i < targets.size(); ++i) {
+            insertGroup(children[targets[i]], first + bounds[i], first + bounds[i + 1], parts[i], pool);
+        }
+    }
+    std::vector<NodeType*> changedChildren;
+    for (const auto& part : parts) {
+        changedChildren.insert(changedChildren.end(), part.begin(), part.end());
+    }
+    for (NodeType* child : changedChildren) {
+        child->parent = node;
+        updatedChildren.push_back(child);
+    }
+    node->children = std::move(updatedChildren);
+
+    if (node->children.size() > maxPointsPerNode) {
+        splitOverflowing(node, replacements);
+        return;
+    }
+
+    // One recentering for the whole group, then the sphere grows over each changed child
+    for (NodeType* child : changedChildren) {
+        node->entrySum += child->centroid;
+    }
+    Scalar shift = node->recenter();
+    for (NodeType* child : changedChildren) {
+        node->expandBoundingEnvelope(shift, child->centroid, child->radius, child->tagSignature);
+        shift = 0.0f;
+    }
+    replacements.push_back(node);
+}
+
+/**
+ * splitOverflowing
+ * Splits a node holding too many entries until every part fits: it is partitioned at once
+ * into as few nodes as can hold its entries, the way the bulk loader groups points, whose
+ * variance sums run over whole rows rather than one dimension at a time. Only a node that
+ * fits in two and splits by a policy other than AxisVariance uses that policy, and the
+ * halves split in turn. The node is destroyed.
+ * @param node: Node to split.
+ * @param parts: Receives the nodes it split into.
+ */
+
+template <int Dim, typename Scalar>
+void SSTree<Dim, Scalar>::splitOverflowing(NodeType* node, std::vector<NodeType*>& parts) {
+    const size_t count = node->entryCount();
+    if (count > 2 * maxPointsPerNode || splitPolicy == SplitPolicy::AxisVariance) {
+        size_t groups = (count + maxPointsPerNode - 1) / maxPointsPerNode;
+        if (node->isLeaf) {
+            std::vector<const DataType*> records;
+            records.reserve(count);
+            for (DataId id : node->_data) {
+                records.push_back(&store.get(id));
+            }
+            std::vector<typename std::vector<const DataType*>::iterator> bounds;
+            partitionByMaxVariance(records.begin(), records.end(), groups, bounds);
+
+            auto groupFirst = records.begin();
+            for (auto groupLast : bounds) {
+                NodeType* part;
+                {
+                    std::lock_guard<std::mutex> lock(arena->mutex);
+                    part = createNode((*groupFirst)->getEmbedding(), true, node->parent);
+                }
+                for (auto it = groupFirst; it != groupLast; ++it) {
+                    part->_data.push_back((*it)->getId());
+                }
+                part->rebuildEmbeddings();
+                part->indexEntries();
+                part->updateBoundingEnvelope();
+                parts.push_back(part);
+                groupFirst = groupLast;
+            }
+        } else {
+            std::vector<NodeType*> children = node->children;
+            std::vector<typename std::vector<NodeType*>::iterator> bounds;
+            partitionByMaxVariance(children.begin(), children.end(), groups, bounds);
+
+            auto groupFirst = children.begin();
+            for (auto groupLast : bounds) {
+                NodeType* part;
+                {
+                    std::lock_guard<std::mutex> lock(arena->mutex);
+                    part = createNode((*groupFirst)->centroid, false, node->parent);
+                }
+                part->children.assign(groupFirst, groupLast);
+                for (NodeType* child : part->children) {
+                    child->parent = part;
+                }
+                part->updateBoundingEnvelope();
+                parts.push_back(part);
+                groupFirst = groupLast;
+            }
+        }
+        std::lock_guard<std::mutex> lock(arena->mutex);
+        arena->nodes.destroy(node);
+        return;
+    }
+
+    auto [leftSplit, rightSplit] = node->split();
+    {
+        std::lock_guard<std::mutex> lock(arena->mutex);
+        arena->nodes.destroy(node);
+    }
+    for (NodeType* half : {leftSplit, rightSplit}) {
+        if (half->entryCount() > maxPointsPerNode) {
+            splitOverflowing(half, parts);
+        } else {
+            parts.push_back(half);
+        }
+    }
+}
+
+/**
+ * insertConcurrent
+ * Inserts a record of the data store while other threads insert and search. The descent
+ * couples shared latches down to the closest leaf, which it latches exclusively: a leaf with
+ * room takes the point at once, then the spheres above are widened to cover it, one node at
+ * a time from the bottom up. A full leaf is left to insertSplitting.
+ * @param data: Record to insert.
+ */
+
+template <int Dim, typename Scalar>
+void SSTree<Dim, Scalar>::insertConcurrent(const DataType* data) {
+    EpochGuard epoch(&epochs);
+    const PointType& point = data->getEmbedding();
+
+    bool empty;
+    {
+        std::shared_lock<std::shared_mutex> rootLock(rootLatch);
+        empty = root == nullptr;
+    }
+    if (empty) {
+        std::lock_guard<std::mutex> structure(splitMutex);
+        std::unique_lock<std::shared_mutex> rootLock(rootLatch);
+        if (root == nullptr) {
+            createArena(point.size());
+            std::lock_guard<std::mutex> lock(arena->mutex);
+            root = arena->nodes.create(point, 0.0f, true, nullptr, maxPointsPerNode, arena.get());
+        }
+    }
+    growLeafIndex(data->getId());
+
+    NodeType* leaf = latchLeaf(point);
+    if (leaf->_data.size() < maxPointsPerNode) {
+        {
+            std::shared_lock<std::shared_mutex> index(arena->leafIndexMutex);
+            leaf->addEntry(data);
+        }
+        leaf->latch.unlock();
+        widenAncestors(leaf, data->getId());
+        return;
+    }
+    leaf->latch.unlock();
+    insertSplitting(data);
+}
+
+/**
+ * insertSplitting
+ * Inserts a record whose leaf is full. Splits hold `splitMutex`, so the structure only
+ * changes here and one split at a time: the leaf and the full ancestors that split with it
+ * are latched exclusively top-down, from the lowest ancestor with room (or the root pointer,
+ * when the root splits), and their other children are latched shared while the envelopes
+ * are recomputed. The nodes replaced by a split are retired rather than freed, as searches
+ * may still hold them, and the retired leaf is left with the entries it had so that a search
+ * reaching it still reads a consistent leaf.
+ * @param data: Record to insert.
+ */
+
+template <int Dim, typename Scalar>
+void SSTree<Dim, Scalar>::insertSplitting(const DataType* data) {
+    std::unique_lock<std::mutex> structure(splitMutex);
+    const DataId id = data->getId();
+    NodeType* leaf = latchLeaf(data->getEmbedding());
+    // Another split may have made room meanwhile
+    if (leaf->_data.size() < maxPointsPerNode) {
+        {
+            std::shared_lock<std::shared_mutex> index(arena->leafIndexMutex);
+            leaf->addEntry(data);
+        }
+        leaf->latch.unlock();
+        structure.unlock();
+        widenAncestors(leaf, id);
+        return;
+    }
+    leaf->latch.unlock();
+
+    // Children counts only change under splitMutex, so the nodes that will split are known up front
+    std::vector<NodeType*> chain{leaf};
+    NodeType* top = leaf->parent;
+    while (top != nullptr && top->children.size() >= maxPointsPerNode) {
+        chain.push_back(top);
+        top = top->parent;
+    }
+
+    std::unique_lock<std::shared_mutex> rootLock(rootLatch, std::defer_lock);
+    if (top == nullptr) {
+        rootLock.lock();
+    } else {
+        top->latch.lock();
+    }
+    for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+        (*it)->latch.lock();
+    }
+    std::vector<NodeType*> siblings;
+    for (NodeType* node : chain) {
+        for (NodeType* child : node->children) {
+            if (std::find(chain.begin(), chain.end(), child) == chain.end()) {
+                child->latch.lock_shared();
+                siblings.push_back(child);
+            }
+        }
+    }
+    if (top != nullptr) {
+        for (NodeType* child : top->children) {
+            if (child != chain.back()) {
+                child->latch.lock_shared();
+                siblings.push_back(child);
+            }
+        }
+    }
+
+    std::vector<NodeType*> created;
+    {
+        std::shared_lock<std::shared_mutex> index(arena->leafIndexMutex);
+        leaf->_data.push_back(id);
+        arena->leafOf[id] = leaf;
+        NodeType* replaced = leaf;
+        auto halves = leaf->split(true);
+        leaf->_data.erase(std::find(leaf->_data.begin(), leaf->_data.end(), id));
+        leaf->rebuildEmbeddings();
+
+        for (;;) {
+            created.push_back(halves.first);
+            created.push_back(halves.second);
+            retiredNodes.emplace_back(replaced, epochs.now());
+
+            NodeType* parent = replaced->parent;
+            if (parent == nullptr) {
+                NodeType* newRoot;
+                {
+                    std::lock_guard<std::mutex> lock(arena->mutex);
+                    newRoot = arena->nodes.create(halves.first->centroid, 0.0f, false, nullptr, maxPointsPerNode,
+                                                  arena.get());
+                }
+                newRoot->latch.lock();
+                created.push_back(newRoot);
+                newRoot->children = {halves.first, halves.second};
+                halves.first->parent = newRoot;
+                halves.second->parent = newRoot;
+                newRoot->updateBoundingEnvelope();
+                root = newRoot;
+                break;
+            }
+
+            parent->children.erase(std::find(parent->children.begin(), parent->children.end(), replaced));
+            parent->children.push_back(halves.first);
+            parent->children.push_back(halves.second);
+            halves.first->parent = parent;
+            halves.second->parent = parent;
+            if (parent->children.size() > maxPointsPerNode) {
+                replaced = parent;
+                halves = parent->split(true);
+                continue;
+            }
+
+            parent->entrySum -= replaced->centroid;
+            parent->entrySum += halves.first->centroid;
+            parent->entrySum += halves.second->centroid;
+            parent->expandBoundingEnvelope(parent->recenter(), halves.first->centroid, halves.first->radius,
+                                           halves.first->tagSignature);
+            parent->expandBoundingEnvelope(0.0f, halves.second->centroid, halves.second->radius,
+                                           halves.second->tagSignature);
+            break;
+        }
+    }
+
+    for (NodeType* node : siblings) {
+        node->latch.unlock_shared();
+    }
+    for (NodeType* node : created) {
+        node->latch.unlock();
+    }
+    for (NodeType* node : chain) {
+        node->latch.unlock();
+    }
+    if (top != nullptr) {
+        top->latch.unlock();
+    } else {
+        rootLock.unlock();
+    }
+    reclaimNodes(false);
+    structure.unlock();
+
+    if (top != nullptr) {
+        widenAncestors(top, id);
+    }
+}
+
+/**
+ * latchLeaf
+ * Descends to the leaf whose centroid is closest at each level, coupling shared latches:
+ * a node stays latched until its chosen child is, so no split can move the child away
+ * in between.
+ * @param target: Point to route.
+ * @return NodeType*: The leaf, latched exclusively.
+ */
+
+template <int Dim, typename Scalar>
+SSNode<Dim, Scalar>* SSTree<Dim, Scalar>::latchLeaf(const PointType& target) {
+    std::shared_lock<std::shared_mutex> rootLock(rootLatch);
+    NodeType* node = root;
+    if (node->isLeaf) {
+        node->latch.lock();
+        return node;
+    }
+    node->latch.lock_shared();
+    rootLock.unlock();
+
+    for (;;) {
+        NodeType* closestChild = nullptr;
+        Scalar minDistance = std::numeric_limits<Scalar>::max();
+        for (NodeType* child : node->children) {
+            std::shared_lock<std::shared_mutex> childLock(child->latch);
+            Scalar childDistance = child->centroid.distanceSquared(target);
+            if (childDistance < minDistance) {
+                minDistance = childDistance;
+                closestChild = child;
+            }
+        }
+
+        if (closestChild->isLeaf) {
+            closestChild->latch.lock();
+        } else {
+            closestChild->latch.lock_shared();
+        }
+        node->latch.unlock_shared();
+        if (closestChild->isLeaf) {
+            return closestChild;
+        }
+        node = closestChild;
+    }
+}
+
+/**
+ * widenAncestors
+ * Grows the sphere of every ancestor of a node, from the bottom up, so that it covers the
+ * sphere of its child on the way, holding one exclusive latch at a time. Ancestors keep
+ * their centroids. A link broken by a concurrent split is repaired by starting over from
+ * the current leaf of the inserted point, under `splitMutex` so that it cannot break again.
+ * @param node: Node whose sphere changed.
+ * @param id: Data point inserted below it.
+ */
+
+template <int Dim, typename Scalar>
+void SSTree<Dim, Scalar>::widenAncestors(NodeType* node, DataId id) {
+    std::unique_lock<std::mutex> structure(splitMutex, std::defer_lock);
+    auto restart = [&]() {
+        // Held since the first restart, if any
+        if (!structure.owns_lock()) {
+            structure.lock();
+        }
+        std::shared_lock<std::shared_mutex> index(arena->leafIndexMutex);
+        return arena->leafOf[id];
+    };
+
+    NodeType* child = node;
+    for (;;) {
+        NodeType* parent = child->parent;
+        if (parent == nullptr) {
+            std::shared_lock<std::shared_mutex> rootLock(rootLatch);
+            if (child == root) {
+                return;
+            }
+            // A root that split
+            rootLock.unlock();
+            child = restart();
+            continue;
+        }
+
+        std::unique_lock<std::shared_mutex> parentLock(parent->latch);
+        if (child->parent != parent) {
+            // Moved to a half of its parent
+            continue;
+        }
+        if (std::find(parent->children.begin(), parent->children.end(), child) == parent->children.end()) {
+            // Split itself, and retired
+            parentLock.unlock();
+            child = restart();
+            continue;
+        }
+
+        std::shared_lock<std::shared_mutex> childLock(child->latch);
+        Scalar extent = PointType::distance(parent->centroid, child->centroid) + child->radius;
+        if (extent > parent->radius) {
+            parent->radius = extent * (1.0f + ENVELOPE_TOLERANCE);
+        }
+        parent->tagSignature.merge(child->tagSignature);
+        child = parent;
+    }
+}
+
+/**
+ * growLeafIndex
+ * Makes room in the id index for a data point added by a concurrent insert, doubling it so
+ * that the exclusive lock it takes stays rare.
+ * @param id: Id of the data point.
+ */
+
+template <int Dim, typename Scalar>
+void SSTree<Dim, Scalar>::growLeafIndex(DataId id) {
+    {
+        std::shared_lock<std::shared_mutex> index(arena->leafIndexMutex);
+        if (id < arena->leafOf.size()) {
+            return;
+        }
+    }
+    std::unique_lock<std::shared_mutex> index(arena->leafIndexMutex);
+    if (id >= arena->leafOf.size()) {
+        arena->leafOf.resize(std::max<size_t>(static_cast<size_t>(id) + 1, 2 * arena->leafOf.size()), nullptr);
+    }
+}
+
+/**
+ * reclaimNodes
+ * Frees the nodes retired by concurrent splits that no search can hold anymore.
+ * @param all: Free every retired node, when no other thread uses the tree.
+ */
+
+template <int Dim, typename Scalar>
+void SSTree<Dim, Scalar>::reclaimNodes(bool all) {
+    epochs.tryAdvance();
+    std::lock_guard<std::mutex> lock(arena->mutex);
+    size_t kept = 0;
+    for (const auto& [node, stamp] : retiredNodes) {
+        if (all || epochs.isSafe(stamp)) {
+            arena->nodes.destroy(node);
+        } else {
+            retiredNodes[kept++] = {node, stamp};
+        }
+    }
+    retiredNodes.resize(kept);
+}
+
+/**
+ * refreshEnvelopes
+ * Recomputes the envelopes of the internal nodes of a subtree from the bottom up.
+ * @param node: Root of the subtree.
+ */
+
+template <int Dim, typename Scalar>
+void SSTree<Dim, Scalar>::refreshEnvelopes(NodeType* node) {
+    if (node->isLeaf) {
+        return;
+    }
+    for (NodeType* child : node->children) {
+        refreshEnvelopes(child);
+    }
+    node->updateBoundingEnvelope();
+}
+
+/**
+ * collectData
+ * Gathers every data entry stored in the subtree rooted at a node.
+ * @param node: Root of the subtree to collect.
+ * @param out: Vector that receives the ids of the entries.
+ */
+
+template <int Dim, typename Scalar>
+void collectData(const SSNode<Dim, Scalar>* node, std::vector<DataId>& out) {
+    if (node->getIsLeaf()) {
+        out.insert(out.end(), node->getData().begin(), node->getData().end());
+        return;
+    }
+    for (const auto& child : node->getChildren()) {
+        collectData(child, out);
+    }
+}
+
+/**
+ * buildSubtree
+ * Builds, top-down, a subtree of the given height holding a range of data points.
+ * Each level splits its points into as few groups as the children can hold, so nodes
+ * end up filled close to `maxPointsPerNode`. With a pool, the children of a large
+ * range are built as separate tasks; they only share the node arena.
+ * @param first: Iterator to the first data point of the range.
+ * @param last: Iterator past the last data point of the range.
+ * @param height: Height of the subtree (0 builds a leaf).
+ * @param parent: Parent of the subtree root.
+ * @param pool: Pool for the parallel build, or nullptr.
+ * @return SSNode*: Root of the new subtree.
+ */
+
+template <int Dim, typename Scalar>
+SSNode<Dim, Scalar>* SSTree<Dim, Scalar>::buildSubtree(typename std::vector<const DataType*>::iterator first,
+                                                       typename std::vector<const DataType*>::iterator last,
+                                                       size_t height, NodeType* parent, ThreadPool* pool) {
+    NodeType* node;
+    {
+        std::unique_lock<std::mutex> lock(arena->mutex, std::defer_lock);
+        if (pool != nullptr) lock.lock();
+        node = createNode((*first)->getEmbedding(), height == 0, parent);
+    }
+
+    if (height == 0) {
+        for (auto it = first; it != last; ++it) {
+            node->_data.push_back((*it)->getId());
+        }
+        node->rebuildEmbeddings();
+        node->indexEntries();
+    } else {
+        size_t childCapacity = 1;
+        for (size_t level = 0; level < height; ++level) {
+            childCapacity *= maxPointsPerNode;
+        }
+
+        size_t count = std::distance(first, last);
+        size_t groups = (count + childCapacity - 1) / childCapacity;
+
+        std::vector<typename std::vector<const DataType*>::iterator> bounds;
+        partitionByMaxVariance(first, last, groups, bounds, pool);
+
+        if (pool != nullptr && count >= PARALLEL_BUILD_GRAIN) {
+            node->children.resize(bounds.size());
+            TaskGroup group;
+            auto groupFirst = first;
+            for (size_t i = 0; i < bounds.size(); ++i) {
+                pool->submit(group, [this, node, groupFirst, groupLast = bounds[i], height, pool, i](unsigned) {
+                    node->children[i] = buildSubtree(groupFirst, groupLast, height - 1, node, pool);
+                });
+                groupFirst = bounds[i];
+            }
+            pool->wait(group);
+        } else {
+            auto groupFirst = first;
+            for (auto groupLast : bounds) {
+                node->children.push_back(buildSubtree(groupFirst, groupLast, height - 1, node, pool));
+                groupFirst = groupLast;
+            }
+        }
+    }
+
+    node->updateBoundingEnvelope();
+    return node;
+}
+
+/**
+ * bulkLoad
+ * Builds the tree from a whole dataset in one top-down pass, recursively partitioning
+ * the points along their direction of maximum variance. The points are copied into the
+ * data store and get consecutive ids; entries already in the tree are loaded together
+ * with the new ones. Int8 trees first fit their quantizer, and trees routing on
+ * principal components their directions, to the whole dataset.
+ * With more than one thread, independent subtrees and the variance sums of large
+ * partitions are computed on the internal pool. The resulting tree satisfies the same
+ * invariants as a sequential build, though ties may group points differently.
+ * @param embeddings: Embeddings of the data to load.
+ * @param paths: Path of each embedding, or empty to leave every path empty.
+ * @param tags: Tags of each embedding, or empty to leave every point untagged.
+ * @param threads: Number of threads to build with (0 uses every hardware thread).
+ * @return DataId: Id of the first loaded point; the i-th point gets this id plus i.
+ */
+
+template <int Dim, typename Scalar>
+DataId SSTree<Dim, Scalar>::bulkLoad(const std::vector<PointType>& embeddings, const std::vector<std::string>& paths,
+                                     const std::vector<std::vector<Tag>>& tags, unsigned threads) {
+    if (!paths.empty() && paths.size() != embeddings.size()) {
+        throw std::invalid_argument("bulkLoad needs one path per embedding, or none");
+    }
+    if (!tags.empty() && tags.size() != embeddings.size()) {
+        throw std::invalid_argument("bulkLoad needs one tag list per embedding, or none");
+    }
+
+    const DataId firstId = static_cast<DataId>(store.size());
+    std::vector<const DataType*> data;
+    data.reserve(embeddings.size());
+    for (size_t i = 0; i < embeddings.size(); ++i) {
+        data.push_back(&store.add(embeddings[i], paths.empty() ? std::string_view() : std::string_view(paths[i]),
+                                  tags.empty() ? std::vector<Tag>() : tags[i]));
+    }
+    store.releaseRetired();
+
+    if (root != nullptr) {
+        std::vector<DataId> present;
+        collectData(root, present);
+        for (DataId id : present) {
+            data.push_back(&store.get(id));
+        }
+        destroySubtree(root);
+        root = nullptr;
+    }
+
+    if (data.empty()) {
+        return firstId;
+    }
+
+    // Sized up front, so that parallel builders only write the slots of their own points
+    createArena(data.front()->getEmbedding().size());
+    arena->leafOf.resize(store.size(), nullptr);
+
+    if (leafStorage == LeafStorage::Int8 || routing == Routing::PrincipalComponents) {
+        std::vector<const Scalar*> rows;
+        rows.reserve(data.size());
+        for (const auto* record : data) {
+            rows.push_back(record->getEmbedding().data());
+        }
+        if (leafStorage == LeafStorage::Int8) {
+            trainQuantizer(rows, arena->dimension);
+        }
+        if (routing == Routing::PrincipalComponents) {
+            trainRouting(rows, arena->dimension);
+        }
+    }
+
+    size_t height = 0;
+    for (size_t capacity = maxPointsPerNode; capacity < data.size(); capacity *= maxPointsPerNode) {
+        ++height;
+    }
+
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    if (threads == 1) {
+        root = buildSubtree(data.begin(), data.end(), height, nullptr);
+        return firstId;
+    }
+
+    std::lock_guard<std::mutex> lock(poolMutex);
+    if (!pool || pool->size() != threads) {
+        pool = std::make_unique<ThreadPool>(threads);
+    }
+    root = buildSubtree(data.begin(), data.end(), height, nullptr, pool.get());
+    return firstId;
+}
+
+/**
+ * trainQuantizer
+ * Fits the int8 code ranges of an Int8 tree to a sample of the data and re-encodes the
+ * leaves already built. Points later inserted outside the sampled ranges are clamped,
+ * which only costs accuracy in the approximate scan, since results are re-ranked exactly.
+ * Has no effect on other leaf storage formats.
+ * @param sample: Embeddings representative of what the tree will hold.
+ */
+
+template <int Dim, typename Scalar>
+void SSTree<Dim, Scalar>::trainQuantizer(const std::vector<PointType>& sample) {
+    if (leafStorage != LeafStorage::Int8) {
+        return;
+    }
+    if (sample.empty()) {
+        throw std::invalid_argument("Cannot train a quantizer on an empty sample");
+    }
+
+    std::vector<const Scalar*> rows;
+    rows.reserve(sample.size());
+    for (const auto& embedding : sample) {
+        rows.push_back(embedding.data());
+    }
+    trainQuantizer(rows, sample.front().size());
+}
+
+/**
+ * trainQuantizer
+ * Fits the int8 code ranges to a set of embedding rows and re-encodes the leaves already built.
+ * @param rows: Coordinates of each embedding of the sample.
+ * @param dimension: Number of coordinates per embedding.
+ */
+
+template <int Dim, typename Scalar>
+void SSTree<Dim, Scalar>::trainQuantizer(const std::vector<const Scalar*>& rows, size_t dimension) {
+    createArena(dimension);
+    arena->quantizer.train(rows.data(), rows.size(), dimension);
+
+    std::vector<NodeType*> pending;
+    if (root != nullptr) {
+        pending.push_back(root);
+    }
+    while (!pending.empty()) {
+        NodeType* node = pending.back();
+        pending.pop_back();
+        if (node->isLeaf) {
+            node->rebuildEmbeddings();
+        } else {
+            pending.insert(pending.end(), node->children.begin(), node->children.end());
+        }
+    }
+}
+
+/**
+ * remove
+ * Removes data from the tree. The id index gives its leaf directly; walking up from it,
+ * nodes left with fewer than
+ * `minPointsPerNode` entries are dissolved and their data set aside, while the others
+ * get their envelope recomputed exactly. A root left with a single child is replaced
+ * by that child, and the set-aside data is finally reinserted from the root.
+ * The record of the removed data stays in the data store, so its id is never reused.
+ * @param id: Id of the data to remove.
+ * @return bool: True if the data was found and removed.
+ */
+
+template <int Dim, typename Scalar>
+bool SSTree<Dim, Scalar>::remove(DataId id) {
+    NodeType* leaf = search(id);
+    if (leaf == nullptr) {
+        return false;
+    }
+
+    leaf->removeEntry(std::find(leaf->_data.begin(), leaf->_data.end(), id) - leaf->_data.begin());
+
+    std::vector<DataId> orphans;
+    for (NodeType* node = leaf; node != root;) {
+        NodeType* parent = node->parent;
+
+        if (node->entryCount() < minPointsPerNode) {
+            parent->children.erase(std::find(parent->children.begin(), parent->children.end(), node));
+            collectData(node, orphans);
+            destroySubtree(node);
+        } else {
+            node->updateBoundingEnvelope();
+        }
+
+        node = parent;
+    }
+
+    while (!root->isLeaf && root->children.size() == 1) {
+        NodeType* child = root->children.front();
+        root->children.clear();
+        arena->nodes.destroy(root);
+        root = child;
+        root->parent = nullptr;
+    }
+
+    if (root->entryCount() == 0) {
+        arena->nodes.destroy(root);
+        root = nullptr;
+    } else {
+        root->updateBoundingEnvelope();
+    }
+
+    for (DataId orphan : orphans) {
+        insertRecord(&store.get(orphan));
+    }
+
+    return true;
+}
+
+/**
+ * search
+ * Finds the leaf holding a data point in O(1) through the id index, which inserts,
+ * splits, bulk loads and removals keep current. Its ancestors follow from the parent
+ * pointers. SSNode::search still finds the leaf by descending the spheres.
+ * @param id: Id of the data to search for.
+ * @param stats: Left unchanged, as the lookup visits no node; SSNode::search counts its descent.
+ * @return SSNode*: Leaf containing the data (or nullptr if it is not in the tree).
+ */
+
+template <int Dim, typename Scalar>
+SSNode<Dim, Scalar>* SSTree<Dim, Scalar>::search(DataId id, [[maybe_unused]] QueryStats* stats) {
+    if (root == nullptr || id >= arena->leafOf.size()) return nullptr;
+    return arena->leafOf[id];
+}
+
+/**
+ * getEmbedding
+ * @param id: Id returned by insert or bulkLoad.
+ * @return const Point&: Embedding of the data, owned by the tree.
+ */
+
+template <int Dim, typename Scalar>
+const Point<Dim, Scalar>& SSTree<Dim, Scalar>::getEmbedding(DataId id) const {
+    if (!store.contains(id)) {
+        throw std::out_of_range("Unknown data id " + std::to_string(id));
+    }
+    return store.getEmbedding(id);
+}
+
+/**
+ * getPath
+ * @param id: Id returned by insert or bulkLoad.
+ * @return std::string_view: Path of the data, valid as long as the tree.
+ */
+
+template <int Dim, typename Scalar>
+std::string_view SSTree<Dim, Scalar>::getPath(DataId id) const {
+    if (!store.contains(id)) {
+        throw std::out_of_range("Unknown data id " + std::to_string(id));
+    }
+    return store.getPath(id);
+}
+
+/**
+ * getTags
+ * @param id: Id returned by insert or bulkLoad.
+ * @return TagList: Tags of the data, sorted, valid as long as the tree.
+ */
+
+template <int Dim, typename Scalar>
+TagList SSTree<Dim, Scalar>::getTags(DataId id) const {
+    if (!store.contains(id)) {
+        throw std::out_of_range("Unknown data id " + std::to_string(id));
+    }
+    return store.getTags(id);
+}
+
+/**
+ * knn-search
+ * Returns the k nearest neighbors.
+ * @param k: number of neighbors
+ * @param query: point from which to find the k nearest neighbors
+ * @return std::vector<DataId>: Ids of the k nearest neighbors
+ */
+
+template <int Dim, typename Scalar>
+std::vector<DataId> SSTree<Dim, Scalar>::knn(const PointType& query, size_t k) const {
+    return knn(query, k, KnnOptions());
+}
+
+/**
+ * knn-search
+ * Returns the k nearest neighbors, approximately when the options set a budget, an
+ * epsilon or an early stop.
+ * @param query: point from which to find the k nearest neighbors
+ * @param k: number of neighbors
+ * @param options: limits of the search
+ * @param report: if not null, receives the effort spent and the quality bound reached
+ * @return std::vector<DataId>: Ids of the k nearest neighbors found
+ */
+
+template <int Dim, typename Scalar>
+std::vector<DataId> SSTree<Dim, Scalar>::knn(const PointType& query, size_t k, const KnnOptions& options,
+                                             KnnReport* report) const {
+    return knn(query, k, SearchFilter(), options, report);
+}
+
+/**
+ * knn-search
+ * Returns the k nearest neighbors among the data matching a filter. Subtrees whose tag
+ * signature rules out every tag of the filter are skipped, so the search explores about
+ * as much of the tree as an unfiltered one over the matching data only.
+ * @param query: point from which to find the k nearest neighbors
+ * @param k: number of neighbors
+ * @param filter: data the neighbors are chosen from
+ * @param options: limits of the search
+ * @param report: if not null, receives the effort spent and the quality bound reached
+ * @return std::vector<DataId>: Ids of the k nearest matching neighbors found (fewer if fewer match)
+ */
+
+template <int Dim, typename Scalar>
+std::vector<DataId> SSTree<Dim, Scalar>::knn(const PointType& query, size_t k, const SearchFilter& filter,
+                                             const KnnOptions& options, KnnReport* report) const {
+    ContextType context;
+    knn(query, k, context, filter, options);
+    if (report != nullptr) {
+        *report = context.report;
+    }
+
+    std::vector<DataId> neighbors;
+    neighbors.reserve(context.results.size());
+    for (const auto& [distance, id] : context.results) {
+        neighbors.push_back(id);
+    }
+    return neighbors;
+}
+
+/**
+ * knn-search
+ * Best-first kNN traversal into a caller-owned context, which keeps the heaps and buffers
+ * between queries so that the search itself allocates nothing once they are sized.
+ * Distances are measured in the tree's metric, whose kernels are picked once per query.
+ * @param query: point from which to find the k nearest neighbors
+ * @param k: number of neighbors
+ * @param context: storage for the search; receives the results and the report
+ * @param options: limits of the search
+ * @return std::vector<std::pair<Scalar, DataId>>: The neighbors found with their distances, nearest first
+ */
+
+template <int Dim, typename Scalar>
+const std::vector<typename KnnContext<Dim, Scalar>::Neighbor>&
+SSTree<Dim, Scalar>::knn(const PointType& query, size_t k, ContextType& context, const KnnOptions& options) const {
+    return knn(query, k, context, SearchFilter(), options);
+}
+
+/**
+ * knn-search
+ * Filtered kNN traversal into a caller-owned context.
+ * @param query: point from which to find the k nearest neighbors
+ * @param k: number of neighbors
+ * @param context: storage for the search; receives the results and the report
+ * @param filter: data the neighbors are chosen from
+ * @param options: limits of the search
+ * @return std::vector<std::pair<Scalar, DataId>>: The matching neighbors found with their distances, nearest first
+ */
+
+template <int Dim, typename Scalar>
+const std::vector<typename KnnContext<Dim, Scalar>::Neighbor>&
+SSTree<Dim, Scalar>::knn(const PointType& query, size_t k, ContextType& context, const SearchFilter& filter,
+                         const KnnOptions& options) const {
+    switch (metric) {
+        case Metric::SquaredEuclidean:
+            knnSearch<Metric::SquaredEuclidean>(query, k, context, options, filter);
+            break;
+        case Metric::Cosine:
+            knnSearch<Metric::Cosine>(query, k, context, options, filter);
+            break;
+        case Metric::InnerProduct:
+            knnSearch<Metric::InnerProduct>(query, k, context, options, filter);
+            break;
+        default:
+            knnSearch<Metric::Euclidean>(query, k, context, options, filter);
+            break;
+    }
+    return context.results;
+}
+
+/**
+ * knnSearch
+ * kNN traversal under one metric. Entries are ranked by the metric's key in a (key, id)
+ * max-heap, and nodes are pruned against a cached bound that only changes when that heap
+ * does. With projected routing, Euclidean-ordered metrics order and prune nodes on lower
+ * bounds from the projected centroids.
+ * Leaves are scanned through their block: full-precision rows give exact keys, while
+ * quantized rows give approximate ones, for which k * QUANTIZED_RERANK_FACTOR candidates
+ * are kept and then re-ranked on their exact embeddings from the data store. Quantized
+ * rows only approximate Euclidean distances, so InnerProduct scores the stored embeddings.
+ * The search stops early when a budget of the options runs out or when the candidates
+ * have not changed for `maxStableLeaves` leaves, and epsilon prunes nodes whose lower
+ * bound is within a factor 1 + epsilon of the k-th distance. Whatever is left unexplored
+ * is summarized in the report's error bound.
+ * A filter skips the subtrees whose tag signature shares no bit with its tags, and the
+ * leaf entries that do not match it; neither counts as unexplored, as they hold no match.
+ * In concurrent mode the search may run alongside inserts, which it sees or not depending
+ * on whether they reached the nodes before it did.
+ * @param query: point from which to find the k nearest neighbors
+ * @param k: number of neighbors
+ * @param context: storage for the search; receives the results and the report
+ * @param options: limits of the search
+ * @param filter: data the neighbors are chosen from
+ */
+
+template <int Dim, typename Scalar>
+template <Metric M>
+void SSTree<Dim, Scalar>::knnSearch(const PointType& query, size_t k, ContextType& context,
+                                    const KnnOptions& options, const SearchFilter& filter) const {
+    using Kernel = MetricKernel<M>;
+    KnnReport& report = context.report;
+    report = KnnReport();
+    context.results.clear();
+    TagMatcher& matcher = context.matcher;
+    matcher.reset(&filter);
+
+    // In concurrent mode every node is read under its shared latch, and the search stays in an
+    // epoch so that the nodes it queued are not freed by a split meanwhile
+    const bool latched = concurrent;
+    EpochGuard epoch(latched ? &epochs : nullptr);
+    auto share = [latched](const NodeType* node) {
+        std::shared_lock<std::shared_mutex> lock(node->latch, std::defer_lock);
+        if (latched) {
+            lock.lock();
+        }
+        return lock;
+    };
+    const NodeType* top;
+    {
+        std::shared_lock<std::shared_mutex> rootLock(rootLatch, std::defer_lock);
+        if (latched) {
+            rootLock.lock();
+        }
+        top = root;
+    }
+    if (!top || k == 0) {
+        return;
+    }
+    {
+        auto topLock = share(top);
+        if (!matcher.mayMatch(top->getTagSignature())) {
+            return;
+        }
+    }
+
+    auto compare = [](const std::pair<const NodeType*, Scalar>& a, const std::pair<const NodeType*, Scalar>& b) {
+        return a.second > b.second;
+    };
+
+    auto& nodeQueue = context.nodeQueue;
+    auto& candidates = context.candidates;
+    auto& encodedQuery = context.encodedQuery;
+    auto& rows = context.rows;
+    auto& distances = context.distances;
+    nodeQueue.clear();
+    candidates.clear();
+
+    const size_t dimension = query.size();
+    // Leaves whose rows give approximate keys, re-ranked at the end
+    const bool quantized = Kernel::euclideanOrder && arena->storage != LeafStorage::Float;
+    // Leaves whose rows do not serve the metric, scored on the embeddings of the data store
+    const bool stored = !Kernel::euclideanOrder && arena->storage != LeafStorage::Float;
+    const bool int8 = arena->storage == LeafStorage::Int8;
+    const size_t capacity = quantized ? k * QUANTIZED_RERANK_FACTOR : k;
+
+    // The queue never holds more than every node, and no node has more than M + 1 entries. The
+    // node count is only a capacity hint, read without the arena lock that concurrent splits take
+    nodeQueue.reserve(arena->nodes.getObjectsInUse());
+    candidates.reserve(capacity);
+    context.results.reserve(k);
+    rows.reserve(maxPointsPerNode + 1);
+    distances.reserve(maxPointsPerNode + 1);
+    context.entryMatches.reserve(maxPointsPerNode + 1);
+
+    if (quantized && int8) {
+        encodedQuery.resize(dimension);
+        arena->quantizer.prepareQuery(query.data(), dimension, encodedQuery.data());
+    } else if (quantized) {
+        encodedQuery.assign(query.data(), query.data() + dimension);
+    }
+
+    // Nodes are bounded in the routing space: the full space, or the projected one
+    const bool projected = Kernel::euclideanOrder && arena->projection.isTrained();
+    const size_t routingDimension = projected ? arena->projection.outputDimension() : dimension;
+    const Scalar routingScale = projected ? Scalar(1) - static_cast<Scalar>(PROJECTION_TOLERANCE) : Scalar(1);
+    const Scalar* routingQuery = query.data();
+    if (projected) {
+        context.projectedQuery.resize(routingDimension);
+        arena->projection.project(query.data(), context.projectedQuery.data());
+        routingQuery = context.projectedQuery.data();
+    }
+    auto routingCentroid = [projected](const NodeType* node) {
+        return projected ? node->getRoutingCentroid() : node->getCentroid().data();
+    };
+
+    const Scalar queryNorm = std::sqrt(dotProduct(query.data(), query.data(), dimension));
+    auto nodeBound = [&](Scalar centroidScore, const NodeType* node) {
+        return Kernel::nodeBound(centroidScore, node->getRadius(), queryNorm, routingScale);
+    };
+
+    const Scalar infinity = std::numeric_limits<Scalar>::infinity();
+    const Scalar relaxation = Scalar(1) + static_cast<Scalar>(options.epsilon);
+    // Divides positive distances by 1 + epsilon and multiplies negative ones (inner products)
+    auto relax = [relaxation](Scalar distance) {
+        return distance >= Scalar(0) ? distance / relaxation : distance * relaxation;
+    };
+    // Lower bound a node must not exceed to be explored: the k-th candidate distance over 1 + epsilon
+    Scalar pruneDistance = infinity;
+    // Smallest lower bound among the nodes left unexplored
+    Scalar unexplored = infinity;
+    size_t stableLeaves = 0;
+
+    {
+        auto topLock = share(top);
+        const Scalar* rootCentroid = routingCentroid(top);
+        Scalar rootScore;
+        Kernel::centroidScores(routingQuery, &rootCentroid, 1, routingDimension, &rootScore);
+        nodeQueue.emplace_back(top, nodeBound(rootScore, top));
+    }
+    SSTREE_STAT(++report.stats.centroidDistances;)
+
+    while (!nodeQueue.empty()) {
+        std::pop_heap(nodeQueue.begin(), nodeQueue.end(), compare);
+        auto [currentNode, nodeDistance] = nodeQueue.back();
+        nodeQueue.pop_back();
+        SSTREE_STAT(++report.stats.nodesPopped;)
+
+        if (nodeDistance > pruneDistance) {
+            SSTREE_STAT(++report.stats.nodesPruned;)
+            unexplored = std::min(unexplored, nodeDistance);
+            continue;
+        }
+
+        if (currentNode->getIsLeaf()) {
+            if (options.maxLeaves != 0 && report.leavesVisited >= options.maxLeaves) {
+                report.stop = KnnStop::LeafBudget;
+            } else if (options.maxDistanceEvaluations != 0 && report.distanceEvaluations >= options.maxDistanceEvaluations) {
+                report.stop = KnnStop::DistanceBudget;
+            } else if (options.maxStableLeaves != 0 && stableLeaves >= options.maxStableLeaves) {
+                report.stop = KnnStop::Stable;
+            }
+            if (report.stop != KnnStop::Completed) {
+                // The queue is ordered by lower bound, so nothing left in it is closer than this node
+                unexplored = std::min(unexplored, nodeDistance);
+                break;
+            }
+
+            auto leafLock = share(currentNode);
+            const auto& entries = currentNode->getData();
+            // Leaves without a matching entry are visited but not scanned
+            ++report.nodesVisited;
+            auto& entryMatches = context.entryMatches;
+            if (matcher.isActive()) {
+                entryMatches.resize(entries.size());
+                bool anyMatch = false;
+                for (size_t i = 0; i < entries.size(); ++i) {
+                    entryMatches[i] = matcher.matches(entries[i], store.getTags(entries[i]));
+                    anyMatch = anyMatch || entryMatches[i];
+                }
+                if (!anyMatch) {
+                    ++stableLeaves;
+                    continue;
+                }
+            }
+
+            ++report.leavesVisited;
+            distances.resize(entries.size());
+            if (stored) {
+                rows.clear();
+                for (DataId id : entries) {
+                    rows.push_back(store.getEmbedding(id).data());
+                }
+                Kernel::scoreBatch(query.data(), rows.data(), rows.size(), dimension, distances.data());
+            } else if (!quantized) {
+                Kernel::scoreRows(query.data(), currentNode->getEmbeddings(), entries.size(),
+                                  currentNode->getEmbeddingStride(), dimension, distances.data());
+            } else if constexpr (Kernel::euclideanOrder) {
+                const unsigned char* block = currentNode->getLeafBlock();
+                for (size_t i = 0; i < entries.size(); ++i) {
+                    const unsigned char* row = block + i * arena->rowBytes;
+                    distances[i] = Kernel::fromSquaredDistance(
+                        int8 ? squaredDistanceInt8(encodedQuery.data(), arena->quantizer.getWeights(), row, dimension)
+                             : squaredDistanceHalf(encodedQuery.data(), reinterpret_cast<const uint16_t*>(row), dimension));
+                }
+            }
+            report.distanceEvaluations += entries.size();
+            SSTREE_STAT(++report.stats.leavesScanned;)
+            SSTREE_STAT(report.stats.entryDistances += entries.size();)
+
+            bool changed = false;
+            for (size_t i = 0; i < entries.size(); ++i) {
+                if (matcher.isActive() && !entryMatches[i]) {
+                    continue;
+                }
+                if (candidates.size() < capacity) {
+                    candidates.emplace_back(distances[i], entries[i]);
+                    std::push_heap(candidates.begin(), candidates.end());
+                    changed = true;
+                } else if (distances[i] < candidates.front().first) {
+                    std::pop_heap(candidates.begin(), candidates.end());
+                    candidates.back() = {distances[i], entries[i]};
+                    std::push_heap(candidates.begin(), candidates.end());
+                    changed = true;
+                }
+            }
+            if (changed && candidates.size() == capacity) {
+                pruneDistance = relax(Kernel::distance(candidates.front().first));
+            }
+            stableLeaves = changed ? 0 : stableLeaves + 1;
+        } else {
+            ++report.nodesVisited;
+
+            auto nodeLock = share(currentNode);
+            const auto& children = currentNode->getChildren();
+            // The children's envelopes are read under their latches, released before the queue grows
+            if (latched) {
+                for (const NodeType* child : children) {
+                    child->latch.lock_shared();
+                }
+            }
+            auto& childMatches = context.entryMatches;
+            childMatches.resize(children.size());
+            rows.clear();
+            for (const auto& child : children) {
+                rows.push_back(routingCentroid(child));
+            }
+            distances.resize(rows.size());
+            Kernel::centroidScores(routingQuery, rows.data(), rows.size(), routingDimension, distances.data());
+            SSTREE_STAT(report.stats.centroidDistances += children.size();)
+            for (size_t i = 0; i < children.size(); ++i) {
+                childMatches[i] = matcher.mayMatch(children[i]->getTagSignature());
+                distances[i] = nodeBound(distances[i], children[i]);
+            }
+            if (latched) {
+                for (const NodeType* child : children) {
+                    child->latch.unlock_shared();
+                }
+            }
+
+            for (size_t i = 0; i < children.size(); ++i) {
+                if (!childMatches[i]) {
+                    SSTREE_STAT(++report.stats.nodesPruned;)
+                    continue;
+                }
+                Scalar childDistance = distances[i];
+                if (childDistance > pruneDistance) {
+                    SSTREE_STAT(++report.stats.nodesPruned;)
+                    unexplored = std::min(unexplored, childDistance);
+                    continue;
+                }
+                nodeQueue.emplace_back(children[i], childDistance);
+                std::push_heap(nodeQueue.begin(), nodeQueue.end(), compare);
+            }
+        }
+    }
+
+    if (quantized) {
+        for (auto& candidate : candidates) {
+            const Scalar* row = store.getEmbedding(candidate.second).data();
+            Kernel::scoreBatch(query.data(), &row, 1, dimension, &candidate.first);
+        }
+    }
+    size_t count = std::min(k, candidates.size());
+    std::partial_sort(candidates.begin(), candidates.begin() + count, candidates.end());
+    for (size_t i = 0; i < count; ++i) {
+        context.results.emplace_back(Kernel::distance(candidates[i].first), candidates[i].second);
+    }
+
+    // Every unexplored point is at least `unexplored` away, so the true k-th distance is at
+    // least min(kth, unexplored); inner products compare the other way round
+    Scalar kth = count < k ? infinity : context.results.back().first;
+    if (unexplored >= kth) {
+        report.errorBound = 1.0;
+    } else if (unexplored > Scalar(0)) {
+        report.errorBound = static_cast<double>(kth / unexplored);
+    } else if (kth < Scalar(0)) {
+        report.errorBound = static_cast<double>(unexplored / kth);
+    } else {
+        report.errorBound = std::numeric_limits<double>::infinity();
+    }
+}
+
+/**
+ * rangeSearch
+ * Returns every data point within a distance of the query that matches a filter.
+ * @param query: Center of the search.
+ * @param range: Maximum distance from the query.
+ * @param filter: Data the matches are chosen from (all of it by default).
+ * @return std::vector<DataId>: Ids of the data within range, in tree order.
+ */
+
+template <int Dim, typename Scalar>
+std::vector<DataId> SSTree<Dim, Scalar>::rangeSearch(const PointType& query, Scalar range,
+                                                     const SearchFilter& filter) const {
+    std::vector<DataId> ans;
+    forEachInRange(query, range, filter, [&ans](DataId id, Scalar) {
+        ans.push_back(id);
+        return true;
+    });
+    return ans;
+}
+
+/**
+ * forEachInRange
+ * Streams every data point within a distance of the query, in the tree's metric, to a
+ * visitor, without collecting them. Subtrees whose bounding sphere lies entirely farther
+ * than the range are skipped.
+ * @param query: Center of the search.
+ * @param range: Maximum distance from the query.
+ * @param visitor: Called with the id of each match and its distance; returning false stops the search.
+ */
+
+template <int Dim, typename Scalar>
+void SSTree<Dim, Scalar>::forEachInRange(const PointType& query, Scalar range,
+                                         const std::function<bool(DataId, Scalar)>& visitor) const {
+    forEachInRange(query, range, SearchFilter(), visitor);
+}
+
+/**
+ * forEachInRange
+ * Streams every data point within a distance of the query that matches a filter to a
+ * visitor. Subtrees whose tag signature rules out the filter's tags are skipped too.
+ * @param query: Center of the search.
+ * @param range: Maximum distance from the query.
+ * @param filter: Data the matches are chosen from.
+ * @param visitor: Called with the id of each match and its distance; returning false stops the search.
+ */
+
+template <int Dim, typename Scalar>
+void SSTree<Dim, Scalar>::forEachInRange(const PointType& query, Scalar range, const SearchFilter& filter,
+                                         const std::function<bool(DataId, Scalar)>& visitor) const {
+    switch (metric) {
+        case Metric::SquaredEuclidean:
+            rangeSearch<Metric::SquaredEuclidean>(query, range, filter, visitor);
+            break;
+        case Metric::Cosine:
+            rangeSearch<Metric::Cosine>(query, range, filter, visitor);
+            break;
+        case Metric::InnerProduct:
+            rangeSearch<Metric::InnerProduct>(query, range, filter, visitor);
+            break;
+        default:
+            rangeSearch<Metric::Euclidean>(query, range, filter, visitor);
+            break;
+    }
+}
+
+/**
+ * rangeSearch
+ * Range traversal under one metric; nodes are bounded on their full centroids.
+ * @param query: Center of the search.
+ * @param range: Maximum distance from the query.
+ * @param filter: Data the matches are chosen from.
+ * @param visitor: Called with the id of each match and its distance; returning false stops the search.
+ */
+
+template <int Dim, typename Scalar>
+template <Metric M>
+void SSTree<Dim, Scalar>::rangeSearch(const PointType& query, Scalar range, const SearchFilter& filter,
+                                      const std::function<bool(DataId, Scalar)>& visitor) const {
+    assert(!concurrent && "forEachInRange reads the nodes unlatched");
+    using Kernel = MetricKernel<M>;
+    TagMatcher matcher;
+    matcher.reset(&filter);
+    if (!root || !matcher.mayMatch(root->getTagSignature())) {
+        return;
+    }
+
+    const size_t dimension = query.size();
+    const Scalar queryNorm = std::sqrt(dotProduct(query.data(), query.data(), dimension));
+    auto nodeBound = [&](const Scalar* centroid, const NodeType* node) {
+        Scalar score;
+        Kernel::centroidScores(query.data(), &centroid, 1, dimension, &score);
+        return Kernel::nodeBound(score, node->getRadius(), queryNorm, Scalar(1));
+    };
+    if (nodeBound(root->getCentroid().data(), root) > range) {
+        return;
+    }
+
+    std::vector<const NodeType*> pending{root};
+    std::vector<const Scalar*> rows;
+    std::vector<Scalar> distances;
+
+    while (!pending.empty()) {
+        const NodeType* currentNode = pending.back();
+        pending.pop_back();
+
+        if (currentNode->getIsLeaf()) {
+            const auto& entries = currentNode->getData();
+            distances.resize(entries.size());
+            if (arena->storage == LeafStorage::Float) {
+                Kernel::scoreRows(query.data(), currentNode->getEmbeddings(), entries.size(),
+                                  currentNode->getEmbeddingStride(), dimension, distances.data());
+            } else {
+                // Quantized rows are approximate; range membership is decided on the exact embeddings
+                rows.clear();
+                for (DataId id : entries) {
+                    rows.push_back(store.getEmbedding(id).data());
+                }
+                Kernel::scoreBatch(query.data(), rows.data(), rows.size(), dimension, distances.data());
+            }
+
+            for (size_t i = 0; i < entries.size(); ++i) {
+                Scalar distance = Kernel::distance(distances[i]);
+                if (distance <= range && matcher.matches(entries[i], store.getTags(entries[i]))
+                    && !visitor(entries[i], distance)) {
+                    return;
+                }
+            }
+        } else {
+            const auto& children = currentNode->getChildren();
+            rows.clear();
+            for (const auto& child : children) {
+                rows.push_back(child->getCentroid().data());
+            }
+            distances.resize(rows.size());
+            Kernel::centroidScores(query.data(), rows.data(), rows.size(), dimension, distances.data());
+
+            for (size_t i = 0; i < children.size(); ++i) {
+                if (Kernel::nodeBound(distances[i], children[i]->getRadius(), queryNorm, Scalar(1)) <= range
+                    && matcher.mayMatch(children[i]->getTagSignature())) {
+                    pending.push_back(children[i]);
+                }
+            }
+        }
+    }
+}
+
+/**
+ * nearest
+ * Starts an incremental nearest-neighbor search, under the tree's metric.
+ * @param query: Point whose neighbors to enumerate.
+ * @param filter: Data the neighbors are chosen from (all of it by default).
+ * @return NearestNeighborIterator: Iterator returning the matching neighbors nearest first.
+ */
+
+template <int Dim, typename Scalar>
+NearestNeighborIterator<Dim, Scalar> SSTree<Dim, Scalar>::nearest(const PointType& query,
+                                                                  const SearchFilter& filter) const {
+    return NearestNeighborIterator<Dim, Scalar>(this, query, filter);
+}
+
+/**
+ * NearestNeighborIterator
+ * Queues the root of the tree, unless the filter rules out the whole tree.
+ */
+
+template <int Dim, typename Scalar>
+NearestNeighborIterator<Dim, Scalar>::NearestNeighborIterator(const SSTree<Dim, Scalar>* tree, const PointType& query,
+                                                              const SearchFilter& filter)
+    : tree(tree), query(query), queryNorm(std::sqrt(dotProduct(query.data(), query.data(), query.size()))), filter(std::make_unique<SearchFilter>(filter)) {
+    assert(!tree->concurrent && "nearest reads the nodes unlatched");
+    matcher.reset(this->filter.get());
+    const NodeType* root = tree->root;
+    if (root != nullptr && matcher.mayMatch(root->getTagSignature())) {
+        push(std::numeric_limits<Scalar>::lowest(), root, 0);
+    }
+}
+
+template <int Dim, typename Scalar>
+void NearestNeighborIterator<Dim, Scalar>::push(Scalar key, const NodeType* node, DataId id) {
+    queue.push_back({key, node, id});
+    std::push_heap(queue.begin(), queue.end(), std::greater<Item>());
+}
+
+/**
+ * next
+ * Expands nodes from the queue until a data point comes first, and returns it.
+ * @param neighbor: Receives the next neighbor and its distance.
+ * @return bool: False once every matching data point has been returned.
+ */
+
+template <int Dim, typename Scalar>
+bool NearestNeighborIterator<Dim, Scalar>::next(Neighbor& neighbor) {
+    while (!queue.empty()) {
+        std::pop_heap(queue.begin(), queue.end(), std::greater<Item>());
+        Item item = queue.back();
+        queue.pop_back();
+
+        if (item.node == nullptr) {
+            neighbor = {item.key, item.id};
+            return true;
+        }
+        switch (tree->metric) {
+            case Metric::SquaredEuclidean:
+                expand<Metric::SquaredEuclidean>(item.node);
+                break;
+            case Metric::Cosine:
+                expand<Metric::Cosine>(item.node);
+                break;
+            case Metric::InnerProduct:
+                expand<Metric::InnerProduct>(item.node);
+                break;
+            default:
+                expand<Metric::Euclidean>(item.node);
+                break;
+        }
+    }
+    return false;
+}
+
+/**
+ * expand
+ * Queues the matching entries of a leaf with their exact distances, or the children of an
+ * internal node that may hold a match with the smallest distance their sphere allows.
+ * Quantized leaves are scored on the embeddings of the data store, as the order of the
+ * returned neighbors must be exact.
+ * @param node: Node popped from the queue.
+ */
+
+template <int Dim, typename Scalar>
+template <Metric M>
+void NearestNeighborIterator<Dim, Scalar>::expand(const NodeType* node) {
+    using Kernel = MetricKernel<M>;
+    const size_t dimension = query.size();
+    ++report.nodesVisited;
+
+    if (node->getIsLeaf()) {
+        const auto& entries = node->getData();
+        scores.resize(entries.size());
+        if (tree->arena->storage == LeafStorage::Float) {
+            Kernel::scoreRows(query.data(), node->getEmbeddings(), entries.size(), node->getEmbeddingStride(),
+                              dimension, scores.data());
+        } else {
+            rows.clear();
+            for (DataId id : entries) {
+                rows.push_back(tree->store.getEmbedding(id).data());
+            }
+            Kernel::scoreBatch(query.data(), rows.data(), rows.size(), dimension, scores.data());
+        }
+        ++report.leavesVisited;
+        report.distanceEvaluations += entries.size();
+
+        for (size_t i = 0; i < entries.size(); ++i) {
+            if (!matcher.isActive() || matcher.matches(entries[i], tree->store.getTags(entries[i]))) {
+                push(Kernel::distance(scores[i]), nullptr, entries[i]);
+            }
+        }
+    } else {
+        const auto& children = node->getChildren();
+        rows.clear();
+        for (const auto& child : children) {
+            rows.push_back(child->getCentroid().data());
+        }
+        scores.resize(rows.size());
+        Kernel::centroidScores(query.data(), rows.data(), rows.size(), dimension, scores.data());
+
+        for (size_t i = 0; i < children.size(); ++i) {
+            if (matcher.mayMatch(children[i]->getTagSignature())) {
+                push(Kernel::nodeBound(scores[i], children[i]->getRadius(), queryNorm, Scalar(1)), children[i], 0);
+            }
+        }
+    }
+}
+
+/**
+ * routingKey
+ * Encodes the root-to-leaf path an insertion of the query would follow, so that sorting
+ * queries by key places queries that land in the same subtree next to each other.
+ * Levels that no longer fit in 64 bits are dropped.
+ * @param query: Query point.
+ * @return uint64_t: Key ordering queries by subtree.
+ */
+
+template <int Dim, typename Scalar>
+uint64_t SSTree<Dim, Scalar>::routingKey(const PointType& query) const {
+    size_t bitsPerLevel = 1;
+    while ((size_t(1) << bitsPerLevel) <= maxPointsPerNode) {
+        ++bitsPerLevel;
+    }
+
+    // In concurrent mode the descent couples shared latches as knnSearch does, inside an epoch
+    // so that no node on the path is freed by a split meanwhile
+    const bool latched = concurrent;
+    EpochGuard epoch(latched ? &epochs : nullptr);
+    std::shared_lock<std::shared_mutex> nodeLock;
+    NodeType* node;
+    {
+        std::shared_lock<std::shared_mutex> rootLock(rootLatch, std::defer_lock);
+        if (latched) {
+            rootLock.lock();
+        }
+        node = root;
+        if (latched && node != nullptr) {
+            nodeLock = std::shared_lock<std::shared_mutex>(node->latch);
+        }
+    }
+
+    uint64_t key = 0;
+    size_t usedBits = 0;
+    for (; node != nullptr && !node->getIsLeaf() && usedBits + bitsPerLevel <= 64; usedBits += bitsPerLevel) {
+        size_t index = 0;
+        Scalar minDistance = std::numeric_limits<Scalar>::max();
+        for (size_t i = 0; i < node->children.size(); ++i) {
+            std::shared_lock<std::shared_mutex> childLock(node->children[i]->latch, std::defer_lock);
+            if (latched) {
+                childLock.lock();
+            }
+            Scalar childDistance = node->children[i]->getCentroid().distanceSquared(query);
+            if (childDistance < minDistance) {
+                minDistance = childDistance;
+                index = i;
+            }
+        }
+        key = (key << bitsPerLevel) | index;
+        NodeType* closestChild = node->children[index];
+        if (latched) {
+            std::shared_lock<std::shared_mutex> childLock(closestChild->latch);
+            nodeLock = std::move(childLock);
+        }
+        node = closestChild;
+    }
+
+    return usedBits < 64 ? key << (64 - usedBits) : key;
+}
+
+/**
+ * knnBatch
+ * Answers a batch of kNN queries on the tree's internal work-stealing thread pool.
+ * Queries are ordered by the subtree they fall in and handed out in chunks, so a worker
+ * tends to revisit the same nodes while they are still in cache; each worker reuses
+ * its own KnnContext across the queries it runs. Concurrent calls are serialized.
+ * @param queries: Query points.
+ * @param k: number of neighbors per query
+ * @param threads: Number of worker threads (0 uses the hardware concurrency).
+ * @param options: Limits applied to every query.
+ * @param reports: If not null, receives the report of each query, in input order.
+ * @return std::vector<std::vector<DataId>>: Ids of the k nearest neighbors of each query, in input order.
+ */
+
+template <int Dim, typename Scalar>
+std::vector<std::vector<DataId>> SSTree<Dim, Scalar>::knnBatch(const std::vector<PointType>& queries,
+                                                               size_t k, unsigned threads,
+                                                               const KnnOptions& options,
+                                                               std::vector<KnnReport>* reports) const {
+    std::vector<std::vector<DataId>> results(queries.size());
+    std::vector<KnnReport> localReports;
+    std::vector<KnnReport>& queryReports = reports != nullptr ? *reports : localReports;
+    queryReports.assign(queries.size(), KnnReport());
+    {
+        std::shared_lock<std::shared_mutex> rootLock(rootLatch, std::defer_lock);
+        if (concurrent) {
+            rootLock.lock();
+        }
+        if (!root || queries.empty()) {
+            return results;
+        }
+    }
+
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    std::vector<std::pair<uint64_t, size_t>> order(queries.size());
+    for (size_t i = 0; i < queries.size(); ++i) {
+        order[i] = {routingKey(queries[i]), i};
+    }
+    std::sort(order.begin(), order.end());
+
+    std::lock_guard<std::mutex> lock(poolMutex);
+    if (!pool || pool->size() != threads) {
+        pool = std::make_unique<ThreadPool>(threads);
+    }
+
+    std::vector<ContextType> contexts(threads);
+    size_t chunkSize = std::max<size_t>(1, std::min<size_t>(KNN_BATCH_CHUNK, queries.size() / (threads * 4)));
+
+    for (size_t first = 0; first < order.size(); first += chunkSize) {
+        size_t last = std::min(order.size(), first + chunkSize);
+        pool->submit([&, first, last](unsigned worker) {
+            for (size_t i = first; i < last; ++i) {
+                size_t queryIndex = order[i].second;
+                const auto& neighbors = knn(queries[queryIndex], k, contexts[worker], options);
+                for (const auto& [distance, id] : neighbors) {
+                    results[queryIndex].push_back(id);
+                }
+                queryReports[queryIndex] = contexts[worker].report;
+            }
+        });
+    }
+    pool->wait();
+
+    return results;
+}
+/**
+ * memoryUsage
+ * Reports the memory held by the tree: arena slabs for nodes and leaf blocks, the
+ * heap storage of the per-node entry lists, projected centroids and id index, and the
+ * records and paths of the data store.
+ * @return MemoryUsage: Breakdown of the memory in use.
+ */
+
+template <int Dim, typename Scalar>
+MemoryUsage SSTree<Dim, Scalar>::memoryUsage() const {
+    MemoryUsage usage;
+    usage.dataBytes = store.getReservedBytes();
+    if (!arena) {
+        return usage;
+    }
+
+    usage.nodes = arena->nodes.getObjectsInUse();
+    usage.leaves = arena->leafBlocks.getBlocksInUse();
+    usage.nodeBytes = arena->nodes.getReservedBytes();
+    usage.leafBlockBytes = arena->leafBlocks.getReservedBytes();
+
+    std::vector<const NodeType*> pending;
+    if (root != nullptr) {
+        pending.push_back(root);
+    }
+    while (!pending.empty()) {
+        const NodeType* node = pending.back();
+        pending.pop_back();
+
+        usage.heapBytes += node->children.capacity() * sizeof(NodeType*) + node->_data.capacity() * sizeof(DataId)
+                           + node->routingCentroid.capacity() * sizeof(Scalar);
+        if (Dim == Eigen::Dynamic) {
+            usage.heapBytes += (node->centroid.size() + node->entrySum.size()) * sizeof(Scalar);
+        }
+        pending.insert(pending.end(), node->children.begin(), node->children.end());
+    }
+    usage.heapBytes += arena->leafOf.capacity() * sizeof(NodeType*) + arena->projection.getReservedBytes();
+
+    return usage;
+}
+/**
+ * treeStats
+ * Walks the tree level by level and summarizes its shape: height, fan-out histogram,
+ * leaf fill, radius of the nodes on each level and overlap between sibling spheres.
+ * Overlapping siblings force searches to descend into several subtrees, so a growing
+ * overlap after many inserts is a sign the tree would benefit from a rebuild.
+ * @return TreeStats: Statistics of the tree.
+ */
+
+template <int Dim, typename Scalar>
+TreeStats SSTree<Dim, Scalar>::treeStats() const {
+    TreeStats stats;
+    std::vector<const NodeType*> level;
+    if (root != nullptr) {
+        level.push_back(root);
+    }
+
+    while (!level.empty()) {
+        LevelStats levelStats;
+        std::vector<const NodeType*> next;
+        double overlapSum = 0.0;
+
+        for (const NodeType* node : level) {
+            ++stats.nodes;
+            ++levelStats.nodes;
+            levelStats.radius.add(static_cast<double>(node->radius));
+
+            if (node->isLeaf) {
+                ++stats.leaves;
+                stats.entries += node->_data.size();
+                stats.leafFill.add(static_cast<double>(node->_data.size()) / static_cast<double>(maxPointsPerNode));
+                continue;
+            }
+
+            const auto& children = node->children;
+            if (stats.fanOut.size() <= children.size()) {
+                stats.fanOut.resize(children.size() + 1, 0);
+            }
+            ++stats.fanOut[children.size()];
+            next.insert(next.end(), children.begin(), children.end());
+        }
+
+        // Siblings are contiguous on a level, since each parent appends all its children at once
+        for (size_t first = 0; first < level.size();) {
+            size_t last = first;
+            while (last < level.size() && level[last]->parent == level[first]->parent) {
+                ++last;
+            }
+            for (size_t i = first; i < last; ++i) {
+                for (size_t j = i + 1; j < last; ++j) {
+                    double reach = static_cast<double>(level[i]->radius + level[j]->radius);
+                    double gap = static_cast<double>(level[i]->centroid.distance(level[j]->centroid));
+                    ++levelStats.siblingPairs;
+                    if (gap < reach) {
+                        ++levelStats.overlappingPairs;
+                        overlapSum += (reach - gap) / reach;
+                    }
+                }
+            }
+            first = last;
+        }
+        if (levelStats.siblingPairs > 0) {
+            levelStats.meanOverlap = overlapSum / static_cast<double>(levelStats.siblingPairs);
+        }
+
+        stats.levels.push_back(levelStats);
+        level.swap(next);
+    }
+
+    stats.height = stats.levels.size();
+    return stats;
+}
+
+/**
+ * save
+ * Writes the tree to an index file (see IndexFormat.h) that MappedSSTree can query in place.
+ * Nodes are laid out breadth-first so that the children of a node, their centroids and
+ * the entries of a leaf each occupy one contiguous run. Each entry keeps its id and the
+ * header the tree's metric, so that the mapped index returns the ids, in the order, that
+ * this tree's searches do.
+ * @param path: File to write.
+ */
+
+template <int Dim, typename Scalar>
+void SSTree<Dim, Scalar>::save(const std::string& path) const {
+    std::vector<const NodeType*> order;
+    if (root != nullptr) {
+        order.push_back(root);
+    }
+
+    std::vector<IndexNode> nodes;
+    uint64_t entryCount = 0;
+    for (size_t i = 0; i < order.size(); ++i) {
+        const NodeType* node = order[i];
+        IndexNode record{static_cast<double>(node->radius), node->isLeaf ? 1u : 0u,
+                         static_cast<uint32_t>(node->entryCount()), 0};
+        if (node->isLeaf) {
+            record.first = entryCount;
+            entryCount += node->_data.size();
+        } else {
+            record.first = order.size();
+            order.insert(order.end(), node->children.begin(), node->children.end());
+        }
+        nodes.push_back(record);
+    }
+
+    const size_t dimension = root != nullptr ? root->centroid.size() : PointType::defaultDimension;
+    const size_t stride = embeddingStride<Scalar>(dimension);
+    const uint64_t rowBytes = stride * sizeof(Scalar);
+
+    std::vector<uint64_t> pathOffsets{0};
+    std::string pathBlob;
+    for (const NodeType* node : order) {
+        for (DataId id : node->_data) {
+            pathBlob += store.getPath(id);
+            pathOffsets.push_back(pathBlob.size());
+        }
+    }
+
+    IndexHeader header{};
+    header.magic = INDEX_MAGIC;
+    header.version = INDEX_VERSION;
+    header.byteOrder = INDEX_BYTE_ORDER;
+    header.scalarSize = sizeof(Scalar);
+    header.dimension = static_cast<uint32_t>(dimension);
+    header.stride = static_cast<uint32_t>(stride);
+    header.maxPointsPerNode = static_cast<uint32_t>(maxPointsPerNode);
+    header.metric = static_cast<uint32_t>(metric);
+    header.nodeCount = nodes.size();
+    header.entryCount = entryCount;
+    header.nodesOffset = alignIndexOffset(sizeof(IndexHeader));
+    header.centroidsOffset = alignIndexOffset(header.nodesOffset + nodes.size() * sizeof(IndexNode));
+    header.embeddingsOffset = alignIndexOffset(header.centroidsOffset + nodes.size() * rowBytes);
+    header.idsOffset = alignIndexOffset(header.embeddingsOffset + entryCount * rowBytes);
+    header.pathOffsetsOffset = alignIndexOffset(header.idsOffset + entryCount * sizeof(DataId));
+    header.pathsOffset = alignIndexOffset(header.pathOffsetsOffset + pathOffsets.size() * sizeof(uint64_t));
+    header.fileSize = header.pathsOffset + pathBlob.size();
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw std::runtime_error("Cannot create index file: " + path);
+    }
+
+    std::vector<char> padding(INDEX_ALIGNMENT, 0);
+    auto padTo = [&](uint64_t offset) {
+        out.write(padding.data(), static_cast<std::streamsize>(offset - static_cast<uint64_t>(out.tellp())));
+    };
+    std::vector<Scalar> row(stride, Scalar(0));
+    auto writeRow = [&](const Scalar* coordinates) {
+        std::copy(coordinates, coordinates + dimension, row.begin());
+        out.write(reinterpret_cast<const char*>(row.data()), static_cast<std::streamsize>(rowBytes));
+    };
+
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    padTo(header.nodesOffset);
+    out.write(reinterpret_cast<const char*>(nodes.data()), static_cast<std::streamsize>(nodes.size() * sizeof(IndexNode)));
+    padTo(header.centroidsOffset);
+    for (const NodeType* node : order) {
+        writeRow(node->centroid.data());
+    }
+    padTo(header.embeddingsOffset);
+    for (const NodeType* node : order) {
+        for (size_t i = 0; i < node->_data.size(); ++i) {
+            writeRow(store.getEmbedding(node->_data[i]).data());
+        }
+    }
+    padTo(header.idsOffset);
+    for (const NodeType* node : order) {
+        out.write(reinterpret_cast<const char*>(node->_data.data()),
+                  static_cast<std::streamsize>(node->_data.size() * sizeof(DataId)));
+    }
+    padTo(header.pathOffsetsOffset);
+    out.write(reinterpret_cast<const char*>(pathOffsets.data()),
+              static_cast<std::streamsize>(pathOffsets.size() * sizeof(uint64_t)));
+    padTo(header.pathsOffset);
+    out.write(pathBlob.data(), static_cast<std::streamsize>(pathBlob.size()));
+
+    if (!out) {
+        throw std::runtime_error("Failed writing index file: " + path);
+    }
+}
+
+#define INSTANTIATE_SSTREE(Dim, Scalar) \
+    template class SSNode<Dim, Scalar>; \
+    template struct NodeArena<Dim, Scalar>; \
+    template class SSTree<Dim, Scalar>; \
+    template class NearestNeighborIterator<Dim, Scalar>;
+SSTREE_FOR_EACH_INSTANTIATION(INSTANTIATE_SSTREE)
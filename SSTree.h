@@ -6,70 +6,531 @@
 #include <algorithm>
 #include <numeric>
 #include <queue>
+#include <type_traits>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
 #include "Point.h"
 #include "Data.h"
+#include "DataStore.h"
+#include "Arena.h"
+#include "Epoch.h"
+#include "Quantizer.h"
+#include "Projection.h"
+#include "Metric.h"
+#include "Stats.h"
+#include "ThreadPool.h"
+#include "MappedSSTree.h"
 
+// Relative slack added when a radius is grown incrementally, to absorb rounding
+constexpr float ENVELOPE_TOLERANCE = 1e-5f;
+// Centroid drift, relative to the radius, after which the radius is recomputed exactly
+constexpr float MAX_CENTROID_DRIFT = 0.25f;
+// Fraction of maxPointsPerNode below which a node underflows after a removal
+constexpr float MIN_FILL_FACTOR = 0.4f;
+// Largest number of queries handed to a worker at once by knnBatch
+constexpr size_t KNN_BATCH_CHUNK = 16;
+// Candidates per requested neighbor kept by a quantized leaf scan for exact re-ranking
+constexpr size_t QUANTIZED_RERANK_FACTOR = 4;
+// Smallest number of points a parallel bulk load still splits into separate tasks
+constexpr size_t PARALLEL_BUILD_GRAIN = 4096;
+// Smallest group of points a parallel batched insert still spreads over tasks, one per child
+constexpr size_t PARALLEL_INSERT_GRAIN = 256;
+// Power iterations run by a SplitPolicy::PrincipalDirection split
+constexpr size_t SPLIT_POWER_ITERATIONS = 16;
+// Largest number of Lloyd iterations run by a SplitPolicy::TwoMeans split
+constexpr size_t SPLIT_KMEANS_ITERATIONS = 10;
+// Fraction of an overflowing node's entries evicted by forced reinsertion, as recommended for the R*-tree
+constexpr float DEFAULT_REINSERT_FRACTION = 0.3f;
+// Directions kept by projected routing unless told otherwise
+constexpr size_t DEFAULT_ROUTING_DIMENSIONS = 32;
+// Largest number of embeddings Routing::PrincipalComponents learns its directions from
+constexpr size_t ROUTING_SAMPLE_SIZE = 4096;
+// Subspace iterations run to learn Routing::PrincipalComponents directions
+constexpr size_t ROUTING_POWER_ITERATIONS = 8;
+// Seed of the random directions of projected routing
+constexpr uint32_t ROUTING_SEED = 42;
+// Relative slack taken off projected distances, whose directions rounding leaves only nearly orthonormal
+constexpr float PROJECTION_TOLERANCE = 1e-4f;
+
+// How an overflowing node divides its entries in two. TwoMeans and PrincipalDirection follow
+// clusters in the entries and cut unevenly when they are uneven, which leaves more, smaller nodes:
+// on clustered data PrincipalDirection lets exact kNN visit the fewest nodes, while on uniform
+// high-dimensional data, where kNN visits every node, both make the tree larger than AxisVariance
+enum class SplitPolicy {
+    // Minimum-variance cut along the coordinate axis of highest variance
+    AxisVariance,
+    // Two clusters found by k-means with k = 2, as in the SS+-tree
+    TwoMeans,
+    // Minimum-variance cut along the principal direction of the entries
+    PrincipalDirection
+};
+
+template <int Dim, typename Scalar>
+class SSTree;
+
+template <int Dim, typename Scalar>
+struct NodeArena;
+
+template <int Dim = static_cast<int>(DIM), typename Scalar = float>
 class SSNode {
+public:
+    using PointType = Point<Dim, Scalar>;
+    using DataType = Data<Dim, Scalar>;
+
+    // An entry for a node of height `height`: a data point (height 0) or a subtree
+    struct Entry {
+        const DataType* data;
+        SSNode* subtree;
+        size_t height;
+
+        const PointType& centroid() const { return data != nullptr ? data->getEmbedding() : subtree->centroid; }
+    };
+
+    // Forced reinsertion state of one SSTree::insert
+    struct Reinsertion {
+        // Fraction of an overflowing node's entries to evict
+        float fraction;
+        // evicted[h]: whether a node of height h already evicted entries during this insert
+        std::vector<bool> evicted;
+        // Entries waiting to be reinserted from the root
+        std::vector<Entry> pending;
+        // Node that evicted entries during the last descent (its ancestors need exact envelopes)
+        SSNode* evictedFrom = nullptr;
+    };
+
+private:
     size_t maxPointsPerNode;
-    Point centroid;
-    float radius;
+    PointType centroid;
+    Scalar radius;
     bool isLeaf;
 
-    SSNode* parent;
+    // Atomic so that a concurrent insert can follow it while a split moves the node
+    std::atomic<SSNode*> parent;
     std::vector<SSNode*> children;
-    std::vector<Data*> _data;
+    // Ids of the data points of a leaf, resolved through `arena->store`
+    std::vector<DataId> _data;
+
+    // Running sum of the entry centroids and centroid movement since the last exact radius
+    PointType entrySum;
+    Scalar drift;
+    // Centroid under the arena's routing projection (empty without projected routing)
+    std::vector<Scalar> routingCentroid;
+    // Union of the tag signatures of the entries
+    TagSignature tagSignature;
+
+    // Owner of the node and of its leaf block
+    NodeArena<Dim, Scalar>* arena;
+    // Leaf rows, one of `arena->rowBytes` bytes per entry in the same order as `_data`,
+    // holding the embeddings in the arena's LeafStorage format
+    unsigned char* leafBlock;
+    // Guards the entries, children and envelope of the node in concurrent mode
+    mutable std::shared_mutex latch;
 
     // For searching
-    SSNode* findClosestChild(const Point& target);
+    SSNode* findClosestChild(const PointType& target);
 
     // For insertion
     void updateBoundingEnvelope();
+    void updateRoutingCentroid();
+    Scalar recenter();
+    void expandBoundingEnvelope(Scalar shift, const PointType& entryCentroid, Scalar entryRadius,
+                                const TagSignature& entryTags);
+    void addEntry(const DataType* data);
+    void removeEntry(size_t index);
+    void indexEntries();
+    size_t entryCount() const { return isLeaf ? _data.size() : children.size(); }
+    const PointType& embeddingOf(DataId id) const { return arena->store->getEmbedding(id); }
+    TagList tagsOf(DataId id) const { return arena->store->getTags(id); }
     size_t directionOfMaxVariance();
-    std::pair<SSNode*, SSNode*> split();
+    std::pair<SSNode*, SSNode*> split(bool latched = false);
     size_t findSplitIndex(size_t coordinateIndex);
-    std::vector<Point> getEntriesCentroids() const;
-    size_t minVarianceSplit(const std::vector<float>& values);
+    size_t twoMeansSplit();
+    size_t principalDirectionSplit();
+    std::vector<Scalar> sortEntriesByKey(const std::vector<Scalar>& keys);
+    std::pair<SSNode*, SSNode*> insertEntry(SSNode* node, size_t height, const Entry& entry, Reinsertion* reinsertion);
+    std::pair<SSNode*, SSNode*> overflow(size_t height, Reinsertion* reinsertion);
+    void evictFarthest(size_t height, Reinsertion& reinsertion);
+    std::vector<PointType> getEntriesCentroids() const;
+    size_t minVarianceSplit(const std::vector<Scalar>& values);
+
+    // For leaf storage
+    void storeEmbedding(size_t row, const PointType& embedding);
+    void rebuildEmbeddings();
 
 public:
-    explicit SSNode(const Point& centroid, float radius=0.0f, bool isLeaf=true, SSNode* parent=nullptr , size_t M = 4)
-        : centroid(centroid), radius(radius), isLeaf(isLeaf), parent(parent) , maxPointsPerNode(M){}
+    explicit SSNode(const PointType& centroid, Scalar radius=0.0f, bool isLeaf=true, SSNode* parent=nullptr , size_t M = 4,
+                    NodeArena<Dim, Scalar>* arena = nullptr);
+    ~SSNode();
+
+    SSNode(const SSNode&) = delete;
+    SSNode& operator=(const SSNode&) = delete;
 
     // Checks if a point is inside the bounding sphere
-    bool intersectsPoint(const Point& point) const;
+    bool intersectsPoint(const PointType& point) const;
 
     // Getters
-    const Point& getCentroid() const { return centroid; }
-    float getRadius() const { return radius; }
+    const PointType& getCentroid() const { return centroid; }
+    Scalar getRadius() const { return radius; }
     const std::vector<SSNode*>& getChildren() const { return children; }
-    const std::vector<Data*>& getData () const { return    _data; }
+    const std::vector<DataId>& getData () const { return    _data; }
+    const PointType& getEntryEmbedding(size_t index) const { return embeddingOf(_data[index]); }
     bool getIsLeaf() const { return isLeaf; }
     SSNode* getParent() const { return parent; }
+    const Scalar* getEmbeddings() const { return reinterpret_cast<const Scalar*>(leafBlock); }
+    const unsigned char* getLeafBlock() const { return leafBlock; }
+    const Scalar* getRoutingCentroid() const { return routingCentroid.data(); }
+    const TagSignature& getTagSignature() const { return tagSignature; }
+    size_t getEmbeddingStride() const;
 
     // Insertion
-    SSNode* searchParentLeaf(SSNode* node, const Point& target);
-    std::pair<SSNode*, SSNode*> insert(SSNode*& node, Data* data);
+    SSNode* searchParentLeaf(SSNode* node, const PointType& target);
+    std::pair<SSNode*, SSNode*> insert(SSNode*& node, const DataType* data);
 
     // Search
-    SSNode* search(SSNode* node, Data* _data);
+    SSNode* search(SSNode* node, DataId id, QueryStats* stats = nullptr);
+
+    friend class SSTree<Dim, Scalar>;
+};
+
+/*
+ * NodeArena
+ * Owns every node of a tree and the contiguous embedding blocks of its leaves.
+ * Leaves resolve their ids through the tree's DataStore.
+ */
+
+template <int Dim, typename Scalar>
+struct NodeArena {
+    const DataStore<Dim, Scalar>* store;
+    ObjectPool<SSNode<Dim, Scalar>> nodes;
+    LeafStorage storage;
+    // Number of coordinates per embedding
+    size_t dimension;
+    // Bytes between consecutive rows of a leaf block (rows are cache-line aligned)
+    size_t rowBytes;
+    BlockPool leafBlocks;
+    // Scalars between consecutive embeddings of a LeafStorage::Float leaf block
+    size_t stride;
+    // Code ranges of a LeafStorage::Int8 tree
+    ScalarQuantizer quantizer;
+    SplitPolicy splitPolicy;
+    // Directions of projected routing (untrained: route on full centroids)
+    RoutingProjection<Scalar> projection;
+    // leafOf[id]: leaf holding the data point with that id (nullptr while it is not in the tree)
+    std::vector<SSNode<Dim, Scalar>*> leafOf;
+    // In concurrent mode, entries of `leafOf` are written under a shared lock and it grows under an exclusive one
+    std::shared_mutex leafIndexMutex;
+    // Serializes node allocation and release by the tasks of a parallel bulk load or batched insert
+    std::mutex mutex;
+
+    NodeArena(const DataStore<Dim, Scalar>* store, size_t maxPointsPerNode, size_t dimension,
+              LeafStorage storage = LeafStorage::Float, SplitPolicy splitPolicy = SplitPolicy::AxisVariance);
+};
+
+// Limits of an approximate kNN search; the defaults give an exact search
+struct KnnOptions {
+    // Leaves scanned before the search stops (0: no limit)
+    size_t maxLeaves = 0;
+    // Distances to entries computed before the search stops, checked before each leaf (0: no limit)
+    size_t maxDistanceEvaluations = 0;
+    // Nodes whose lower bound is above the k-th distance divided by 1 + epsilon are pruned
+    float epsilon = 0.0f;
+    // Consecutive leaves leaving the result unchanged after which the search stops (0: never)
+    size_t maxStableLeaves = 0;
+};
+
+// Why a kNN search stopped
+enum class KnnStop {
+    Completed,
+    LeafBudget,
+    DistanceBudget,
+    Stable
+};
 
-    friend class SSTree;
+// Effort spent by a kNN search and the quality it can vouch for
+struct KnnReport {
+    size_t nodesVisited = 0;
+    size_t leavesVisited = 0;
+    size_t distanceEvaluations = 0;
+    KnnStop stop = KnnStop::Completed;
+    // Upper bound on the returned k-th distance over the true one (1: the result is exact).
+    // Quantized leaves only rank their candidates approximately, which this bound ignores.
+    double errorBound = 1.0;
+    // Detailed counters, filled when compiled with SSTREE_STATS
+    QueryStats stats;
 };
 
+// Memory held by a tree, in bytes unless stated otherwise
+struct MemoryUsage {
+    size_t nodes = 0;
+    size_t leaves = 0;
+    size_t nodeBytes = 0;
+    // Leaf rows; in LeafStorage::Float they repeat the embeddings counted in dataBytes
+    size_t leafBlockBytes = 0;
+    size_t heapBytes = 0;
+    // Records (with their exact embeddings) and interned paths of the data store
+    size_t dataBytes = 0;
+
+    size_t totalBytes() const { return nodeBytes + leafBlockBytes + heapBytes + dataBytes; }
+};
+
+/*
+ * KnnContext
+ * Caller-owned state of kNN searches: the node queue, the candidate heap, distance buffers
+ * and the results of the last search. The buffers are sized for the whole tree on first
+ * use and kept across queries, so searching again with the same k allocates nothing.
+ * A context must not be shared between concurrent searches.
+ */
+
+template <int Dim = static_cast<int>(DIM), typename Scalar = float>
+class KnnContext {
+public:
+    // (distance, id)
+    using Neighbor = std::pair<Scalar, DataId>;
+
+    // Neighbors found by the last search, nearest first
+    const std::vector<Neighbor>& getResults() const { return results; }
+    // Effort and quality of the last search
+    const KnnReport& getReport() const { return report; }
+    // Query projected into the routing space by the last search (empty under full routing)
+    const std::vector<Scalar>& getProjectedQuery() const { return projectedQuery; }
+
+private:
+    std::vector<std::pair<const SSNode<Dim, Scalar>*, Scalar>> nodeQueue;
+    // Max-heap of (key, id), keys being squared distances under Metric::Euclidean
+    std::vector<Neighbor> candidates;
+    std::vector<const Scalar*> rows;
+    std::vector<Scalar> distances;
+    std::vector<float> encodedQuery;
+    std::vector<Scalar> projectedQuery;
+    // Filter of the current search and, per entry of the current leaf, whether it matches
+    TagMatcher matcher;
+    std::vector<char> entryMatches;
+    std::vector<Neighbor> results;
+    KnnReport report;
+
+    friend class SSTree<Dim, Scalar>;
+};
+
+/*
+ * NearestNeighborIterator
+ * Incremental nearest-neighbor search in the style of Hjaltason and Samet. One priority
+ * queue holds both nodes, keyed by the smallest distance their sphere allows, and data
+ * points, keyed by their distance. Popping a node pushes its children or entries, and
+ * popping a data point returns it, since nothing left in the queue can be nearer. Neighbors
+ * thus come out one at a time, nearest first, and asking for one more resumes where the
+ * last one stopped instead of searching again. The tree must not change while an iterator
+ * is in use.
+ */
+
+template <int Dim = static_cast<int>(DIM), typename Scalar = float>
+class NearestNeighborIterator {
+public:
+    using PointType = Point<Dim, Scalar>;
+    using NodeType = SSNode<Dim, Scalar>;
+    // (distance, id)
+    using Neighbor = std::pair<Scalar, DataId>;
+
+    NearestNeighborIterator(NearestNeighborIterator&&) = default;
+    NearestNeighborIterator& operator=(NearestNeighborIterator&&) = default;
+
+    bool next(Neighbor& neighbor);
+    // Effort spent so far
+    const KnnReport& getReport() const { return report; }
+
+private:
+    // A node to expand, or a data point (node == nullptr) to return
+    struct Item {
+        Scalar key;
+        const NodeType* node;
+        DataId id;
+
+        bool operator>(const Item& other) const { return key > other.key; }
+    };
+
+    const SSTree<Dim, Scalar>* tree;
+    PointType query;
+    Scalar queryNorm;
+    // Owned so that the matcher's pointer to it survives moves of the iterator
+    std::unique_ptr<SearchFilter> filter;
+    TagMatcher matcher;
+    // Min-heap on the key
+    std::vector<Item> queue;
+    std::vector<const Scalar*> rows;
+    std::vector<Scalar> scores;
+    KnnReport report;
+
+    NearestNeighborIterator(const SSTree<Dim, Scalar>* tree, const PointType& query, const SearchFilter& filter);
+    void push(Scalar key, const NodeType* node, DataId id);
+    template <Metric M>
+    void expand(const NodeType* node);
+
+    friend class SSTree<Dim, Scalar>;
+};
+
+template <int Dim = static_cast<int>(DIM), typename Scalar = float>
 class SSTree {
-    SSNode* root;
+public:
+    using PointType = Point<Dim, Scalar>;
+    using DataType = Data<Dim, Scalar>;
+    using NodeType = SSNode<Dim, Scalar>;
+    using ContextType = KnnContext<Dim, Scalar>;
+    using StoreType = DataStore<Dim, Scalar>;
+
+private:
+    NodeType* root;
     size_t maxPointsPerNode;
+    size_t minPointsPerNode;
+    LeafStorage leafStorage;
+    SplitPolicy splitPolicy;
+    // Fraction of entries evicted on the first overflow per level of an insert (0: split right away)
+    float reinsertFraction = 0.0f;
+    Routing routing = Routing::Full;
+    size_t routingDimensions = DEFAULT_ROUTING_DIMENSIONS;
+    Metric metric = Metric::Euclidean;
+    // Embeddings and paths of every point inserted, addressed by id; declared before the
+    // arena, whose leaves refer to it
+    StoreType store;
+    std::unique_ptr<NodeArena<Dim, Scalar>> arena;
+
+    // Internal thread pool used by knnBatch, parallel bulk loads and batched inserts, created on first use
+    mutable std::unique_ptr<ThreadPool> pool;
+    mutable std::mutex poolMutex;
+
+    // Whether insert and kNN searches may run from several threads at once (see setConcurrent)
+    bool concurrent = false;
+    // Guards `root` in concurrent mode; a root split swaps it under an exclusive lock
+    mutable std::shared_mutex rootLatch;
+    // Serializes the data store appends of concurrent inserts
+    std::mutex storeMutex;
+    // Serializes the splits of concurrent inserts: children lists, parent pointers and the root
+    // only change under it
+    std::mutex splitMutex;
+    // Concurrent searches and inserts stay in an epoch while they hold nodes
+    mutable EpochDomain epochs;
+    // Nodes replaced by concurrent splits, with the epoch they were unlinked in (guarded by splitMutex)
+    std::vector<std::pair<NodeType*, uint64_t>> retiredNodes;
+
+    void createArena(size_t dimension);
+    NodeType* createNode(const PointType& centroid, bool isLeaf, NodeType* parent);
+    void destroySubtree(NodeType* node);
+
+    uint64_t routingKey(const PointType& query) const;
+
+    // For insertion
+    void insertRecord(const DataType* data);
+    void insertEntry(const typename NodeType::Entry& entry, typename NodeType::Reinsertion* reinsertion);
+    void insertGroup(NodeType* node, typename std::vector<const DataType*>::iterator first,
+                     typename std::vector<const DataType*>::iterator last, std::vector<NodeType*>& replacements,
+                     ThreadPool* pool = nullptr);
+    void splitOverflowing(NodeType* node, std::vector<NodeType*>& parts);
+
+    // For concurrent inserts
+    void insertConcurrent(const DataType* data);
+    void insertSplitting(const DataType* data);
+    NodeType* latchLeaf(const PointType& target);
+    void widenAncestors(NodeType* node, DataId id);
+    void growLeafIndex(DataId id);
+    void reclaimNodes(bool all);
+    void refreshEnvelopes(NodeType* node);
+
+    // For bulk loading
+    NodeType* buildSubtree(typename std::vector<const DataType*>::iterator first,
+                           typename std::vector<const DataType*>::iterator last,
+                           size_t height, NodeType* parent, ThreadPool* pool = nullptr);
+    void trainQuantizer(const std::vector<const Scalar*>& rows, size_t dimension);
+    void trainRouting(const std::vector<const Scalar*>& rows, size_t dimension);
+
+    // Searches specialized for one metric
+    template <Metric M>
+    void knnSearch(const PointType& query, size_t k, ContextType& context, const KnnOptions& options,
+                   const SearchFilter& filter) const;
+    template <Metric M>
+    void rangeSearch(const PointType& query, Scalar range, const SearchFilter& filter,
+                     const std::function<bool(DataId, Scalar)>& visitor) const;
 
 public:
-    SSTree(size_t maxPointsPerNode) : maxPointsPerNode(maxPointsPerNode), root(nullptr) {}
+    SSTree(size_t maxPointsPerNode, LeafStorage leafStorage = LeafStorage::Float,
+           SplitPolicy splitPolicy = SplitPolicy::AxisVariance)
+        : root(nullptr),
+          maxPointsPerNode(maxPointsPerNode),
+          minPointsPerNode(std::max<size_t>(1, static_cast<size_t>(maxPointsPerNode * MIN_FILL_FACTOR))),
+          leafStorage(leafStorage),
+          splitPolicy(splitPolicy) {}
+    ~SSTree();
 
-    void insert(Data* _data);
-    SSNode* search(Data* _data);
+    SSTree(const SSTree&) = delete;
+    SSTree& operator=(const SSTree&) = delete;
 
-    SSNode * getRoot() const {
+    DataId insert(const PointType& embedding, std::string_view path = {}, const std::vector<Tag>& tags = {});
+    // Inserts many points at once, faster than one insert each
+    DataId insertBatch(const std::vector<PointType>& embeddings, const std::vector<std::string>& paths = {},
+                       const std::vector<std::vector<Tag>>& tags = {}, unsigned threads = 1);
+    void setReinsertFraction(float fraction);
+    void setRouting(Routing routing, size_t dimensions = DEFAULT_ROUTING_DIMENSIONS);
+    // Lets insert and the kNN searches run from several threads at once
+    void setConcurrent(bool enabled);
+    bool isConcurrent() const { return concurrent; }
+    // Metric of kNN and range searches (the tree itself does not depend on it)
+    void setMetric(Metric metric) { this->metric = metric; }
+    Metric getMetric() const { return metric; }
+    DataId bulkLoad(const std::vector<PointType>& embeddings, const std::vector<std::string>& paths = {},
+                    const std::vector<std::vector<Tag>>& tags = {}, unsigned threads = 1);
+    void trainQuantizer(const std::vector<PointType>& sample);
+    bool remove(DataId id);
+    NodeType* search(DataId id, QueryStats* stats = nullptr);
+
+    NodeType * getRoot() const {
         return root;
     };
 
-    std::vector<Data*> knn(const Point& query, size_t k) const;
+    // Data owned by the tree; ids stay valid (and keep their data) after being removed
+    const PointType& getEmbedding(DataId id) const;
+    std::string_view getPath(DataId id) const;
+    TagList getTags(DataId id) const;
+
+    std::vector<DataId> knn(const PointType& query, size_t k) const;
+    std::vector<DataId> knn(const PointType& query, size_t k, const KnnOptions& options,
+                            KnnReport* report = nullptr) const;
+    const std::vector<typename ContextType::Neighbor>& knn(const PointType& query, size_t k, ContextType& context,
+                                                           const KnnOptions& options = KnnOptions()) const;
+
+    // Filtered kNN: the k nearest data points among those matching the filter
+    std::vector<DataId> knn(const PointType& query, size_t k, const SearchFilter& filter,
+                            const KnnOptions& options = KnnOptions(), KnnReport* report = nullptr) const;
+    const std::vector<typename ContextType::Neighbor>& knn(const PointType& query, size_t k, ContextType& context,
+                                                           const SearchFilter& filter,
+                                                           const KnnOptions& options = KnnOptions()) const;
+    // Neighbors one at a time, nearest first, for as long as the caller keeps asking
+    NearestNeighborIterator<Dim, Scalar> nearest(const PointType& query, const SearchFilter& filter = SearchFilter()) const;
+
+    std::vector<std::vector<DataId>> knnBatch(const std::vector<PointType>& queries, size_t k,
+                                              unsigned threads = 0, const KnnOptions& options = KnnOptions(),
+                                              std::vector<KnnReport>* reports = nullptr) const;
+
+    // Range search; the visitor receives each match with its distance and returns false to stop
+    std::vector<DataId> rangeSearch(const PointType& query, Scalar range,
+                                    const SearchFilter& filter = SearchFilter()) const;
+    void forEachInRange(const PointType& query, Scalar range,
+                        const std::function<bool(DataId, Scalar)>& visitor) const;
+    void forEachInRange(const PointType& query, Scalar range, const SearchFilter& filter,
+                        const std::function<bool(DataId, Scalar)>& visitor) const;
+
+    MemoryUsage memoryUsage() const;
+    TreeStats treeStats() const;
+
+    // Persistence
+    void save(const std::string& path) const;
+    static MappedSSTree<Dim, Scalar> openMapped(const std::string& path) {
+        return MappedSSTree<Dim, Scalar>(path);
+    }
+
+    friend class NearestNeighborIterator<Dim, Scalar>;
 };
 
-#endif // SSTREE_H
\ No newline at end of file
+#endif // SSTREE_H
@@ -0,0 +1,72 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <cstddef>
+#include <vector>
+
+/*
+ * Instrumentation
+ * Per-query counters are only maintained when the library is compiled with SSTREE_STATS
+ * defined; otherwise SSTREE_STAT discards its statement and the counters stay at zero.
+ * The structs themselves always exist, so code built with and without the flag links together.
+ */
+
+#if defined(SSTREE_STATS)
+#define SSTREE_STAT(statement) statement
+constexpr bool STATS_ENABLED = true;
+#else
+#define SSTREE_STAT(statement)
+constexpr bool STATS_ENABLED = false;
+#endif
+
+// Work done by one knn or search call
+struct QueryStats {
+    // Nodes taken from the search queue (or visited, for search)
+    size_t nodesPopped = 0;
+    // Nodes discarded because their bounding sphere could not hold a better result
+    size_t nodesPruned = 0;
+    size_t leavesScanned = 0;
+    // Distances computed to node centroids and to leaf entries
+    size_t centroidDistances = 0;
+    size_t entryDistances = 0;
+};
+
+// Minimum, mean and maximum of a quantity over a set of nodes
+struct StatSummary {
+    size_t count = 0;
+    double min = 0.0;
+    double mean = 0.0;
+    double max = 0.0;
+
+    void add(double value) {
+        min = count == 0 ? value : (value < min ? value : min);
+        max = count == 0 ? value : (value > max ? value : max);
+        mean += (value - mean) / static_cast<double>(++count);
+    }
+};
+
+// Shape of one level of a tree (level 0 is the root)
+struct LevelStats {
+    size_t nodes = 0;
+    StatSummary radius;
+    // Pairs of sibling nodes on this level, and how many of them have intersecting spheres
+    size_t siblingPairs = 0;
+    size_t overlappingPairs = 0;
+    // Mean over sibling pairs of (r1 + r2 - distance) / (r1 + r2), counting disjoint pairs as 0
+    double meanOverlap = 0.0;
+};
+
+// Shape of a whole tree, gathered by SSTree::treeStats
+struct TreeStats {
+    size_t height = 0;
+    size_t nodes = 0;
+    size_t leaves = 0;
+    size_t entries = 0;
+    // fanOut[i]: internal nodes with i children
+    std::vector<size_t> fanOut;
+    // Entries per leaf over maxPointsPerNode
+    StatSummary leafFill;
+    std::vector<LevelStats> levels;
+};
+
+#endif // STATS_H
@@ -0,0 +1,188 @@
+#ifndef TAGS_H
+#define TAGS_H
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "Arena.h"
+#include "Data.h"
+
+// Attribute of a data point, such as a tenant or a category, encoded by the caller
+using Tag = uint32_t;
+
+// 64-bit words of a TagSignature
+constexpr size_t TAG_SIGNATURE_WORDS = 4;
+
+/*
+ * TagList
+ * Read-only view of the tags of one data point, sorted and without duplicates.
+ */
+
+struct TagList {
+    const Tag* first = nullptr;
+    const Tag* last = nullptr;
+
+    const Tag* begin() const { return first; }
+    const Tag* end() const { return last; }
+    size_t size() const { return static_cast<size_t>(last - first); }
+    bool empty() const { return first == last; }
+};
+
+/*
+ * TagSignature
+ * Bloom filter of a set of tags with a single hash function: every tag sets one of
+ * 64 * TAG_SIGNATURE_WORDS bits. The signature of a node is the union of the signatures
+ * of its entries, so two signatures without a common bit have no common tag, and a
+ * subtree whose signature misses every bit of a filter cannot hold a match.
+ */
+
+struct TagSignature {
+    std::array<uint64_t, TAG_SIGNATURE_WORDS> words{};
+
+    static size_t bitOf(Tag tag) {
+        // Fibonacci hashing
+        constexpr size_t bits = 64 * TAG_SIGNATURE_WORDS;
+        return static_cast<size_t>((static_cast<uint64_t>(tag) * 0x9E3779B97F4A7C15ull) >> 32) % bits;
+    }
+
+    static TagSignature of(TagList tags) {
+        TagSignature signature;
+        for (Tag tag : tags) {
+            signature.add(tag);
+        }
+        return signature;
+    }
+
+    void add(Tag tag) {
+        size_t bit = bitOf(tag);
+        words[bit / 64] |= uint64_t(1) << (bit % 64);
+    }
+
+    void merge(const TagSignature& other) {
+        for (size_t i = 0; i < TAG_SIGNATURE_WORDS; ++i) {
+            words[i] |= other.words[i];
+        }
+    }
+
+    bool intersects(const TagSignature& other) const {
+        for (size_t i = 0; i < TAG_SIGNATURE_WORDS; ++i) {
+            if ((words[i] & other.words[i]) != 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+/*
+ * TagArena
+ * Stores the tag lists of the data points back to back, addressed by id through an offset
+ * table, like the PathArena does for paths. Both live in AppendOnlyArrays, so lists may be
+ * read while another one is added.
+ */
+
+class TagArena {
+    AppendOnlyArray<Tag> tags;
+    // offsets[i] and offsets[i + 1] delimit the tags of data point i
+    AppendOnlyArray<uint64_t> offsets;
+    std::vector<Tag> scratch;
+
+public:
+    TagArena() { offsets.push_back(0); }
+
+    size_t add(const std::vector<Tag>& list) {
+        scratch.assign(list.begin(), list.end());
+        std::sort(scratch.begin(), scratch.end());
+        scratch.erase(std::unique(scratch.begin(), scratch.end()), scratch.end());
+        tags.append(scratch.data(), scratch.data() + scratch.size());
+        offsets.push_back(tags.size());
+        return offsets.size() - 2;
+    }
+
+    TagList get(size_t index) const {
+        const Tag* first = tags.data();
+        return {first + offsets[index], first + offsets[index + 1]};
+    }
+
+    void releaseRetired() {
+        tags.releaseRetired();
+        offsets.releaseRetired();
+    }
+
+    size_t getReservedBytes() const {
+        return tags.getReservedBytes() + offsets.getReservedBytes() + scratch.capacity() * sizeof(Tag);
+    }
+};
+
+/*
+ * SearchFilter
+ * Restricts a kNN or range search to part of the data. A data point matches when it
+ * carries one of `anyTag` (or `anyTag` is empty) and `predicate` accepts it (or is empty).
+ * The tags are pushed down into the traversal, which skips the subtrees whose signature
+ * rules them out; the predicate is only run on the entries whose tags match.
+ */
+
+struct SearchFilter {
+    std::vector<Tag> anyTag;
+    std::function<bool(DataId)> predicate;
+};
+
+/*
+ * TagMatcher
+ * A SearchFilter prepared for one search: its tags sorted and their signature. Resetting
+ * a matcher for the next search reuses its buffer.
+ */
+
+class TagMatcher {
+    const SearchFilter* filter = nullptr;
+    std::vector<Tag> tags;
+    TagSignature signature;
+
+public:
+    /**
+     * reset
+     * @param filter: Filter of the next search, or nullptr to match everything.
+     */
+
+    void reset(const SearchFilter* filter) {
+        bool restricts = filter != nullptr && (!filter->anyTag.empty() || filter->predicate);
+        this->filter = restricts ? filter : nullptr;
+        tags.clear();
+        signature = TagSignature();
+        if (restricts) {
+            tags.assign(filter->anyTag.begin(), filter->anyTag.end());
+            std::sort(tags.begin(), tags.end());
+            for (Tag tag : tags) {
+                signature.add(tag);
+            }
+        }
+    }
+
+    // Whether the filter can reject anything
+    bool isActive() const { return filter != nullptr; }
+
+    // Whether some data point summarized by the signature may match
+    bool mayMatch(const TagSignature& summary) const {
+        return tags.empty() || signature.intersects(summary);
+    }
+
+    bool matches(DataId id, TagList entryTags) const {
+        if (filter == nullptr) {
+            return true;
+        }
+        if (!tags.empty()) {
+            bool tagged = std::any_of(entryTags.begin(), entryTags.end(), [this](Tag tag) {
+                return std::binary_search(tags.begin(), tags.end(), tag);
+            });
+            if (!tagged) {
+                return false;
+            }
+        }
+        return !filter->predicate || filter->predicate(id);
+    }
+};
+
+#endif // TAGS_H
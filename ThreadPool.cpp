@@ -0,0 +1,189 @@
+#include "ThreadPool.h"
+
+namespace {
+// Pool and worker index of the calling thread, when it is a pool worker
+thread_local const ThreadPool* currentPool = nullptr;
+thread_local unsigned currentWorker = 0;
+}
+
+/**
+ * ThreadPool
+ * Starts the worker threads.
+ * @param threads: Number of workers (at least one is started).
+ */
+
+ThreadPool::ThreadPool(unsigned threads) {
+    if (threads == 0) threads = 1;
+
+    for (unsigned i = 0; i < threads; ++i) {
+        queues.push_back(std::make_unique<WorkQueue>());
+    }
+    for (unsigned i = 0; i < threads; ++i) {
+        workers.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+/**
+ * ~ThreadPool
+ * Lets the workers finish the queued tasks, then joins them.
+ */
+
+ThreadPool::~ThreadPool() {
+    wait();
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        stopping = true;
+    }
+    workAvailable.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+/**
+ * submit
+ * Queues a task. Tasks submitted from a worker go to that worker's own deque;
+ * others are spread round-robin over all deques.
+ * @param task: Task to run.
+ */
+
+void ThreadPool::submit(Task task) {
+    unsigned target = currentPool == this ? currentWorker : nextQueue.fetch_add(1) % size();
+    pending.fetch_add(1);
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        queued.fetch_add(1);
+    }
+    {
+        std::lock_guard<std::mutex> lock(queues[target]->mutex);
+        queues[target]->tasks.push_back(std::move(task));
+    }
+    workAvailable.notify_one();
+}
+
+/**
+ * submit
+ * Queues a task as part of a group.
+ * @param group: Group the task belongs to, until it finishes.
+ * @param task: Task to run.
+ */
+
+void ThreadPool::submit(TaskGroup& group, Task task) {
+    group.pending.fetch_add(1);
+    submit([this, &group, task = std::move(task)](unsigned worker) {
+        task(worker);
+        if (group.pending.fetch_sub(1) == 1) {
+            std::lock_guard<std::mutex> lock(stateMutex);
+            allDone.notify_all();
+        }
+    });
+}
+
+/**
+ * wait
+ * Blocks until every submitted task has finished. Must not be called from a worker.
+ */
+
+void ThreadPool::wait() {
+    std::unique_lock<std::mutex> lock(stateMutex);
+    allDone.wait(lock, [this] { return pending.load() == 0; });
+}
+
+/**
+ * wait
+ * Waits until every task of a group has finished. A worker runs other queued tasks
+ * meanwhile instead of blocking, so that tasks waiting for their subtasks cannot
+ * exhaust the pool.
+ * @param group: Group to wait for.
+ */
+
+void ThreadPool::wait(TaskGroup& group) {
+    if (currentPool == this) {
+        while (group.pending.load() > 0) {
+            Task task;
+            if (tryPop(currentWorker, task)) {
+                runTask(currentWorker, task);
+            } else {
+                std::this_thread::yield();
+            }
+        }
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(stateMutex);
+    allDone.wait(lock, [&group] { return group.pending.load() == 0; });
+}
+
+/**
+ * tryPop
+ * Takes the next task for a worker: the newest one from its own deque, otherwise
+ * the oldest one from another worker's deque.
+ * @param self: Index of the worker.
+ * @param task: Receives the task.
+ * @return bool: True if a task was found.
+ */
+
+bool ThreadPool::tryPop(unsigned self, Task& task) {
+    {
+        std::lock_guard<std::mutex> lock(queues[self]->mutex);
+        if (!queues[self]->tasks.empty()) {
+            task = std::move(queues[self]->tasks.back());
+            queues[self]->tasks.pop_back();
+            queued.fetch_sub(1);
+            return true;
+        }
+    }
+
+    for (unsigned offset = 1; offset < size(); ++offset) {
+        WorkQueue& victim = *queues[(self + offset) % size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            queued.fetch_sub(1);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * runTask
+ * Runs a task and signals wait() when it was the last one pending.
+ * @param self: Index of the worker.
+ * @param task: Task to run.
+ */
+
+void ThreadPool::runTask(unsigned self, Task& task) {
+    task(self);
+    if (pending.fetch_sub(1) == 1) {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        allDone.notify_all();
+    }
+}
+
+/**
+ * workerLoop
+ * Runs tasks until the pool is destroyed, sleeping while there is nothing to do.
+ * @param self: Index of the worker.
+ */
+
+void ThreadPool::workerLoop(unsigned self) {
+    currentPool = this;
+    currentWorker = self;
+
+    while (true) {
+        Task task;
+        if (tryPop(self, task)) {
+            runTask(self, task);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(stateMutex);
+        workAvailable.wait(lock, [this] { return stopping || queued.load() > 0; });
+        if (stopping && queued.load() == 0) {
+            return;
+        }
+    }
+}
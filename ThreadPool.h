@@ -0,0 +1,68 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * ThreadPool
+ * Fixed set of worker threads with one task deque each. A worker pops its own tasks
+ * from the back (most recently submitted first) and, when it runs dry, steals from the
+ * front of the other workers' deques. Tasks receive the index of the worker running
+ * them, so callers can keep per-worker scratch state.
+ * Tasks can be gathered in a TaskGroup and waited for as a unit; a worker waiting for a
+ * group keeps running queued tasks, so tasks may spawn subtasks and wait for them.
+ */
+
+class TaskGroup {
+    std::atomic<size_t> pending{0};
+
+    friend class ThreadPool;
+};
+
+class ThreadPool {
+public:
+    using Task = std::function<void(unsigned worker)>;
+
+    explicit ThreadPool(unsigned threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void submit(Task task);
+    void submit(TaskGroup& group, Task task);
+    void wait();
+    void wait(TaskGroup& group);
+
+    unsigned size() const { return static_cast<unsigned>(queues.size()); }
+
+private:
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    std::vector<std::thread> workers;
+
+    std::mutex stateMutex;
+    std::condition_variable workAvailable;
+    std::condition_variable allDone;
+    std::atomic<size_t> queued{0};
+    std::atomic<size_t> pending{0};
+    std::atomic<unsigned> nextQueue{0};
+    bool stopping = false;
+
+    bool tryPop(unsigned self, Task& task);
+    void runTask(unsigned self, Task& task);
+    void workerLoop(unsigned self);
+};
+
+#endif // THREADPOOL_H
@@ -0,0 +1,380 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <string>
+#include "Point.h"
+#include "Data.h"
+#include "SSTree.h"
+#include "Dataset.h"
+
+/*
+ * Benchmark suite
+ * Measures, on a synthetic or loaded dataset, the build time and memory of a tree, single
+ * query latency and recall for several k, and knnBatch throughput, and prints the results
+ * as JSON. Progress goes to stderr so that stdout can be redirected to a file.
+ *
+ * Usage: bench [--data clustered|uniform|FILE.fvecs|FILE.npy] [--queries FILE] [--points N]
+ *              [--num-queries N] [--dimension D] [--clusters N] [--k 1,10,100] [--threads N]
+ *              [--build bulk|insert|sorted-insert|batch-insert|concurrent-insert] [--batch-size N]
+ *              [--build-threads N]
+ *              [--split-policy axis|2means|principal] [--reinsert FRACTION] [--node-size M]
+ *              [--routing full|random|pca] [--routing-dims N] [--metric l2|sql2|cosine|ip]
+ *              [--leaf-storage float|int8|fp16] [--epsilon E] [--max-leaves N] [--seed S] [--json FILE]
+ * The split policy and forced reinsertion only matter for trees built by insertion;
+ * sorted-insert inserts the points in order of their first coordinate, and batch-insert passes
+ * them to insertBatch in batches (the first one into the empty tree is bulk loaded). concurrent-insert
+ * inserts them one at a time from --build-threads threads in concurrent mode. With the cosine metric,
+ * the dataset and the queries are normalized before anything else.
+ */
+
+struct BenchmarkConfig {
+    std::string source = "clustered";
+    std::string queryPath;
+    size_t points = 20000;
+    size_t queries = 512;
+    size_t dimension = 768;
+    size_t clusters = 50;
+    std::vector<size_t> ks{1, 10, 100};
+    unsigned maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    std::string build = "bulk";
+    unsigned buildThreads = 1;
+    size_t batchSize = 1000;
+    std::string splitPolicy = "axis";
+    float reinsertFraction = 0.0f;
+    std::string routing = "full";
+    size_t routingDimensions = DEFAULT_ROUTING_DIMENSIONS;
+    std::string metric = "l2";
+    size_t maxPointsPerNode = 20;
+    std::string leafStorage = "float";
+    KnnOptions options;
+    unsigned seed = 42;
+    std::string jsonPath;
+};
+
+/*
+ * Helper functions
+ */
+
+template <typename Function>
+double secondsFor(Function&& function) {
+    auto start = std::chrono::high_resolution_clock::now();
+    function();
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double>(end - start).count();
+}
+
+double percentile(std::vector<double> values, double fraction) {
+    size_t index = std::min(values.size() - 1, static_cast<size_t>(fraction * values.size()));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+std::string jsonString(const std::string& text) {
+    std::string quoted = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+        }
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+SplitPolicy parseSplitPolicy(const std::string& name) {
+    if (name == "axis") return SplitPolicy::AxisVariance;
+    if (name == "2means") return SplitPolicy::TwoMeans;
+    if (name == "principal") return SplitPolicy::PrincipalDirection;
+    throw std::invalid_argument("Unknown split policy: " + name);
+}
+
+Routing parseRouting(const std::string& name) {
+    if (name == "full") return Routing::Full;
+    if (name == "random") return Routing::RandomProjection;
+    if (name == "pca") return Routing::PrincipalComponents;
+    throw std::invalid_argument("Unknown routing: " + name);
+}
+
+Metric parseMetric(const std::string& name) {
+    if (name == "l2") return Metric::Euclidean;
+    if (name == "sql2") return Metric::SquaredEuclidean;
+    if (name == "cosine") return Metric::Cosine;
+    if (name == "ip") return Metric::InnerProduct;
+    throw std::invalid_argument("Unknown metric: " + name);
+}
+
+LeafStorage parseLeafStorage(const std::string& name) {
+    if (name == "float") return LeafStorage::Float;
+    if (name == "int8") return LeafStorage::Int8;
+    if (name == "fp16") return LeafStorage::Float16;
+    throw std::invalid_argument("Unknown leaf storage: " + name);
+}
+
+BenchmarkConfig parseArguments(int argc, char** argv) {
+    BenchmarkConfig config;
+    for (int i = 1; i < argc; i += 2) {
+        std::string flag = argv[i];
+        if (i + 1 >= argc) {
+            throw std::invalid_argument("Missing value for " + flag);
+        }
+        std::string value = argv[i + 1];
+
+        if (flag == "--data") config.source = value;
+        else if (flag == "--queries") config.queryPath = value;
+        else if (flag == "--points") config.points = std::stoull(value);
+        else if (flag == "--num-queries") config.queries = std::stoull(value);
+        else if (flag == "--dimension") config.dimension = std::stoull(value);
+        else if (flag == "--clusters") config.clusters = std::stoull(value);
+        else if (flag == "--threads") config.maxThreads = static_cast<unsigned>(std::stoul(value));
+        else if (flag == "--build") config.build = value;
+        else if (flag == "--split-policy") config.splitPolicy = value;
+        else if (flag == "--reinsert") config.reinsertFraction = std::stof(value);
+        else if (flag == "--routing") config.routing = value;
+        else if (flag == "--routing-dims") config.routingDimensions = std::stoull(value);
+        else if (flag == "--metric") config.metric = value;
+        else if (flag == "--build-threads") config.buildThreads = static_cast<unsigned>(std::stoul(value));
+        else if (flag == "--batch-size") config.batchSize = std::stoull(value);
+        else if (flag == "--node-size") config.maxPointsPerNode = std::stoull(value);
+        else if (flag == "--leaf-storage") config.leafStorage = value;
+        else if (flag == "--epsilon") config.options.epsilon = std::stof(value);
+        else if (flag == "--max-leaves") config.options.maxLeaves = std::stoull(value);
+        else if (flag == "--seed") config.seed = static_cast<unsigned>(std::stoul(value));
+        else if (flag == "--json") config.jsonPath = value;
+        else if (flag == "--k") {
+            config.ks.clear();
+            std::stringstream list(value);
+            for (std::string item; std::getline(list, item, ',');) {
+                config.ks.push_back(std::stoull(item));
+            }
+        } else {
+            throw std::invalid_argument("Unknown option: " + flag);
+        }
+    }
+    if (config.ks.empty() || config.queries == 0) {
+        throw std::invalid_argument("At least one k and one query are needed");
+    }
+    if (config.build != "bulk" && config.build != "insert" && config.build != "sorted-insert"
+        && config.build != "batch-insert" && config.build != "concurrent-insert") {
+        throw std::invalid_argument("Unknown build method: " + config.build);
+    }
+    if (config.batchSize == 0) {
+        throw std::invalid_argument("The batch size must be positive");
+    }
+    return config;
+}
+
+// Indices of the `k` nearest rows of `base` to each query under a metric, by exhaustive scan
+std::vector<std::vector<size_t>> bruteForceNeighbors(const Dataset& base, const Dataset& queries, size_t k,
+                                                     Metric metric) {
+    std::vector<std::vector<size_t>> neighbors(queries.size());
+    std::vector<std::pair<float, size_t>> distances(base.size());
+    k = std::min(k, base.size());
+
+    for (size_t q = 0; q < queries.size(); ++q) {
+        for (size_t i = 0; i < base.size(); ++i) {
+            float key = metric == Metric::Euclidean || metric == Metric::SquaredEuclidean
+                            ? squaredDistance(queries.row(q), base.row(i), base.dimension)
+                            : -dotProduct(queries.row(q), base.row(i), base.dimension);
+            distances[i] = {key, i};
+        }
+        std::partial_sort(distances.begin(), distances.begin() + k, distances.end());
+        for (size_t i = 0; i < k; ++i) {
+            neighbors[q].push_back(distances[i].second);
+        }
+    }
+    return neighbors;
+}
+
+/*
+ * Benchmarks
+ */
+
+template <int Dim>
+void runBenchmark(const BenchmarkConfig& config, const Dataset& base, const Dataset& queryRows, std::ostream& json) {
+    using PointType = Point<Dim, float>;
+
+    auto toPoint = [&base](const float* row) {
+        return PointType(Eigen::Map<const Eigen::Matrix<float, Dim, 1>>(row, base.dimension));
+    };
+
+    std::vector<PointType> embeddings;
+    std::vector<std::string> paths;
+    embeddings.reserve(base.size());
+    for (size_t i = 0; i < base.size(); ++i) {
+        embeddings.push_back(toPoint(base.row(i)));
+        paths.push_back("item_" + std::to_string(i));
+    }
+    std::vector<PointType> queries;
+    for (size_t q = 0; q < queryRows.size(); ++q) {
+        queries.push_back(toPoint(queryRows.row(q)));
+    }
+
+    size_t maxK = *std::max_element(config.ks.begin(), config.ks.end());
+    std::cerr << "Computing exact neighbors of " << queries.size() << " queries..." << std::endl;
+    auto truth = bruteForceNeighbors(base, queryRows, maxK, parseMetric(config.metric));
+
+    std::cerr << "Building the tree..." << std::endl;
+    SSTree<Dim, float> tree(config.maxPointsPerNode, parseLeafStorage(config.leafStorage),
+                            parseSplitPolicy(config.splitPolicy));
+    tree.setReinsertFraction(config.reinsertFraction);
+    tree.setRouting(parseRouting(config.routing), config.routingDimensions);
+    tree.setMetric(parseMetric(config.metric));
+    // insertOrder[id]: row of the base dataset the tree gave that id
+    std::vector<size_t> insertOrder(base.size());
+    std::iota(insertOrder.begin(), insertOrder.end(), size_t(0));
+    if (config.build == "sorted-insert") {
+        std::sort(insertOrder.begin(), insertOrder.end(), [&embeddings](size_t a, size_t b) {
+            return embeddings[a][0] < embeddings[b][0];
+        });
+    }
+    double buildSeconds = secondsFor([&] {
+        if (config.build == "bulk") {
+            tree.bulkLoad(embeddings, paths, {}, config.buildThreads);
+        } else if (config.build == "batch-insert") {
+            for (size_t first = 0; first < embeddings.size(); first += config.batchSize) {
+                size_t last = std::min(first + config.batchSize, embeddings.size());
+                tree.insertBatch(std::vector<PointType>(embeddings.begin() + first, embeddings.begin() + last),
+                                 std::vector<std::string>(paths.begin() + first, paths.begin() + last), {},
+                                 config.buildThreads);
+            }
+        } else if (config.build == "concurrent-insert") {
+            tree.trainQuantizer(embeddings);
+            tree.setConcurrent(true);
+            std::atomic<size_t> next{0};
+            std::vector<std::thread> writers;
+            for (unsigned t = 0; t < config.buildThreads; ++t) {
+                writers.emplace_back([&]() {
+                    for (size_t row = next++; row < embeddings.size(); row = next++) {
+                        tree.insert(embeddings[row], paths[row]);
+                    }
+                });
+            }
+            for (auto& writer : writers) {
+                writer.join();
+            }
+            tree.setConcurrent(false);
+        } else {
+            tree.trainQuantizer(embeddings);
+            for (size_t row : insertOrder) {
+                tree.insert(embeddings[row], paths[row]);
+            }
+        }
+    });
+    if (config.build == "concurrent-insert") {
+        // Ids follow the order in which the writers got to the rows, which the paths record
+        for (size_t id = 0; id < base.size(); ++id) {
+            insertOrder[id] = std::stoull(std::string(tree.getPath(static_cast<DataId>(id)).substr(5)));
+        }
+    }
+    MemoryUsage usage = tree.memoryUsage();
+
+    json << "{\n";
+    json << "  \"dataset\": {\"source\": " << jsonString(config.source) << ", \"points\": " << base.size()
+         << ", \"queries\": " << queries.size() << ", \"dimension\": " << base.dimension << "},\n";
+    json << "  \"config\": {\"build\": \"" << config.build << "\", \"batchSize\": " << config.batchSize
+         << ", \"splitPolicy\": \"" << config.splitPolicy
+         << "\", \"reinsertFraction\": " << config.reinsertFraction << ", \"routing\": \"" << config.routing
+         << "\", \"routingDimensions\": " << config.routingDimensions << ", \"metric\": \"" << config.metric
+         << "\", \"maxPointsPerNode\": " << config.maxPointsPerNode << ", \"leafStorage\": \""
+         << config.leafStorage << "\", \"epsilon\": " << config.options.epsilon
+         << ", \"maxLeaves\": " << config.options.maxLeaves << "},\n";
+    json << "  \"build\": {\"threads\": " << config.buildThreads << ", \"seconds\": " << buildSeconds << ", \"memoryBytes\": " << usage.totalBytes()
+         << ", \"nodes\": " << usage.nodes << ", \"leaves\": " << usage.leaves << "},\n";
+
+    std::cerr << "Measuring single-query latency..." << std::endl;
+    json << "  \"knn\": [";
+    for (size_t ki = 0; ki < config.ks.size(); ++ki) {
+        size_t k = config.ks[ki];
+        std::vector<double> latencies;
+        size_t found = 0;
+        size_t expected = 0;
+        size_t nodesVisited = 0;
+        size_t leavesVisited = 0;
+
+        KnnContext<Dim, float> context;
+        for (size_t q = 0; q < queries.size(); ++q) {
+            latencies.push_back(secondsFor([&] { tree.knn(queries[q], k, context, config.options); }) * 1e6);
+            nodesVisited += context.getReport().nodesVisited;
+            leavesVisited += context.getReport().leavesVisited;
+
+            size_t relevant = std::min(k, truth[q].size());
+            std::vector<size_t> ids;
+            for (const auto& [distance, neighbor] : context.getResults()) {
+                ids.push_back(insertOrder[neighbor]);
+            }
+            for (size_t i = 0; i < relevant; ++i) {
+                found += std::find(ids.begin(), ids.end(), truth[q][i]) != ids.end();
+            }
+            expected += relevant;
+        }
+
+        double mean = std::accumulate(latencies.begin(), latencies.end(), 0.0) / latencies.size();
+        json << (ki == 0 ? "\n" : ",\n") << "    {\"k\": " << k << ", \"p50Us\": " << percentile(latencies, 0.5)
+             << ", \"p99Us\": " << percentile(latencies, 0.99) << ", \"meanUs\": " << mean
+             << ", \"recall\": " << static_cast<double>(found) / std::max<size_t>(1, expected)
+             << ", \"meanNodesVisited\": " << static_cast<double>(nodesVisited) / queries.size()
+             << ", \"meanLeavesVisited\": " << static_cast<double>(leavesVisited) / queries.size() << "}";
+    }
+    json << "\n  ],\n";
+
+    size_t batchK = std::find(config.ks.begin(), config.ks.end(), 10) != config.ks.end() ? 10 : config.ks.front();
+    std::cerr << "Measuring batch throughput..." << std::endl;
+    json << "  \"throughput\": [";
+    for (unsigned threads = 1; threads <= config.maxThreads; threads *= 2) {
+        tree.knnBatch(queries, batchK, threads, config.options);  // warm up the pool
+        double batchSeconds = secondsFor([&] { tree.knnBatch(queries, batchK, threads, config.options); });
+        json << (threads == 1 ? "\n" : ",\n") << "    {\"threads\": " << threads << ", \"k\": " << batchK
+             << ", \"queriesPerSecond\": " << queries.size() / batchSeconds << "}";
+    }
+    json << "\n  ]\n}\n";
+}
+
+int main(int argc, char** argv) {
+    try {
+        BenchmarkConfig config = parseArguments(argc, argv);
+        std::mt19937 gen(config.seed);
+
+        Dataset base;
+        if (config.source == "clustered") {
+            base = generateClustered(config.points + config.queries, config.dimension, config.clusters, 0.05f, gen);
+        } else if (config.source == "uniform") {
+            base = generateUniform(config.points + config.queries, config.dimension, gen);
+        } else {
+            base = loadDataset(config.source, config.queryPath.empty() ? config.points + config.queries : config.points);
+        }
+
+        Dataset queries = config.queryPath.empty() ? splitQueries(base, config.queries)
+                                                   : loadDataset(config.queryPath, config.queries);
+        if (base.size() == 0 || queries.size() == 0 || queries.dimension != base.dimension) {
+            throw std::runtime_error("The dataset and the queries must be non-empty and of the same dimension");
+        }
+        if (parseMetric(config.metric) == Metric::Cosine) {
+            normalizeRows(base);
+            normalizeRows(queries);
+        }
+
+        std::ostringstream json;
+        switch (base.dimension) {
+            case 128: runBenchmark<128>(config, base, queries, json); break;
+            case 384: runBenchmark<384>(config, base, queries, json); break;
+            case 768: runBenchmark<768>(config, base, queries, json); break;
+            case 1024: runBenchmark<1024>(config, base, queries, json); break;
+            default: runBenchmark<Eigen::Dynamic>(config, base, queries, json); break;
+        }
+
+        if (config.jsonPath.empty()) {
+            std::cout << json.str();
+        } else {
+            std::ofstream(config.jsonPath) << json.str();
+            std::cerr << "Results written to " << config.jsonPath << std::endl;
+        }
+    } catch (const std::exception& error) {
+        std::cerr << "bench: " << error.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -5,27 +5,112 @@
 #include "Point.h"
 #include "Data.h"
 #include "SSTree.h"
+#include "Dataset.h"
 #include <chrono> 
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <cstring>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
 
 constexpr size_t NUM_POINTS = 10000;
 constexpr size_t MAX_POINTS_PER_NODE = 20;
+constexpr size_t RUNTIME_DIM = 100;
+constexpr double MIN_QUANTIZED_RECALL = 0.95;
 
 /*
  * Helper functions
  */
 
-std::vector<Data*> generateRandomData(size_t numPoints) {
-    std::vector<Data*> data;
+// Heap allocations made through the global operator new, to check allocation-free paths
+std::atomic<size_t> allocationCount{0};
+
+// Behind every replaced form of operator new and delete, plain, array and over-aligned (as Eigen's
+// fixed-size types need). Kept out of line, so that the compiler does not pair an inlined free with
+// the operator new it came from
+[[gnu::noinline]] void* countedAllocate(std::size_t size, std::size_t alignment) {
+    ++allocationCount;
+    size = size == 0 ? 1 : size;
+    void* memory = alignment <= alignof(std::max_align_t)
+                       ? std::malloc(size)
+                       : std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+    if (memory == nullptr) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+[[gnu::noinline]] void countedRelease(void* memory) noexcept { std::free(memory); }
+
+void* operator new(std::size_t size) { return countedAllocate(size, 0); }
+void* operator new[](std::size_t size) { return countedAllocate(size, 0); }
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    return countedAllocate(size, static_cast<std::size_t>(alignment));
+}
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+    return countedAllocate(size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void* memory) noexcept { countedRelease(memory); }
+void operator delete(void* memory, std::size_t) noexcept { countedRelease(memory); }
+void operator delete[](void* memory) noexcept { countedRelease(memory); }
+void operator delete[](void* memory, std::size_t) noexcept { countedRelease(memory); }
+void operator delete(void* memory, std::align_val_t) noexcept { countedRelease(memory); }
+void operator delete(void* memory, std::size_t, std::align_val_t) noexcept { countedRelease(memory); }
+void operator delete[](void* memory, std::align_val_t) noexcept { countedRelease(memory); }
+void operator delete[](void* memory, std::size_t, std::align_val_t) noexcept { countedRelease(memory); }
+
+template <int Dim = static_cast<int>(DIM), typename Scalar = float>
+std::vector<Point<Dim, Scalar>> generateRandomData(size_t numPoints,
+                                                   size_t dimension = Point<Dim, Scalar>::defaultDimension) {
+    std::vector<Point<Dim, Scalar>> data;
     for (size_t i = 0; i < numPoints; ++i) {
-        Point embedding = Point::random();
-        std::string imagePath = "eda_" + std::to_string(i) + ".jpg";
-        Data* dataPoint = new Data(embedding, imagePath);
-        data.push_back(dataPoint);
+        data.push_back(Point<Dim, Scalar>::random(0, 1, dimension));
     }
     return data;
 }
 
-void collectDataDFS(SSNode* node, std::unordered_set<Data*>& treeData) {
+// Points scattered around random cluster centers (see generateClustered), with a fixed seed
+template <int Dim = static_cast<int>(DIM), typename Scalar = float>
+std::vector<Point<Dim, Scalar>> generateClusteredData(size_t numPoints, size_t clusters,
+                                                      size_t dimension = Point<Dim, Scalar>::defaultDimension) {
+    std::mt19937 gen(42);
+    Dataset dataset = generateClustered(numPoints, dimension, clusters, 0.05f, gen);
+    std::vector<Point<Dim, Scalar>> data;
+    for (size_t i = 0; i < numPoints; ++i) {
+        data.emplace_back(Eigen::Map<const Eigen::VectorXf>(dataset.row(i), dimension).template cast<Scalar>().eval());
+    }
+    return data;
+}
+
+std::string imagePath(size_t index) {
+    return "eda_" + std::to_string(index) + ".jpg";
+}
+
+// Inserts the points one by one; a fresh tree gives them the ids 0, 1, 2...
+template <int Dim, typename Scalar>
+std::vector<DataId> insertAll(SSTree<Dim, Scalar>& tree, const std::vector<Point<Dim, Scalar>>& data) {
+    std::vector<DataId> ids;
+    for (size_t i = 0; i < data.size(); ++i) {
+        ids.push_back(tree.insert(data[i], imagePath(i)));
+    }
+    return ids;
+}
+
+std::vector<DataId> firstIds(size_t count) {
+    std::vector<DataId> ids(count);
+    std::iota(ids.begin(), ids.end(), DataId(0));
+    return ids;
+}
+
+template <int Dim, typename Scalar>
+void collectDataDFS(SSNode<Dim, Scalar>* node, std::unordered_set<DataId>& treeData) {
     if (node->getIsLeaf()) {
         for (const auto& d : node->getData()) {
             treeData.insert(d);
@@ -42,9 +127,10 @@ void collectDataDFS(SSNode* node, std::unordered_set<Data*>& treeData) {
  */
 
 // Test 1: Check if all data is present in the tree
-bool allDataPresent(const SSTree& tree, const std::vector<Data*>& data) {
-    std::unordered_set<Data*> dataSet(data.begin(), data.end());
-    std::unordered_set<Data*> treeData;
+template <int Dim, typename Scalar>
+bool allDataPresent(const SSTree<Dim, Scalar>& tree, const std::vector<DataId>& data) {
+    std::unordered_set<DataId> dataSet(data.begin(), data.end());
+    std::unordered_set<DataId> treeData;
 
     collectDataDFS(tree.getRoot(), treeData);
     for (const auto& d : dataSet) {
@@ -61,7 +147,8 @@ bool allDataPresent(const SSTree& tree, const std::vector<Data*>& data) {
 }
 
 // Test 2: Check if all leaves are at the same level
-bool leavesAtSameLevelDFS(SSNode* node, int level, int& leafLevel) {
+template <int Dim, typename Scalar>
+bool leavesAtSameLevelDFS(SSNode<Dim, Scalar>* node, int level, int& leafLevel) {
     if (node->getIsLeaf()) {
         if (leafLevel == -1) leafLevel = level;
         return leafLevel == level;
@@ -72,13 +159,15 @@ bool leavesAtSameLevelDFS(SSNode* node, int level, int& leafLevel) {
     return true;
 }
 
-bool leavesAtSameLevel(SSNode* root) {
+template <int Dim, typename Scalar>
+bool leavesAtSameLevel(SSNode<Dim, Scalar>* root) {
     int leafLevel = -1;
     return leavesAtSameLevelDFS(root, 0, leafLevel);
 }
 
 // Test 3: Check if no node exceeds the maximum number of children
-bool noNodeExceedsMaxChildrenDFS(SSNode* node, size_t maxPointsPerNode) {
+template <int Dim, typename Scalar>
+bool noNodeExceedsMaxChildrenDFS(SSNode<Dim, Scalar>* node, size_t maxPointsPerNode) {
     if (node->getChildren().size() > maxPointsPerNode) return false;
     for (const auto& child : node->getChildren()) {
         if (!noNodeExceedsMaxChildrenDFS(child, maxPointsPerNode)) return false;
@@ -86,22 +175,25 @@ bool noNodeExceedsMaxChildrenDFS(SSNode* node, size_t maxPointsPerNode) {
     return true;
 }
 
-bool noNodeExceedsMaxChildren(SSNode* root, size_t maxPointsPerNode) {
+template <int Dim, typename Scalar>
+bool noNodeExceedsMaxChildren(SSNode<Dim, Scalar>* root, size_t maxPointsPerNode) {
     return noNodeExceedsMaxChildrenDFS(root, maxPointsPerNode);
 }
 
 // Test 4: Check if all points are inside the bounding sphere of their respective nodes
-bool sphereCoversAllPointsDFS(SSNode* node) {
+template <int Dim, typename Scalar>
+bool sphereCoversAllPointsDFS(SSNode<Dim, Scalar>* node) {
     if (!node->getIsLeaf()) return true;
-    const Point& centroid = node->getCentroid();
-    float radius = node->getRadius();
-    for (const auto& data : node->getData()) {
-        if (Point::distance(centroid, data->getEmbedding()) > radius) return false;
+    const Point<Dim, Scalar>& centroid = node->getCentroid();
+    Scalar radius = node->getRadius();
+    for (size_t i = 0; i < node->getData().size(); ++i) {
+        if (Point<Dim, Scalar>::distance(centroid, node->getEntryEmbedding(i)) > radius) return false;
     }
     return true;
 }
 
-bool dfsSphereCoversAllPoints(SSNode* node) {
+template <int Dim, typename Scalar>
+bool dfsSphereCoversAllPoints(SSNode<Dim, Scalar>* node) {
     if (node->getIsLeaf()) {
         return sphereCoversAllPointsDFS(node);
     } else {
@@ -112,24 +204,27 @@ bool dfsSphereCoversAllPoints(SSNode* node) {
     return true;
 }
 
-bool sphereCoversAllPoints(SSNode* root) {
+template <int Dim, typename Scalar>
+bool sphereCoversAllPoints(SSNode<Dim, Scalar>* root) {
     return dfsSphereCoversAllPoints(root);
 }
 
 // Test 5: Check if all children are inside the bounding sphere of their parent node
-bool sphereCoversAllChildrenSpheresDFS(SSNode* node) {
+template <int Dim, typename Scalar>
+bool sphereCoversAllChildrenSpheresDFS(SSNode<Dim, Scalar>* node) {
     if (node->getIsLeaf()) return true;
-    const Point& centroid = node->getCentroid();
-    float radius = node->getRadius();
+    const Point<Dim, Scalar>& centroid = node->getCentroid();
+    Scalar radius = node->getRadius();
     for (const auto& child : node->getChildren()) {
-        const Point& childCentroid = child->getCentroid();
-        float childRadius = child->getRadius();
-        if (Point::distance(centroid, childCentroid) + childRadius > radius) return false;
+        const Point<Dim, Scalar>& childCentroid = child->getCentroid();
+        Scalar childRadius = child->getRadius();
+        if (Point<Dim, Scalar>::distance(centroid, childCentroid) + childRadius > radius) return false;
     }
     return true;
 }
 
-bool dfsSphereCoversAllChildrenSpheres(SSNode* node) {
+template <int Dim, typename Scalar>
+bool dfsSphereCoversAllChildrenSpheres(SSNode<Dim, Scalar>* node) {
     if (!sphereCoversAllChildrenSpheresDFS(node)) return false;
     for (const auto& child : node->getChildren()) {
         if (!dfsSphereCoversAllChildrenSpheres(child)) return false;
@@ -137,17 +232,19 @@ bool dfsSphereCoversAllChildrenSpheres(SSNode* node) {
     return true;
 }
 
-bool sphereCoversAllChildrenSpheres(SSNode* root) {
+template <int Dim, typename Scalar>
+bool sphereCoversAllChildrenSpheres(SSNode<Dim, Scalar>* root) {
     return dfsSphereCoversAllChildrenSpheres(root);
 }
 
 // Test 6: Verify KNN search consistency by comparing tree results with manually sorted neighbors.
-bool correctKnnSearch(const SSTree &tree, std::vector<Data *> &data) {
-    Point query = Point::random();
+template <int Dim, typename Scalar>
+bool correctKnnSearch(const SSTree<Dim, Scalar> &tree, std::vector<DataId> data) {
+    Point<Dim, Scalar> query = Point<Dim, Scalar>::random(0, 1, tree.getEmbedding(data.front()).size());
     size_t k = 1;
     auto resultUsingTree = tree.knn(query, k);
-    std::sort(data.begin(), data.end(), [&query](Data *a, Data *b) {
-        return a->getEmbedding().distance(query) < b->getEmbedding().distance(query);
+    std::sort(data.begin(), data.end(), [&tree, &query](DataId a, DataId b) {
+        return tree.getEmbedding(a).distance(query) < tree.getEmbedding(b).distance(query);
     });
     data.resize(k);
     for (size_t i = 0; i < data.size(); ++i) {
@@ -158,22 +255,910 @@ bool correctKnnSearch(const SSTree &tree, std::vector<Data *> &data) {
     return true;
 }
 
+// Test 7: Check that batched KNN returns the same neighbors as running the queries one by one
+template <int Dim, typename Scalar>
+bool knnBatchMatchesKnn(const SSTree<Dim, Scalar> &tree, size_t numQueries, size_t k, unsigned threads) {
+    std::vector<Point<Dim, Scalar>> queries;
+    for (size_t i = 0; i < numQueries; ++i) {
+        queries.push_back(Point<Dim, Scalar>::random());
+    }
+    auto resultsUsingBatch = tree.knnBatch(queries, k, threads);
+    for (size_t i = 0; i < queries.size(); ++i) {
+        if (resultsUsingBatch[i] != tree.knn(queries[i], k)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Test 8: Check that range search returns exactly the points within the radius
+template <int Dim, typename Scalar>
+bool correctRangeSearch(const SSTree<Dim, Scalar> &tree, const std::vector<DataId> &data, size_t expected) {
+    Point<Dim, Scalar> query = tree.getEmbedding(data.front());
+    std::vector<Scalar> distances;
+    for (const auto& d : data) {
+        distances.push_back(tree.getEmbedding(d).distance(query));
+    }
+    // Radius halfway between the expected-th and the next distance, away from rounding ties
+    std::partial_sort(distances.begin(), distances.begin() + expected + 1, distances.end());
+    Scalar range = (distances[expected - 1] + distances[expected]) / 2;
+
+    auto resultUsingTree = tree.rangeSearch(query, range);
+    std::unordered_set<DataId> treeData(resultUsingTree.begin(), resultUsingTree.end());
+    for (const auto& d : data) {
+        bool inRange = tree.getEmbedding(d).distance(query) <= range;
+        if (inRange != (treeData.count(d) == 1)) {
+            return false;
+        }
+    }
+    return treeData.size() == resultUsingTree.size();
+}
+
+// Test 9: Check that the tree keeps its invariants and contents after removing part of the data
+template <int Dim, typename Scalar>
+bool validAfterRemovals(const std::vector<Point<Dim, Scalar>> &data, size_t maxPointsPerNode) {
+    SSTree<Dim, Scalar> tree(maxPointsPerNode);
+    auto ids = insertAll(tree, data);
+
+    std::vector<DataId> remaining;
+    for (size_t i = 0; i < ids.size(); ++i) {
+        if (i % 3 != 0) {
+            remaining.push_back(ids[i]);
+        } else if (!tree.remove(ids[i]) || tree.search(ids[i]) != nullptr || tree.remove(ids[i])) {
+            return false;
+        }
+    }
+
+    return allDataPresent(tree, remaining) && leavesAtSameLevel(tree.getRoot())
+            && noNodeExceedsMaxChildren(tree.getRoot(), maxPointsPerNode)
+            && sphereCoversAllPoints(tree.getRoot()) && sphereCoversAllChildrenSpheres(tree.getRoot())
+            && correctKnnSearch(tree, remaining);
+}
+
+// Test 10: Check that a saved and memory-mapped index answers KNN like the tree it came from, under the tree's metric
+template <int Dim, typename Scalar>
+bool mappedKnnMatchesTree(const SSTree<Dim, Scalar> &tree, const std::vector<Point<Dim, Scalar>> &queries, size_t k) {
+    std::string path = (std::filesystem::temp_directory_path() / "sstree_test.idx").string();
+    tree.save(path);
+
+    bool matches = true;
+    {
+        auto mapped = SSTree<Dim, Scalar>::openMapped(path);
+        KnnContext<Dim, Scalar> context;
+        matches = mapped.getMetric() == tree.getMetric();
+        for (size_t i = 0; i < queries.size() && matches; ++i) {
+            const auto &resultUsingTree = tree.knn(queries[i], k, context);
+            auto resultUsingMapped = mapped.knn(queries[i], k);
+            matches = resultUsingTree.size() == resultUsingMapped.size();
+            for (size_t j = 0; j < resultUsingTree.size() && matches; ++j) {
+                // Entries at the same distance, up to rounding, may come out in either order
+                auto [treeDistance, treeId] = resultUsingTree[j];
+                matches = (treeId == resultUsingMapped[j].id
+                           || std::abs(treeDistance - resultUsingMapped[j].distance)
+                                      <= Scalar(1e-5) * (1 + std::abs(treeDistance)))
+                          && tree.getPath(resultUsingMapped[j].id) == resultUsingMapped[j].path;
+            }
+        }
+    }
+
+    std::remove(path.c_str());
+    return matches;
+}
+
+// Test 11: Measure how many of the true nearest neighbors (by brute force) a tree's KNN returns
+template <int Dim, typename Scalar>
+double knnRecall(const SSTree<Dim, Scalar> &tree, const std::vector<DataId> &data, size_t numQueries, size_t k,
+                 const KnnOptions &options = KnnOptions()) {
+    std::vector<std::pair<Scalar, DataId>> distances(data.size());
+    size_t found = 0;
+    for (size_t i = 0; i < numQueries; ++i) {
+        Point<Dim, Scalar> query = Point<Dim, Scalar>::random();
+        for (size_t j = 0; j < data.size(); ++j) {
+            distances[j] = {tree.getEmbedding(data[j]).distance(query), data[j]};
+        }
+        std::partial_sort(distances.begin(), distances.begin() + k, distances.end());
+
+        std::unordered_set<DataId> truth;
+        for (size_t j = 0; j < k; ++j) {
+            truth.insert(distances[j].second);
+        }
+        for (DataId neighbor : tree.knn(query, k, options)) {
+            found += truth.count(neighbor);
+        }
+    }
+    return static_cast<double>(found) / static_cast<double>(numQueries * k);
+}
+
+// Test 12: Check that approximate KNN stays within its budgets and that its error bound holds
+template <int Dim, typename Scalar>
+bool approximateKnnWithinBounds(const SSTree<Dim, Scalar> &tree, size_t numQueries, size_t k) {
+    KnnOptions budget;
+    budget.maxLeaves = 4;
+    KnnOptions relaxed;
+    relaxed.epsilon = 0.5f;
+
+    for (size_t i = 0; i < numQueries; ++i) {
+        Point<Dim, Scalar> query = Point<Dim, Scalar>::random();
+        KnnReport exactReport, budgetReport, relaxedReport;
+        auto exact = tree.knn(query, k, KnnOptions(), &exactReport);
+        auto limited = tree.knn(query, k, budget, &budgetReport);
+        auto approximate = tree.knn(query, k, relaxed, &relaxedReport);
+
+        // The k-th distance found must be within the reported factor of the true one
+        Scalar trueKth = tree.getEmbedding(exact.back()).distance(query);
+        auto boundHolds = [&](const std::vector<DataId> &result, const KnnReport &report) {
+            return result.size() < k
+                   || tree.getEmbedding(result.back()).distance(query) <= report.errorBound * trueKth * (1 + 1e-5);
+        };
+
+        if (exact != tree.knn(query, k) || exactReport.stop != KnnStop::Completed || exactReport.errorBound != 1.0
+            || budgetReport.leavesVisited > budget.maxLeaves || relaxedReport.errorBound > 1.0 + relaxed.epsilon
+            || !boundHolds(limited, budgetReport) || !boundHolds(approximate, relaxedReport)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Test 13: Check that the tree statistics agree with the structure of the tree
+template <int Dim, typename Scalar>
+bool treeStatsConsistent(const SSTree<Dim, Scalar> &tree, size_t numPoints, size_t maxPointsPerNode) {
+    TreeStats stats = tree.treeStats();
+    MemoryUsage usage = tree.memoryUsage();
+
+    size_t internalNodes = std::accumulate(stats.fanOut.begin(), stats.fanOut.end(), size_t(0));
+    return stats.entries == numPoints && stats.nodes == usage.nodes && stats.leaves == usage.leaves
+           && internalNodes == stats.nodes - stats.leaves && stats.fanOut.size() <= maxPointsPerNode + 1
+           && stats.height == stats.levels.size() && stats.levels.front().nodes == 1
+           && stats.levels.back().nodes == stats.leaves && stats.leafFill.max <= 1.0;
+}
+
+// Test 14: Check the per-query counters (all zero unless built with SSTREE_STATS)
+template <int Dim, typename Scalar>
+bool queryStatsConsistent(SSTree<Dim, Scalar> &tree, const std::vector<DataId> &data, size_t k) {
+    KnnReport report;
+    tree.knn(Point<Dim, Scalar>::random(), k, KnnOptions(), &report);
+    // The descent of the spheres is counted; the lookup through the id index visits no node
+    QueryStats searchStats, lookupStats;
+    tree.getRoot()->search(tree.getRoot(), data.front(), &searchStats);
+    tree.search(data.front(), &lookupStats);
+    if (lookupStats.nodesPopped != 0 || lookupStats.leavesScanned != 0) {
+        return false;
+    }
+
+    const QueryStats &stats = report.stats;
+    if (!STATS_ENABLED) {
+        return stats.nodesPopped == 0 && stats.entryDistances == 0 && searchStats.nodesPopped == 0;
+    }
+    return stats.leavesScanned == report.leavesVisited && stats.entryDistances == report.distanceEvaluations
+           && stats.nodesPopped >= report.nodesVisited && stats.centroidDistances >= stats.nodesPopped
+           && searchStats.leavesScanned >= 1 && searchStats.nodesPopped >= searchStats.leavesScanned;
+}
+
+// Test 15: Check that searching with a reused KnnContext matches knn and allocates nothing
+template <int Dim, typename Scalar>
+bool knnContextAllocationFree(const SSTree<Dim, Scalar> &tree, size_t numQueries, size_t k) {
+    std::vector<Point<Dim, Scalar>> queries;
+    std::vector<std::vector<DataId>> expected;
+    for (size_t i = 0; i < numQueries; ++i) {
+        queries.push_back(Point<Dim, Scalar>::random());
+        expected.push_back(tree.knn(queries.back(), k));
+    }
+
+    KnnContext<Dim, Scalar> context;
+    tree.knn(queries.front(), k, context);
+
+    bool matches = true;
+    size_t allocationsBefore = allocationCount;
+    for (size_t i = 0; i < numQueries; ++i) {
+        const auto &results = tree.knn(queries[i], k, context);
+        matches = matches && results.size() == expected[i].size();
+        for (size_t j = 0; matches && j < results.size(); ++j) {
+            matches = results[j].second == expected[i][j] && (j == 0 || results[j - 1].first <= results[j].first);
+        }
+    }
+    return matches && allocationCount == allocationsBefore;
+}
+
+// Test 16: Check that a bulk load spread over several threads keeps the tree invariants
+template <int Dim, typename Scalar>
+bool validParallelBulkLoad(const std::vector<Point<Dim, Scalar>> &data, size_t maxPointsPerNode, unsigned threads) {
+    SSTree<Dim, Scalar> tree(maxPointsPerNode);
+    tree.bulkLoad(data, {}, {}, threads);
+    auto ids = firstIds(data.size());
+
+    return allDataPresent(tree, ids) && leavesAtSameLevel(tree.getRoot())
+            && noNodeExceedsMaxChildren(tree.getRoot(), maxPointsPerNode)
+            && sphereCoversAllPoints(tree.getRoot()) && sphereCoversAllChildrenSpheres(tree.getRoot())
+            && treeStatsConsistent(tree, data.size(), maxPointsPerNode) && correctKnnSearch(tree, ids);
+}
+
+// Test 17: Check that a tree built by insertion with a split policy keeps its invariants and exact KNN,
+// and measure the nodes its exact KNN@10 visits for some queries
+template <int Dim, typename Scalar>
+bool validWithSplitPolicy(const std::vector<Point<Dim, Scalar>> &data, size_t maxPointsPerNode, SplitPolicy policy,
+                          const std::vector<Point<Dim, Scalar>> &queries, double &meanNodesVisited) {
+    SSTree<Dim, Scalar> tree(maxPointsPerNode, LeafStorage::Float, policy);
+    auto ids = insertAll(tree, data);
+
+    size_t nodesVisited = 0;
+    for (const auto &query : queries) {
+        KnnReport report;
+        tree.knn(query, 10, KnnOptions(), &report);
+        nodesVisited += report.nodesVisited;
+    }
+    meanNodesVisited = static_cast<double>(nodesVisited) / queries.size();
+
+    return allDataPresent(tree, ids) && leavesAtSameLevel(tree.getRoot())
+            && noNodeExceedsMaxChildren(tree.getRoot(), maxPointsPerNode)
+            && sphereCoversAllPoints(tree.getRoot()) && sphereCoversAllChildrenSpheres(tree.getRoot())
+            && knnRecall(tree, ids, 20, 10) == 1.0 && correctKnnSearch(tree, ids);
+}
+
+// Test 18: Check that forced reinsertion keeps the invariants on clustered points, and that it does not
+// leave larger or more overlapping leaves than splitting alone
+template <int Dim, typename Scalar>
+bool validWithForcedReinsertion(const std::vector<Point<Dim, Scalar>> &data, size_t maxPointsPerNode,
+                                TreeStats &plainStats, TreeStats &reinsertStats) {
+    SSTree<Dim, Scalar> plainTree(maxPointsPerNode);
+    SSTree<Dim, Scalar> tree(maxPointsPerNode);
+    tree.setReinsertFraction(DEFAULT_REINSERT_FRACTION);
+    insertAll(plainTree, data);
+    auto ids = insertAll(tree, data);
+    plainStats = plainTree.treeStats();
+    reinsertStats = tree.treeStats();
+
+    const LevelStats &plainLeaves = plainStats.levels.back();
+    const LevelStats &reinsertLeaves = reinsertStats.levels.back();
+    return allDataPresent(tree, ids) && leavesAtSameLevel(tree.getRoot())
+            && noNodeExceedsMaxChildren(tree.getRoot(), maxPointsPerNode)
+            && sphereCoversAllPoints(tree.getRoot()) && sphereCoversAllChildrenSpheres(tree.getRoot())
+            && treeStatsConsistent(tree, data.size(), maxPointsPerNode) && knnRecall(tree, ids, 20, 10) == 1.0
+            && reinsertLeaves.radius.mean <= plainLeaves.radius.mean
+            && reinsertLeaves.meanOverlap <= plainLeaves.meanOverlap;
+}
+
+// Test 19: Check that the tree owns its data: ids resolve to copies of the embeddings and to their
+// interned paths, also once removed, and unknown ids are rejected
+template <int Dim, typename Scalar>
+bool treeOwnsItsData(const std::vector<Point<Dim, Scalar>> &data, size_t maxPointsPerNode) {
+    SSTree<Dim, Scalar> tree(maxPointsPerNode);
+    std::vector<std::string> paths;
+    for (size_t i = 0; i < data.size(); ++i) {
+        paths.push_back(imagePath(i));
+    }
+    DataId first = tree.bulkLoad(data, paths);
+    DataId extra = tree.insert(data.front(), "extra.jpg");
+    if (first != 0 || extra != data.size() || !tree.remove(first)) {
+        return false;
+    }
+
+    for (size_t i = 0; i < data.size(); ++i) {
+        DataId id = first + static_cast<DataId>(i);
+        if (tree.getEmbedding(id).distanceSquared(data[i]) != Scalar(0) || tree.getPath(id) != paths[i]) {
+            return false;
+        }
+    }
+
+    bool rejectsUnknownIds = false;
+    try {
+        tree.getPath(extra + 1);
+    } catch (const std::out_of_range &) {
+        rejectsUnknownIds = true;
+    }
+    return rejectsUnknownIds && tree.getPath(extra) == "extra.jpg" && !tree.remove(extra + 1)
+           && tree.search(first) == nullptr && tree.search(extra) != nullptr && tree.memoryUsage().dataBytes > 0;
+}
+
+// Test 20: Check that the id index points every id at the leaf a descent of the spheres finds,
+// and removed ids at no leaf
+template <int Dim, typename Scalar>
+bool leafIndexConsistent(SSTree<Dim, Scalar> &tree, const std::vector<DataId> &present,
+                         const std::vector<DataId> &removed) {
+    for (DataId id : present) {
+        auto *leaf = tree.search(id);
+        if (leaf == nullptr || leaf != tree.getRoot()->search(tree.getRoot(), id)) {
+            return false;
+        }
+        auto *ancestor = leaf;
+        while (ancestor->getParent() != nullptr) {
+            ancestor = ancestor->getParent();
+        }
+        if (ancestor != tree.getRoot()) {
+            return false;
+        }
+    }
+    for (DataId id : removed) {
+        if (tree.search(id) != nullptr) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Keeps the id index checked through splits, forced reinsertion, removals and a bulk reload
+template <int Dim, typename Scalar>
+bool validLeafIndex(const std::vector<Point<Dim, Scalar>> &data, size_t maxPointsPerNode) {
+    SSTree<Dim, Scalar> tree(maxPointsPerNode);
+    tree.setReinsertFraction(DEFAULT_REINSERT_FRACTION);
+    std::vector<Point<Dim, Scalar>> firstHalf(data.begin(), data.begin() + data.size() / 2);
+    std::vector<Point<Dim, Scalar>> secondHalf(data.begin() + data.size() / 2, data.end());
+    auto ids = insertAll(tree, firstHalf);
+    if (!leafIndexConsistent(tree, ids, {})) {
+        return false;
+    }
+
+    std::vector<DataId> present, removed;
+    for (size_t i = 0; i < ids.size(); ++i) {
+        if (i % 3 == 0) {
+            tree.remove(ids[i]);
+            removed.push_back(ids[i]);
+        } else {
+            present.push_back(ids[i]);
+        }
+    }
+    if (!leafIndexConsistent(tree, present, removed)) {
+        return false;
+    }
+
+    DataId first = tree.bulkLoad(secondHalf);
+    for (size_t i = 0; i < secondHalf.size(); ++i) {
+        present.push_back(first + static_cast<DataId>(i));
+    }
+    return leafIndexConsistent(tree, present, removed) && allDataPresent(tree, present);
+}
+
+// Test 21: Check that KNN stays exact with projected routing, before and after new inserts and a retraining,
+// that searches route in the projected space, and that the projected distance to every centroid bounds
+// the full one from below; measure how tight that bound is
+template <int Dim, typename Scalar>
+bool projectedBoundsBelowFull(const SSNode<Dim, Scalar> *node, const Point<Dim, Scalar> &query,
+                              const std::vector<Scalar> &projectedQuery, double &ratioSum, size_t &nodes) {
+    const Scalar *routingCentroid = node->getRoutingCentroid();
+    Scalar squared = 0;
+    for (size_t i = 0; i < projectedQuery.size(); ++i) {
+        squared += (projectedQuery[i] - routingCentroid[i]) * (projectedQuery[i] - routingCentroid[i]);
+    }
+    Scalar projected = std::sqrt(squared);
+    Scalar full = Point<Dim, Scalar>::distance(query, node->getCentroid());
+    if (projected * (Scalar(1) - static_cast<Scalar>(PROJECTION_TOLERANCE)) > full) {
+        return false;
+    }
+    ratioSum += full > Scalar(0) ? projected / full : 1.0;
+    ++nodes;
+    for (const auto *child : node->getChildren()) {
+        if (!projectedBoundsBelowFull(child, query, projectedQuery, ratioSum, nodes)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <int Dim, typename Scalar>
+bool exactWithProjectedRouting(const std::vector<Point<Dim, Scalar>> &data, size_t maxPointsPerNode, Routing routing,
+                               double &meanBoundRatio) {
+    SSTree<Dim, Scalar> tree(maxPointsPerNode);
+    tree.setRouting(routing, 16);
+    std::vector<Point<Dim, Scalar>> loaded(data.begin(), data.begin() + data.size() / 2);
+    std::vector<Point<Dim, Scalar>> inserted(data.begin() + data.size() / 2, data.end());
+    tree.bulkLoad(loaded);
+    auto ids = firstIds(loaded.size());
+    bool exact = knnRecall(tree, ids, 20, 10) == 1.0;
+
+    for (const auto &id : insertAll(tree, inserted)) {
+        ids.push_back(id);
+    }
+    exact = exact && knnRecall(tree, ids, 20, 10) == 1.0;
+    const size_t routingDimensions = 8;
+    tree.setRouting(routing, routingDimensions);
+
+    const size_t numQueries = 50;
+    double ratioSum = 0.0;
+    size_t nodes = 0;
+    KnnContext<Dim, Scalar> context;
+    for (size_t i = 0; i < numQueries; ++i) {
+        Point<Dim, Scalar> query = Point<Dim, Scalar>::random();
+        tree.knn(query, 10, context);
+        if (routing == Routing::Full) {
+            if (!context.getProjectedQuery().empty()) {
+                return false;
+            }
+            continue;
+        }
+        if (context.getProjectedQuery().size() != routingDimensions
+            || !projectedBoundsBelowFull(tree.getRoot(), query, context.getProjectedQuery(), ratioSum, nodes)) {
+            return false;
+        }
+    }
+    meanBoundRatio = nodes == 0 ? 1.0 : ratioSum / nodes;
+
+    return exact && knnRecall(tree, ids, 20, 10) == 1.0 && correctKnnSearch(tree, ids)
+           && approximateKnnWithinBounds(tree, 20, 10) && knnContextAllocationFree(tree, 20, 10)
+           && sphereCoversAllChildrenSpheres(tree.getRoot());
+}
+
+// Test 22: Check that KNN and range search under each metric agree with a brute-force scan under it, and that
+// the index saved from an exact tree ranks under the same metric
+template <int Dim, typename Scalar>
+Scalar metricDistance(Metric metric, const Point<Dim, Scalar> &a, const Point<Dim, Scalar> &b) {
+    switch (metric) {
+        case Metric::SquaredEuclidean: return a.distanceSquared(b);
+        case Metric::Cosine: return Scalar(1) - a.dot(b);
+        case Metric::InnerProduct: return -a.dot(b);
+        default: return a.distance(b);
+    }
+}
+
+template <int Dim, typename Scalar>
+bool exactUnderMetric(std::vector<Point<Dim, Scalar>> data, size_t maxPointsPerNode, Metric metric,
+                      LeafStorage storage, double &meanNodesVisited) {
+    auto sample = [metric](size_t dimension) {
+        Point<Dim, Scalar> point = Point<Dim, Scalar>::random(-1, 1, dimension);
+        return metric == Metric::Cosine ? point / point.norm() : point;
+    };
+    for (auto &point : data) {
+        point = sample(point.size());
+    }
+
+    SSTree<Dim, Scalar> tree(maxPointsPerNode, storage);
+    std::vector<Point<Dim, Scalar>> loaded(data.begin(), data.begin() + data.size() / 2);
+    std::vector<Point<Dim, Scalar>> inserted(data.begin() + data.size() / 2, data.end());
+    tree.bulkLoad(loaded);
+    insertAll(tree, inserted);
+    tree.setMetric(metric);
+
+    const size_t numQueries = 20, k = 10;
+    const Scalar tolerance = Scalar(1e-4);
+    std::vector<std::pair<Scalar, DataId>> truth(data.size());
+    size_t nodesVisited = 0;
+    KnnContext<Dim, Scalar> context;
+    for (size_t i = 0; i < numQueries; ++i) {
+        Point<Dim, Scalar> query = sample(data.front().size());
+        for (size_t j = 0; j < data.size(); ++j) {
+            truth[j] = {metricDistance(metric, query, data[j]), static_cast<DataId>(j)};
+        }
+        std::sort(truth.begin(), truth.end());
+
+        const auto &neighbors = tree.knn(query, k, context);
+        nodesVisited += context.getReport().nodesVisited;
+        if (neighbors.size() != k) {
+            return false;
+        }
+        for (size_t j = 0; j < k; ++j) {
+            Scalar exact = metricDistance(metric, query, tree.getEmbedding(neighbors[j].second));
+            if (std::abs(neighbors[j].first - truth[j].first) > tolerance * (1 + std::abs(truth[j].first))
+                || std::abs(neighbors[j].first - exact) > tolerance * (1 + std::abs(exact))) {
+                return false;
+            }
+        }
+
+        // Range halfway between the 25th and the 26th distance, away from rounding ties
+        Scalar range = (truth[24].first + truth[25].first) / 2;
+        size_t matches = 0;
+        bool inRange = true;
+        tree.forEachInRange(query, range, [&](DataId id, Scalar distance) {
+            ++matches;
+            inRange = inRange && distance <= range
+                      && std::abs(distance - metricDistance(metric, query, data[id])) <= tolerance * (1 + std::abs(distance));
+            return true;
+        });
+        if (!inRange || matches != 25) {
+            return false;
+        }
+    }
+    meanNodesVisited = static_cast<double>(nodesVisited) / numQueries;
+
+    // Quantized leaves rank approximately, so only exact trees must agree with their saved index
+    std::vector<Point<Dim, Scalar>> queries;
+    for (size_t i = 0; i < numQueries; ++i) {
+        queries.push_back(sample(data.front().size()));
+    }
+    return storage != LeafStorage::Float || mappedKnnMatchesTree(tree, queries, k);
+}
+
+// Test 23: Check that filtered KNN and range search return what post-filtering a brute-force scan would
+template <int Dim, typename Scalar>
+bool filteredSearchMatchesBruteForce(const std::vector<Point<Dim, Scalar>> &data, size_t maxPointsPerNode,
+                                     size_t tenants, double &meanLeavesScanned, double &meanUnfilteredLeaves) {
+    // Every point belongs to a tenant, and every third one also to category `tenants`
+    std::vector<std::vector<Tag>> tags(data.size());
+    for (size_t i = 0; i < data.size(); ++i) {
+        tags[i].push_back(static_cast<Tag>(i % tenants));
+        if (i % 3 == 0) {
+            tags[i].push_back(static_cast<Tag>(tenants));
+        }
+    }
+    SSTree<Dim, Scalar> tree(maxPointsPerNode);
+    size_t half = data.size() / 2;
+    tree.bulkLoad(std::vector<Point<Dim, Scalar>>(data.begin(), data.begin() + half), {},
+                  std::vector<std::vector<Tag>>(tags.begin(), tags.begin() + half));
+    for (size_t i = half; i < data.size(); ++i) {
+        tree.insert(data[i], imagePath(i), tags[i]);
+    }
+    // Removals leave stale signatures behind, which must only cost pruning, never matches
+    for (size_t i = 7; i < data.size(); i += 10) {
+        tree.remove(static_cast<DataId>(i));
+    }
+    auto present = [](size_t i) { return i % 10 != 7; };
+
+    const size_t numQueries = 20, k = 10;
+    size_t leavesScanned = 0, unfilteredLeaves = 0;
+    KnnContext<Dim, Scalar> context;
+    for (size_t q = 0; q < numQueries; ++q) {
+        Point<Dim, Scalar> query = Point<Dim, Scalar>::random();
+        SearchFilter filter;
+        filter.anyTag = {static_cast<Tag>(q % tenants)};
+        if (q % 2 == 1) {
+            // Either of two tenants, or the category, restricted further to odd ids
+            filter.anyTag.push_back(static_cast<Tag>((q + 1) % tenants));
+            filter.anyTag.push_back(static_cast<Tag>(tenants));
+            filter.predicate = [](DataId id) { return id % 2 == 1; };
+        }
+        auto matches = [&](size_t i) {
+            bool tagged = std::any_of(tags[i].begin(), tags[i].end(), [&](Tag tag) {
+                return std::find(filter.anyTag.begin(), filter.anyTag.end(), tag) != filter.anyTag.end();
+            });
+            return present(i) && tagged && (!filter.predicate || filter.predicate(static_cast<DataId>(i)));
+        };
+
+        std::vector<std::pair<Scalar, DataId>> truth;
+        for (size_t i = 0; i < data.size(); ++i) {
+            if (matches(i)) {
+                truth.emplace_back(data[i].distance(query), static_cast<DataId>(i));
+            }
+        }
+        std::sort(truth.begin(), truth.end());
+
+        const auto &neighbors = tree.knn(query, k, context, filter);
+        leavesScanned += context.getReport().leavesVisited;
+        if (neighbors.size() != std::min(k, truth.size())) {
+            return false;
+        }
+        for (size_t j = 0; j < neighbors.size(); ++j) {
+            if (!matches(neighbors[j].second) || std::abs(neighbors[j].first - truth[j].first) > 1e-4f * truth[j].first) {
+                return false;
+            }
+        }
+        KnnReport report;
+        tree.knn(query, k, KnnOptions(), &report);
+        unfilteredLeaves += report.leavesVisited;
+
+        if (truth.empty()) {
+            continue;
+        }
+        // Range just past the matching neighbors found
+        Scalar range = truth[std::min(k, truth.size()) - 1].first * (1 + 1e-4f);
+        auto inRange = tree.rangeSearch(query, range, filter);
+        size_t expected = 0;
+        for (const auto &[distance, id] : truth) {
+            expected += distance <= range;
+        }
+        if (inRange.size() != expected || !std::all_of(inRange.begin(), inRange.end(), matches)) {
+            return false;
+        }
+    }
+
+    // No data point carries an unknown tag
+    SearchFilter nobody;
+    nobody.anyTag = {static_cast<Tag>(tenants + 1)};
+    meanLeavesScanned = static_cast<double>(leavesScanned) / numQueries;
+    meanUnfilteredLeaves = static_cast<double>(unfilteredLeaves) / numQueries;
+    return tree.knn(Point<Dim, Scalar>::random(), k, nobody).empty()
+           && tree.rangeSearch(Point<Dim, Scalar>::random(), 1e9f, nobody).empty()
+           && tree.getTags(1).size() == 1 && *tree.getTags(3).begin() == 3;
+}
+
+// Test 24: Check that the incremental search returns every point once, nearest first, that its first
+// neighbors are those of KNN, and that it only expands the nodes a KNN search would need
+template <int Dim, typename Scalar>
+bool incrementalSearchMatchesKnn(const std::vector<Point<Dim, Scalar>> &data, size_t maxPointsPerNode, Metric metric,
+                                 LeafStorage storage, double &meanNodesForTen, double &meanKnnNodes) {
+    SSTree<Dim, Scalar> tree(maxPointsPerNode, storage);
+    tree.bulkLoad(data);
+    tree.setMetric(metric);
+
+    const size_t numQueries = 10, k = 10;
+    const Scalar tolerance = Scalar(1e-4);
+    size_t nodesForTen = 0, knnNodes = 0;
+    KnnContext<Dim, Scalar> context;
+    for (size_t q = 0; q < numQueries; ++q) {
+        Point<Dim, Scalar> query = Point<Dim, Scalar>::random();
+        const auto &neighbors = tree.knn(query, k, context);
+        knnNodes += context.getReport().nodesVisited;
+
+        auto iterator = tree.nearest(query);
+        std::vector<bool> seen(data.size(), false);
+        std::pair<Scalar, DataId> neighbor;
+        size_t count = 0;
+        Scalar previous = std::numeric_limits<Scalar>::lowest();
+        while (iterator.next(neighbor)) {
+            if (count < k && std::abs(neighbor.first - neighbors[count].first)
+                                     > tolerance * std::max(Scalar(1), std::abs(neighbors[count].first))) {
+                return false;
+            }
+            if (seen[neighbor.second] || neighbor.first < previous
+                || std::abs(neighbor.first - metricDistance(metric, query, data[neighbor.second]))
+                           > tolerance * std::max(Scalar(1), std::abs(neighbor.first))) {
+                return false;
+            }
+            seen[neighbor.second] = true;
+            previous = neighbor.first;
+            if (++count == k) {
+                nodesForTen += iterator.getReport().nodesVisited;
+            }
+        }
+        if (count != data.size()) {
+            return false;
+        }
+    }
+
+    // A filtered iterator stopped after five neighbors resumes where it left off
+    SearchFilter filter;
+    filter.predicate = [](DataId id) { return id % 3 == 0; };
+    Point<Dim, Scalar> query = Point<Dim, Scalar>::random();
+    const auto &expected = tree.knn(query, 15, context, filter);
+    auto iterator = tree.nearest(query, filter);
+    std::pair<Scalar, DataId> neighbor;
+    for (size_t j = 0; j < expected.size(); ++j) {
+        if (!iterator.next(neighbor) || neighbor.second % 3 != 0
+            || std::abs(neighbor.first - expected[j].first) > tolerance * std::max(Scalar(1), std::abs(neighbor.first))) {
+            return false;
+        }
+    }
+
+    meanNodesForTen = static_cast<double>(nodesForTen) / numQueries;
+    meanKnnNodes = static_cast<double>(knnNodes) / numQueries;
+    return expected.size() == 15;
+}
+
+// Test 25: Check that batched inserts keep the invariants and the id index, that threads do not change
+// the tree they build, and time them against inserting the same points one at a time
+template <int Dim, typename Scalar>
+bool validBatchedInserts(const std::vector<Point<Dim, Scalar>> &data, size_t maxPointsPerNode, size_t batchSize,
+                         double &speedup) {
+    size_t initial = data.size() / 10;
+    std::vector<Point<Dim, Scalar>> loaded(data.begin(), data.begin() + initial);
+    std::vector<Point<Dim, Scalar>> inserted(data.begin() + initial, data.end());
+
+    SSTree<Dim, Scalar> singleTree(maxPointsPerNode);
+    singleTree.bulkLoad(loaded);
+    auto singleStart = std::chrono::high_resolution_clock::now();
+    insertAll(singleTree, inserted);
+    std::chrono::duration<double> singleElapsed = std::chrono::high_resolution_clock::now() - singleStart;
+
+    SSTree<Dim, Scalar> tree(maxPointsPerNode);
+    // A first batch into the empty tree is bulk loaded
+    tree.insertBatch(loaded);
+    std::vector<std::vector<Tag>> tags;
+    auto batchStart = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < inserted.size(); i += batchSize) {
+        std::vector<Point<Dim, Scalar>> batch(inserted.begin() + i,
+                                              inserted.begin() + std::min(i + batchSize, inserted.size()));
+        tags.assign(batch.size(), {static_cast<Tag>(i / batchSize)});
+        if (tree.insertBatch(batch, {}, tags) != initial + i) {
+            return false;
+        }
+    }
+    std::chrono::duration<double> batchElapsed = std::chrono::high_resolution_clock::now() - batchStart;
+    speedup = singleElapsed.count() / batchElapsed.count();
+
+    // Small batches, an empty one, and one larger than the whole tree
+    tree.insertBatch({});
+    tree.insertBatch({Point<Dim, Scalar>::random()}, {imagePath(0)});
+    std::vector<Point<Dim, Scalar>> large;
+    for (size_t i = 0; i < 2 * data.size(); ++i) {
+        large.push_back(Point<Dim, Scalar>::random());
+    }
+    tree.insertBatch(large);
+    size_t total = data.size() + 1 + large.size();
+
+    SSTree<Dim, Scalar> parallelTree(maxPointsPerNode);
+    parallelTree.bulkLoad(loaded);
+    parallelTree.insertBatch(inserted, {}, {}, 4);
+    SSTree<Dim, Scalar> serialTree(maxPointsPerNode);
+    serialTree.bulkLoad(loaded);
+    serialTree.insertBatch(inserted);
+    if (parallelTree.memoryUsage().nodes != serialTree.memoryUsage().nodes) {
+        return false;
+    }
+    for (size_t q = 0; q < 10; ++q) {
+        Point<Dim, Scalar> query = Point<Dim, Scalar>::random();
+        if (parallelTree.knn(query, 10) != serialTree.knn(query, 10)) {
+            return false;
+        }
+    }
+
+    auto ids = firstIds(total);
+    return allDataPresent(tree, ids) && leavesAtSameLevel(tree.getRoot())
+           && noNodeExceedsMaxChildren(tree.getRoot(), maxPointsPerNode) && sphereCoversAllPoints(tree.getRoot())
+           && sphereCoversAllChildrenSpheres(tree.getRoot()) && correctKnnSearch(tree, ids)
+           && leafIndexConsistent(tree, ids, {}) && treeStatsConsistent(tree, total, maxPointsPerNode)
+           && tree.getPath(static_cast<DataId>(data.size())) == imagePath(0)
+           && *tree.getTags(static_cast<DataId>(initial + batchSize)).begin() == 1;
+}
+
+// Test 26: Check that concurrent inserts and searches keep every earlier point findable while the tree
+// grows, store every point with its own path and tags, and leave a valid tree once concurrent mode is
+// turned off; time the writers against a single one
+template <int Dim, typename Scalar>
+bool validConcurrentInserts(const std::vector<Point<Dim, Scalar>> &data, size_t maxPointsPerNode, unsigned writers,
+                            unsigned readers, double &speedup, size_t &searches) {
+    size_t initial = data.size() / 10;
+    std::vector<Point<Dim, Scalar>> loaded(data.begin(), data.begin() + initial);
+
+    auto ingest = [&](SSTree<Dim, Scalar> &tree, unsigned writerCount, unsigned readerCount) {
+        std::atomic<size_t> next{initial};
+        std::atomic<bool> writing{true}, lost{false};
+        std::atomic<size_t> searchCount{0};
+        std::vector<std::thread> writerThreads, readerThreads;
+        for (unsigned w = 0; w < writerCount; ++w) {
+            writerThreads.emplace_back([&]() {
+                for (size_t i = next++; i < data.size(); i = next++) {
+                    tree.insert(data[i], imagePath(i), {static_cast<Tag>(i % 4)});
+                }
+            });
+        }
+        for (unsigned r = 0; r < readerCount; ++r) {
+            readerThreads.emplace_back([&, r]() {
+                KnnContext<Dim, Scalar> context;
+                std::vector<Point<Dim, Scalar>> batch;
+                for (size_t q = r; writing; q += readerCount) {
+                    // A point loaded before the writers started stays its own nearest neighbor;
+                    // odd readers go through knnBatch, whose routing sort also descends the tree
+                    if (r % 2 == 0) {
+                        const auto &results = tree.knn(data[q % initial], 1, context);
+                        if (results.empty() || results.front().first != Scalar(0)) {
+                            lost = true;
+                        }
+                    } else {
+                        batch.assign({data[q % initial], data[(q + 1) % initial]});
+                        auto results = tree.knnBatch(batch, 1, 2);
+                        for (size_t b = 0; b < batch.size(); ++b) {
+                            if (results[b].empty() || tree.getEmbedding(results[b].front()).distance(batch[b]) != Scalar(0)) {
+                                lost = true;
+                            }
+                        }
+                    }
+                    ++searchCount;
+                }
+            });
+        }
+        for (auto &thread : writerThreads) {
+            thread.join();
+        }
+        writing = false;
+        for (auto &thread : readerThreads) {
+            thread.join();
+        }
+        searches = searchCount;
+        return !lost;
+    };
+
+    SSTree<Dim, Scalar> singleTree(maxPointsPerNode);
+    singleTree.bulkLoad(loaded);
+    singleTree.setConcurrent(true);
+    auto singleStart = std::chrono::high_resolution_clock::now();
+    ingest(singleTree, 1, 0);
+    std::chrono::duration<double> singleElapsed = std::chrono::high_resolution_clock::now() - singleStart;
+
+    SSTree<Dim, Scalar> timedTree(maxPointsPerNode);
+    timedTree.bulkLoad(loaded);
+    timedTree.setConcurrent(true);
+    auto concurrentStart = std::chrono::high_resolution_clock::now();
+    ingest(timedTree, writers, 0);
+    std::chrono::duration<double> concurrentElapsed = std::chrono::high_resolution_clock::now() - concurrentStart;
+    speedup = singleElapsed.count() / concurrentElapsed.count();
+
+    SSTree<Dim, Scalar> tree(maxPointsPerNode);
+    tree.bulkLoad(loaded);
+    tree.setConcurrent(true);
+    if (!ingest(tree, writers, readers)) {
+        return false;
+    }
+    tree.setConcurrent(false);
+
+    auto ids = firstIds(data.size());
+    for (DataId id : ids) {
+        // Bulk loaded points keep their order; the others carry their index in their path
+        size_t index = id < initial ? id : std::stoul(std::string(tree.getPath(id).substr(4)));
+        if (tree.getEmbedding(id).distance(data[index]) != Scalar(0)
+            || (index >= initial && *tree.getTags(id).begin() != static_cast<Tag>(index % 4))) {
+            return false;
+        }
+    }
+    return allDataPresent(tree, ids) && leavesAtSameLevel(tree.getRoot())
+           && noNodeExceedsMaxChildren(tree.getRoot(), maxPointsPerNode) && sphereCoversAllPoints(tree.getRoot())
+           && sphereCoversAllChildrenSpheres(tree.getRoot()) && correctKnnSearch(tree, ids)
+           && leafIndexConsistent(tree, ids, {}) && treeStatsConsistent(tree, data.size(), maxPointsPerNode);
+}
+
+// Test 27: Check that a split policy copes with a tight cluster of near-identical points, whose
+// deviations are far below the norms a direction can be normalized by
+template <int Dim, typename Scalar>
+bool validWithNearDuplicates(size_t numPoints, size_t maxPointsPerNode, SplitPolicy policy) {
+    Point<Dim, Scalar> center = Point<Dim, Scalar>::random();
+    std::vector<Point<Dim, Scalar>> data;
+    for (size_t i = 0; i < numPoints; ++i) {
+        data.push_back(center + Point<Dim, Scalar>::random(Scalar(-1e-5), Scalar(1e-5)));
+    }
+
+    SSTree<Dim, Scalar> tree(maxPointsPerNode, LeafStorage::Float, policy);
+    std::vector<DataId> ids;
+    try {
+        ids = insertAll(tree, data);
+    } catch (const std::exception &) {
+        return false;
+    }
+    return allDataPresent(tree, ids) && leavesAtSameLevel(tree.getRoot())
+           && noNodeExceedsMaxChildren(tree.getRoot(), maxPointsPerNode) && sphereCoversAllPoints(tree.getRoot())
+           && sphereCoversAllChildrenSpheres(tree.getRoot()) && leafIndexConsistent(tree, ids, {});
+}
+
+// Test 28: Check that a memory-mapped index whose header points a section out of the file, or misaligns it,
+// is rejected when opened rather than read out of bounds
+template <int Dim, typename Scalar>
+bool mappedRejectsCorruptHeaders(const SSTree<Dim, Scalar> &tree) {
+    std::string path = (std::filesystem::temp_directory_path() / "sstree_corrupt.idx").string();
+    tree.save(path);
+    std::string original;
+    {
+        std::ifstream file(path, std::ios::binary);
+        original.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+    IndexHeader header;
+    std::memcpy(&header, original.data(), sizeof(header));
+
+    auto opens = [&path](const std::function<void(IndexHeader &, std::string &)> &corrupt, const std::string &bytes,
+                         IndexHeader changed) {
+        std::string contents = bytes;
+        corrupt(changed, contents);
+        std::memcpy(contents.data(), &changed, sizeof(changed));
+        std::ofstream(path, std::ios::binary | std::ios::trunc).write(contents.data(), contents.size());
+        try {
+            SSTree<Dim, Scalar>::openMapped(path);
+            return true;
+        } catch (const std::runtime_error &) {
+            return false;
+        }
+    };
+
+    std::vector<std::function<void(IndexHeader &, std::string &)>> corruptions = {
+        [](IndexHeader &h, std::string &) { h.nodeCount = h.fileSize; },
+        [](IndexHeader &h, std::string &) { h.entryCount = h.fileSize; },
+        [](IndexHeader &h, std::string &) { h.centroidsOffset = h.fileSize; },
+        [](IndexHeader &h, std::string &) { h.embeddingsOffset += sizeof(Scalar); },
+        [](IndexHeader &h, std::string &) { h.idsOffset = h.fileSize + INDEX_ALIGNMENT; },
+        [](IndexHeader &h, std::string &) { h.pathOffsetsOffset = 0; },
+        [](IndexHeader &h, std::string &) { h.stride = h.dimension - 1; },
+        [](IndexHeader &h, std::string &contents) {
+            uint64_t pastEnd = h.fileSize;
+            std::memcpy(contents.data() + h.pathOffsetsOffset + h.entryCount * sizeof(uint64_t), &pastEnd,
+                        sizeof(pastEnd));
+        },
+    };
+    bool rejected = opens([](IndexHeader &, std::string &) {}, original, header);
+    for (const auto &corrupt : corruptions) {
+        rejected = rejected && !opens(corrupt, original, header);
+    }
+
+    std::remove(path.c_str());
+    return rejected;
+}
 
 int main() {
 
     auto start = std::chrono::high_resolution_clock::now();
 
-    auto data = generateRandomData(NUM_POINTS);
-    SSTree tree(MAX_POINTS_PER_NODE);
-    for (const auto &d: data) {
-        tree.insert(d);
-    }
+    auto points = generateRandomData(NUM_POINTS);
+    SSTree<> tree(MAX_POINTS_PER_NODE);
+    auto data = insertAll(tree, points);
 
     bool allPresent = allDataPresent(tree, data);
     bool sameLevel = leavesAtSameLevel(tree.getRoot());
     bool noExceed = noNodeExceedsMaxChildren(tree.getRoot(), MAX_POINTS_PER_NODE);
     bool spherePoints = sphereCoversAllPoints(tree.getRoot());
     bool sphereChildren = sphereCoversAllChildrenSpheres(tree.getRoot());
+    bool statsOk = treeStatsConsistent(tree, NUM_POINTS, MAX_POINTS_PER_NODE) && queryStatsConsistent(tree, data, 10);
     bool testKnn = correctKnnSearch(tree, data);
 
     auto end = std::chrono::high_resolution_clock::now(); 
@@ -189,6 +1174,191 @@ int main() {
 
     std::cout << "Elapsed time: " << elapsed.count() << " seconds" << std::endl;
 
+    MemoryUsage usage = tree.memoryUsage();
+    std::cout << "Memory usage: " << usage.totalBytes() / (1024.0 * 1024.0) << " MB ("
+            << usage.nodes << " nodes, " << usage.leaves << " leaves, "
+            << usage.dataBytes / (1024.0 * 1024.0) << " MB of data)" << std::endl;
+
+    auto bulkStart = std::chrono::high_resolution_clock::now();
+
+    std::vector<std::string> paths;
+    for (size_t i = 0; i < NUM_POINTS; ++i) {
+        paths.push_back(imagePath(i));
+    }
+    SSTree<> bulkTree(MAX_POINTS_PER_NODE);
+    bulkTree.bulkLoad(points, paths);
+    auto bulkData = firstIds(NUM_POINTS);
+
+    auto bulkEnd = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> bulkElapsed = bulkEnd - bulkStart;
+
+    bool bulkStatsOk = treeStatsConsistent(bulkTree, NUM_POINTS, MAX_POINTS_PER_NODE);
+    bool rangeSearchOk = correctRangeSearch(bulkTree, bulkData, 25);
+    std::vector<Point<>> splitData(points.begin(), points.begin() + NUM_POINTS / 5);
+    bool removalOk = validAfterRemovals(splitData, MAX_POINTS_PER_NODE);
+    bool parallelBuildOk = validParallelBulkLoad(points, MAX_POINTS_PER_NODE, 4);
+    bool ownsDataOk = treeOwnsItsData(splitData, MAX_POINTS_PER_NODE);
+    bool leafIndexOk = validLeafIndex(splitData, MAX_POINTS_PER_NODE) && leafIndexConsistent(tree, data, {})
+            && leafIndexConsistent(bulkTree, bulkData, {});
+    double fullRoutingRatio = 0.0, randomRoutingRatio = 0.0, principalRoutingRatio = 0.0;
+    bool routingOk = exactWithProjectedRouting(splitData, MAX_POINTS_PER_NODE, Routing::Full, fullRoutingRatio)
+            && exactWithProjectedRouting(splitData, MAX_POINTS_PER_NODE, Routing::RandomProjection, randomRoutingRatio)
+            && exactWithProjectedRouting(splitData, MAX_POINTS_PER_NODE, Routing::PrincipalComponents,
+                                         principalRoutingRatio);
+
+    double euclideanNodes = 0.0, squaredNodes = 0.0, cosineNodes = 0.0, innerProductNodes = 0.0, int8InnerNodes = 0.0;
+    bool metricsOk = exactUnderMetric(splitData, MAX_POINTS_PER_NODE, Metric::Euclidean, LeafStorage::Float, euclideanNodes)
+            && exactUnderMetric(splitData, MAX_POINTS_PER_NODE, Metric::SquaredEuclidean, LeafStorage::Float, squaredNodes)
+            && exactUnderMetric(splitData, MAX_POINTS_PER_NODE, Metric::Cosine, LeafStorage::Float, cosineNodes)
+            && exactUnderMetric(splitData, MAX_POINTS_PER_NODE, Metric::InnerProduct, LeafStorage::Float, innerProductNodes)
+            && exactUnderMetric(splitData, MAX_POINTS_PER_NODE, Metric::InnerProduct, LeafStorage::Int8, int8InnerNodes);
+
+    double filteredLeaves = 0.0, unfilteredLeaves = 0.0;
+    bool filteredOk = filteredSearchMatchesBruteForce(splitData, MAX_POINTS_PER_NODE, 50, filteredLeaves, unfilteredLeaves);
+
+    double incrementalNodes = 0.0, knnNodes = 0.0, int8IncrementalNodes = 0.0, int8KnnNodes = 0.0;
+    bool incrementalOk = incrementalSearchMatchesKnn(splitData, MAX_POINTS_PER_NODE, Metric::Euclidean,
+                                                     LeafStorage::Float, incrementalNodes, knnNodes)
+            && incrementalSearchMatchesKnn(splitData, MAX_POINTS_PER_NODE, Metric::InnerProduct, LeafStorage::Int8,
+                                           int8IncrementalNodes, int8KnnNodes);
+
+    double batchSpeedup = 0.0;
+    bool batchedInsertsOk = validBatchedInserts(points, MAX_POINTS_PER_NODE, 1000, batchSpeedup);
+
+    double concurrentSpeedup = 0.0;
+    size_t concurrentSearches = 0;
+    bool concurrentOk = validConcurrentInserts(points, MAX_POINTS_PER_NODE, 4, 2, concurrentSpeedup,
+                                               concurrentSearches);
+
+    // On uniform points exact KNN visits every node at this dimension, so the counts there only reflect how
+    // many nodes a policy makes; clustered points show how well a policy lets the search prune
+    auto uniformQueries = generateRandomData(50);
+    auto clusteredSplitData = generateClusteredData(NUM_POINTS / 5 + 50, 50);
+    std::vector<Point<>> clusteredQueries(clusteredSplitData.end() - 50, clusteredSplitData.end());
+    clusteredSplitData.resize(NUM_POINTS / 5);
+    double axisNodes = 0.0, twoMeansNodes = 0.0, principalNodes = 0.0;
+    double axisClusteredNodes = 0.0, twoMeansClusteredNodes = 0.0, principalClusteredNodes = 0.0;
+    bool splitPoliciesOk =
+            validWithSplitPolicy(splitData, MAX_POINTS_PER_NODE, SplitPolicy::AxisVariance, uniformQueries, axisNodes)
+            && validWithSplitPolicy(splitData, MAX_POINTS_PER_NODE, SplitPolicy::TwoMeans, uniformQueries, twoMeansNodes)
+            && validWithSplitPolicy(splitData, MAX_POINTS_PER_NODE, SplitPolicy::PrincipalDirection, uniformQueries,
+                                    principalNodes)
+            && validWithSplitPolicy(clusteredSplitData, MAX_POINTS_PER_NODE, SplitPolicy::AxisVariance,
+                                    clusteredQueries, axisClusteredNodes)
+            && validWithSplitPolicy(clusteredSplitData, MAX_POINTS_PER_NODE, SplitPolicy::TwoMeans, clusteredQueries,
+                                    twoMeansClusteredNodes)
+            && validWithSplitPolicy(clusteredSplitData, MAX_POINTS_PER_NODE, SplitPolicy::PrincipalDirection,
+                                    clusteredQueries, principalClusteredNodes);
+    bool nearDuplicatesOk = validWithNearDuplicates<static_cast<int>(DIM), float>(500, MAX_POINTS_PER_NODE,
+                                                                                 SplitPolicy::PrincipalDirection);
+    TreeStats plainClusteredStats, reinsertClusteredStats;
+    bool reinsertionOk = validWithForcedReinsertion(generateClusteredData(NUM_POINTS / 5, 50), MAX_POINTS_PER_NODE,
+                                                    plainClusteredStats, reinsertClusteredStats);
+
+    SSTree<> int8Tree(MAX_POINTS_PER_NODE, LeafStorage::Int8);
+    int8Tree.bulkLoad(points);
+    SSTree<> halfTree(MAX_POINTS_PER_NODE, LeafStorage::Float16);
+    halfTree.bulkLoad(points);
+    double int8Recall = knnRecall(int8Tree, bulkData, 50, 10);
+    double halfRecall = knnRecall(halfTree, bulkData, 50, 10);
+
+    bool approximateOk = approximateKnnWithinBounds(bulkTree, 50, 10);
+    bool contextOk = knnContextAllocationFree(bulkTree, 50, 10) && knnContextAllocationFree(int8Tree, 50, 10);
+    KnnOptions approximateOptions;
+    approximateOptions.maxLeaves = bulkTree.memoryUsage().leaves / 10;
+    double approximateRecall = knnRecall(bulkTree, bulkData, 50, 10, approximateOptions);
+
+    std::cout << "Bulk load - All data present: " << (allDataPresent(bulkTree, bulkData) ? "Yes" : "No") << std::endl;
+    std::cout << "Bulk load - Leaf nodes at the same level: " << (leavesAtSameLevel(bulkTree.getRoot()) ? "Yes" : "No") << std::endl;
+    std::cout << "Bulk load - No exceeding the child limit per node: "
+            << (noNodeExceedsMaxChildren(bulkTree.getRoot(), MAX_POINTS_PER_NODE) ? "Yes" : "No") << std::endl;
+    std::cout << "Bulk load - Hypersphere covers all points in leaf nodes: "
+            << (sphereCoversAllPoints(bulkTree.getRoot()) ? "Yes" : "No") << std::endl;
+    std::cout << "Bulk load - Hypersphere covers all internal node hyperspheres: "
+            << (sphereCoversAllChildrenSpheres(bulkTree.getRoot()) ? "Yes" : "No") << std::endl;
+    std::cout << "Bulk load - Performs KNN search: " << (correctKnnSearch(bulkTree, bulkData) ? "Yes" : "No") << std::endl;
+    std::cout << "Bulk load time: " << bulkElapsed.count() << " seconds" << std::endl;
+    std::cout << "Parallel bulk load keeps the invariants: " << (parallelBuildOk ? "Yes" : "No") << std::endl;
+    std::cout << "Split policies keep the invariants: " << (splitPoliciesOk ? "Yes" : "No") << std::endl;
+    std::cout << "Nodes visited by exact KNN@10 on uniform points (axis / 2-means / principal direction): "
+            << axisNodes << " / " << twoMeansNodes << " / " << principalNodes << std::endl;
+    std::cout << "Nodes visited by exact KNN@10 on clustered points (axis / 2-means / principal direction): "
+            << axisClusteredNodes << " / " << twoMeansClusteredNodes << " / " << principalClusteredNodes << std::endl;
+    std::cout << "Principal direction splits visit no more nodes than axis splits on clustered points: "
+            << (principalClusteredNodes <= axisClusteredNodes ? "Yes" : "No") << std::endl;
+    std::cout << "Principal direction splits of near-identical points keep the invariants: "
+            << (nearDuplicatesOk ? "Yes" : "No") << std::endl;
+    std::cout << "Forced reinsertion keeps the invariants: " << (reinsertionOk ? "Yes" : "No") << std::endl;
+    std::cout << "Mean leaf radius / leaf sibling overlap on clustered inserts - split only: "
+            << plainClusteredStats.levels.back().radius.mean << " / " << plainClusteredStats.levels.back().meanOverlap
+            << ", forced reinsertion: " << reinsertClusteredStats.levels.back().radius.mean << " / "
+            << reinsertClusteredStats.levels.back().meanOverlap << std::endl;
+
+    std::cout << "Tree statistics match the tree: " << (statsOk && bulkStatsOk ? "Yes" : "No")
+            << (STATS_ENABLED ? " (query counters enabled)" : " (query counters compiled out)") << std::endl;
+    TreeStats insertedStats = tree.treeStats();
+    TreeStats bulkStats = bulkTree.treeStats();
+    std::cout << "Leaf fill / leaf sibling overlap - inserted: " << insertedStats.leafFill.mean << " / "
+            << insertedStats.levels.back().meanOverlap << ", bulk loaded: " << bulkStats.leafFill.mean << " / "
+            << bulkStats.levels.back().meanOverlap << std::endl;
+    std::cout << "Range search returns all points in range: " << (rangeSearchOk ? "Yes" : "No") << std::endl;
+    std::cout << "Tree is valid after removals: " << (removalOk ? "Yes" : "No") << std::endl;
+    std::cout << "Tree owns its data and resolves ids to embeddings and paths: " << (ownsDataOk ? "Yes" : "No") << std::endl;
+    std::cout << "Id index finds the leaf of every point: " << (leafIndexOk ? "Yes" : "No") << std::endl;
+    std::cout << "Projected routing keeps KNN exact: " << (routingOk ? "Yes" : "No") << std::endl;
+    std::cout << "Projected over full centroid distance, 8 of " << DIM << " dimensions (random / principal routing): "
+            << randomRoutingRatio << " / " << principalRoutingRatio << std::endl;
+    std::cout << "KNN and range search are exact under every metric, saved indexes included: " << (metricsOk ? "Yes" : "No") << std::endl;
+    std::cout << "Nodes visited by exact KNN@10 (euclidean / cosine / inner product): " << euclideanNodes << " / "
+            << cosineNodes << " / " << innerProductNodes << std::endl;
+    std::cout << "Filtered KNN and range search match a filtered brute-force scan: " << (filteredOk ? "Yes" : "No") << std::endl;
+    std::cout << "Leaves scanned by KNN@10 (filtered / unfiltered): " << filteredLeaves << " / " << unfilteredLeaves << std::endl;
+    std::cout << "Incremental search returns every point nearest first, starting with the KNN: "
+            << (incrementalOk ? "Yes" : "No") << std::endl;
+    std::cout << "Nodes visited for the first 10 neighbors (incremental / KNN@10): " << incrementalNodes << " / "
+            << knnNodes << std::endl;
+    std::cout << "Batched inserts keep the invariants: " << (batchedInsertsOk ? "Yes" : "No") << std::endl;
+    std::cout << "Batched inserts beat one insert at a time (batches of 1000): " << (batchSpeedup > 1.0 ? "Yes" : "No")
+            << " (" << batchSpeedup << "x)" << std::endl;
+    std::cout << "Concurrent inserts and searches keep the tree valid: " << (concurrentOk ? "Yes" : "No")
+            << " (" << concurrentSearches << " searches during the inserts)" << std::endl;
+    std::cout << "Concurrent insert speedup with 4 writers over 1 (" << std::thread::hardware_concurrency()
+            << " hardware threads): " << concurrentSpeedup << "x" << std::endl;
+    std::cout << "Memory-mapped index matches the tree: " << (mappedKnnMatchesTree(bulkTree, generateRandomData(50), 10) ? "Yes" : "No") << std::endl;
+    std::cout << "Memory-mapped index rejects corrupt section offsets: "
+            << (mappedRejectsCorruptHeaders(bulkTree) ? "Yes" : "No") << std::endl;
+    std::cout << "Batched KNN matches single queries: " << (knnBatchMatchesKnn(bulkTree, 100, 10, 4) ? "Yes" : "No") << std::endl;
+
+    std::cout << "KNN with a reused context allocates nothing: " << (contextOk ? "Yes" : "No") << std::endl;
+    std::cout << "Approximate KNN respects its budgets and error bound: " << (approximateOk ? "Yes" : "No") << std::endl;
+    std::cout << "Approximate KNN recall@10 scanning " << approximateOptions.maxLeaves << " of "
+            << bulkTree.memoryUsage().leaves << " leaves: " << approximateRecall << std::endl;
+
+    std::cout << "Int8 leaves - KNN recall@10 >= " << MIN_QUANTIZED_RECALL << ": "
+            << (int8Recall >= MIN_QUANTIZED_RECALL ? "Yes" : "No") << " (" << int8Recall << ")" << std::endl;
+    std::cout << "Float16 leaves - KNN recall@10 >= " << MIN_QUANTIZED_RECALL << ": "
+            << (halfRecall >= MIN_QUANTIZED_RECALL ? "Yes" : "No") << " (" << halfRecall << ")" << std::endl;
+    std::cout << "Leaf block memory (float / fp16 / int8): "
+            << bulkTree.memoryUsage().leafBlockBytes / (1024.0 * 1024.0) << " / "
+            << halfTree.memoryUsage().leafBlockBytes / (1024.0 * 1024.0) << " / "
+            << int8Tree.memoryUsage().leafBlockBytes / (1024.0 * 1024.0) << " MB" << std::endl;
+    // The data store keeps the exact embeddings in every format, so the total shrinks far less
+    std::cout << "Total index memory (float / fp16 / int8): "
+            << bulkTree.memoryUsage().totalBytes() / (1024.0 * 1024.0) << " / "
+            << halfTree.memoryUsage().totalBytes() / (1024.0 * 1024.0) << " / "
+            << int8Tree.memoryUsage().totalBytes() / (1024.0 * 1024.0) << " MB" << std::endl;
+
+    auto runtimePoints = generateRandomData<Eigen::Dynamic, double>(NUM_POINTS / 5, RUNTIME_DIM);
+    SSTree<Eigen::Dynamic, double> runtimeTree(MAX_POINTS_PER_NODE);
+    auto runtimeData = insertAll(runtimeTree, runtimePoints);
+
+    bool runtimeValid = allDataPresent(runtimeTree, runtimeData) && leavesAtSameLevel(runtimeTree.getRoot())
+            && noNodeExceedsMaxChildren(runtimeTree.getRoot(), MAX_POINTS_PER_NODE)
+            && sphereCoversAllPoints(runtimeTree.getRoot()) && sphereCoversAllChildrenSpheres(runtimeTree.getRoot())
+            && correctKnnSearch(runtimeTree, runtimeData);
+    std::cout << "Runtime dimension (" << RUNTIME_DIM << "-dim, double) tree is valid: "
+            << (runtimeValid ? "Yes" : "No") << std::endl;
+
     std::cout << "Happy ending! :D" << std::endl;
 
     return 0;